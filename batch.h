@@ -0,0 +1,413 @@
+#pragma once
+
+#include "z80emu.h"
+
+#include <new>
+
+namespace llz80emu {
+	#define Z80_BATCH_SPREAD					8 // lanes fetching the same opcode are run in one masked pass if they span fewer than this many lanes per member, or one by one otherwise
+
+	/* structure-of-arrays register file for z80emu_batch (each array is indexed by lane) */
+	template<size_t N> struct z80_batch_regs_t {
+		uint8_t A[N]; uint8_t F[N], B[N], C[N], D[N], E[N], H[N], L[N]; // main registers
+		uint8_t A_s[N], F_s[N], B_s[N], C_s[N], D_s[N], E_s[N], H_s[N], L_s[N]; // shadow registers
+		uint16_t IX[N], IY[N], SP[N], PC[N]; // index registers, stack pointer and program counter
+		uint8_t I[N], R[N], W[N], Z[N]; // other registers
+		uint16_t MEMPTR[N]; // undocumented - see z80_registers_t
+		uint8_t Q[N]; // undocumented assembled flags register value
+		uint8_t instr[N]; // last instruction byte
+		bool iff1[N], iff2[N]; // interrupt flip-flops
+		uint8_t int_mode[N]; // interrupt mode (0-2)
+	};
+
+	/*
+	 * N independent instruction-level Z80 instances stepped in lockstep. Each lane is a full z80emu, but while it sits at a quiet instruction
+	 * boundary its registers are moved into a structure-of-arrays register file. Lanes fetching the same register-only instruction (8-bit
+	 * loads, 8-bit arithmetic/logic, INC/DEC r, accumulator/flag operations, exchanges, NOP) then have it run together by one branchless,
+	 * masked loop over the register file, which the compiler vectorises for the target's SIMD extension (e.g. AVX2/AVX-512 or NEON). Lanes
+	 * that diverge onto another register-only instruction get a pass of their own, and everything else (memory and I/O accesses, branches,
+	 * interrupts, HALT) moves the lane's registers back and falls back to its own decoder. Results are identical to running the lanes
+	 * individually.
+	 */
+	template<size_t N> class z80emu_batch {
+	public:
+		z80emu_batch() {
+			for (size_t i = 0; i < N; i++) new (&lanes()[i]) z80emu(false);
+		}
+		~z80emu_batch() {
+			for (size_t i = 0; i < N; i++) lanes()[i].~z80emu();
+		}
+		z80emu_batch(const z80emu_batch&) = delete; // lanes hold references to their own members
+		z80emu_batch& operator=(const z80emu_batch&) = delete;
+
+		static constexpr size_t size() { return N; } // number of lanes
+		static inline bool lockstep_op(uint8_t op) { // return whether the (unprefixed) opcode is run in the register file
+			uint8_t x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+			switch (x) {
+			case 0: return op == 0x00 || op == 0x08 || ((z == 4 || z == 5) && y != 6) || z == 7; // NOP / EX AF,AF' / INC/DEC r / RLCA-CCF
+			case 1: return y != 6 && z != 6; // LD r,r'
+			case 2: return z != 6; // ALU A,r
+			default: return op == 0xD9 || op == 0xEB; // EXX / EX DE,HL
+			}
+		}
+
+		inline z80emu& lane(size_t i) { sync(i); return lanes()[i]; } // access a lane directly (e.g. for set_bus() or interrupts), moving its registers back into it first
+
+		void reset() { // reset every lane (see z80emu::reset())
+			for (size_t i = 0; i < N; i++) lane(i).reset();
+		}
+
+		void step(int* tstates_out = nullptr) { // execute one instruction on every lane, storing the number of T cycles taken by each lane in tstates_out (if given)
+			for (size_t i = 0; i < N; i++) {
+				int t = (int)fetch(i, false);
+				if (tstates_out) tstates_out[i] = t;
+			}
+			execute();
+		}
+
+		void run(uint64_t tstates, uint64_t* tstates_out = nullptr) { // run every lane for at least the specified number of T cycles (see z80emu::run()), storing the actual number taken by each lane in tstates_out (if given)
+			for (size_t i = 0; i < N; i++) {
+				_done[i] = 0; _live[i] = true;
+				if (!lanes()[i].lockstep_capable()) { // nothing to share - run it on its own
+					_done[i] = lane(i).run(tstates);
+					_live[i] = false;
+				}
+			}
+			for (bool live = true; live; ) {
+				live = false;
+				for (size_t i = 0; i < N; i++) {
+					_run[i] = 0;
+					if (!_live[i]) continue;
+					uint64_t t = fetch(i, true);
+					_done[i] += t;
+					if (!t || _done[i] >= tstates) _live[i] = false; // still in reset, or done
+					else live = true;
+				}
+				execute();
+			}
+			if (tstates_out) for (size_t i = 0; i < N; i++) tstates_out[i] = _done[i];
+		}
+
+		void get_regs(z80_batch_regs_t<N>& regs) { // gather registers of every lane
+			for (size_t i = 0; i < N; i++) {
+				if (!_soa[i]) load_regs(i);
+			}
+			regs = _regs;
+		}
+
+		void set_regs(const z80_batch_regs_t<N>& regs) { // scatter registers to every lane
+			for (size_t i = 0; i < N; i++) sync(i); // (which may change whether lanes can stay in the register file)
+			_regs = regs;
+			for (size_t i = 0; i < N; i++) store_regs(i);
+		}
+
+		z80_counters_t get_counters() { // get the performance counters summed over every lane
+			z80_counters_t sum = {};
+			for (size_t i = 0; i < N; i++) {
+				z80_counters_t c = lane(i).get_counters();
+				sum.half_cycles += c.half_cycles; sum.tstates += c.tstates;
+				for (int j = 0; j < Z80_CYCLE_TYPES; j++) sum.mcycles[j] += c.mcycles[j];
+				sum.instructions += c.instructions; sum.wait_states += c.wait_states; sum.busrel_cycles += c.busrel_cycles;
+				sum.ints += c.ints; sum.nmis += c.nmis;
+			}
+			return sum;
+		}
+	private:
+		alignas(z80emu) unsigned char _lanes[N * sizeof(z80emu)]; // lane storage (constructed in place)
+		inline z80emu* lanes() { return reinterpret_cast<z80emu*>(_lanes); }
+
+		z80_batch_regs_t<N> _regs = {}; // register file (holding the registers of lanes that have _soa set)
+		uint8_t _soa[N] = {}; // 0xFF if the lane's registers are in the register file, 0 if they are in the lane
+		uint8_t _run[N] = {}; // 0xFF if the lane is running _op in the register file this round
+		uint8_t _op[N] = {}; // opcode fetched this round
+		uint8_t _mask[N] = {}; // 0xFF for lanes in the pass being executed
+		uint8_t _rfsh[N] = {}; // R at the last opcode fetch (for the refresh address left on the pins)
+		uint64_t _count[N] = {}; // number of instructions run in the register file since moving the registers in
+		uint64_t _budget[N] = {}; // number of T cycles that can be run in the register file before the lane's scheduled INT is asserted
+		uint64_t _done[N] = {}; // T cycles taken so far by run()
+		bool _live[N] = {}; // set while run() has yet to finish the lane
+
+		/* opcode groups (see execute()) */
+		uint8_t _ops[N] = {}; // distinct opcodes fetched this round
+		uint32_t _members[256] = {}; // number of lanes that have fetched each opcode (0 outside of execute())
+		uint32_t _first[256] = {}, _last[256] = {}; // first and last of those lanes
+		uint32_t _next[N] = {}; // next lane that has fetched the same opcode
+
+		/* moving registers between lanes and the register file */
+		void load_regs(size_t i) {
+			const z80_registers_t& r = lanes()[i]._regs;
+			_regs.A[i] = r.REG_A; _regs.F[i] = r.REG_F; _regs.B[i] = r.REG_B; _regs.C[i] = r.REG_C;
+			_regs.D[i] = r.REG_D; _regs.E[i] = r.REG_E; _regs.H[i] = r.REG_H; _regs.L[i] = r.REG_L;
+			_regs.A_s[i] = r.REG_A_S; _regs.F_s[i] = r.REG_F_S; _regs.B_s[i] = r.REG_B_S; _regs.C_s[i] = r.REG_C_S;
+			_regs.D_s[i] = r.REG_D_S; _regs.E_s[i] = r.REG_E_S; _regs.H_s[i] = r.REG_H_S; _regs.L_s[i] = r.REG_L_S;
+			_regs.IX[i] = r.REG_IX; _regs.IY[i] = r.REG_IY; _regs.SP[i] = r.REG_SP; _regs.PC[i] = r.REG_PC;
+			_regs.I[i] = r.REG_I; _regs.R[i] = r.REG_R; _regs.W[i] = r.REG_W; _regs.Z[i] = r.REG_Z; _regs.MEMPTR[i] = r.MEMPTR;
+			_regs.Q[i] = r.Q; _regs.instr[i] = r.instr;
+			_regs.iff1[i] = r.iff1; _regs.iff2[i] = r.iff2; _regs.int_mode[i] = r.int_mode;
+		}
+		void store_regs(size_t i) {
+			z80_registers_t& r = lanes()[i]._regs;
+			r.REG_A = _regs.A[i]; r.REG_F = _regs.F[i]; r.REG_B = _regs.B[i]; r.REG_C = _regs.C[i];
+			r.REG_D = _regs.D[i]; r.REG_E = _regs.E[i]; r.REG_H = _regs.H[i]; r.REG_L = _regs.L[i];
+			r.REG_A_S = _regs.A_s[i]; r.REG_F_S = _regs.F_s[i]; r.REG_B_S = _regs.B_s[i]; r.REG_C_S = _regs.C_s[i];
+			r.REG_D_S = _regs.D_s[i]; r.REG_E_S = _regs.E_s[i]; r.REG_H_S = _regs.H_s[i]; r.REG_L_S = _regs.L_s[i];
+			r.REG_IX = _regs.IX[i]; r.REG_IY = _regs.IY[i]; r.REG_SP = _regs.SP[i]; r.REG_PC = _regs.PC[i];
+			r.REG_I = _regs.I[i]; r.REG_R = _regs.R[i]; r.REG_W = _regs.W[i]; r.REG_Z = _regs.Z[i]; r.MEMPTR = _regs.MEMPTR[i];
+			r.Q = _regs.Q[i]; r.instr = _regs.instr[i];
+			r.iff1 = _regs.iff1[i]; r.iff2 = _regs.iff2[i]; r.int_mode = _regs.int_mode[i];
+		}
+		void sync(size_t i) { // move the lane's registers back into it (if they're in the register file), catching up on everything else
+			if (!_soa[i]) return;
+			store_regs(i);
+			if (_count[i]) lanes()[i].retire_lockstep(_regs.instr[i], _rfsh[i], _count[i]);
+			_soa[i] = 0;
+		}
+
+		/* fetch lane i's next opcode if it can run in the register file (setting _run), or run its next instruction (or run() iteration) otherwise - return the number of T cycles taken */
+		uint64_t fetch(size_t i, bool run) {
+			z80emu& cpu = lanes()[i];
+			_run[i] = 0;
+			if (_soa[i] && _count[i] * 4 >= _budget[i]) sync(i); // the scheduled INT is due
+			if (!_soa[i] && cpu.lockstep_ready()) {
+				load_regs(i);
+				_soa[i] = 0xFF; _count[i] = 0;
+				_budget[i] = cpu.run_limit(UINT64_MAX);
+			}
+			if (!_soa[i]) return (run) ? cpu.run(1) : (uint64_t)cpu.step_instruction(); // (run(1) being a single iteration of run())
+
+			uint8_t op = cpu._bus.mem_read(cpu._bus.ctx, _regs.PC[i]);
+			if (!lockstep_op(op)) {
+				sync(i);
+				return cpu.step_fetched(op);
+			}
+			_op[i] = op; _run[i] = 0xFF;
+			return 4;
+		}
+
+		/* run the fetched opcodes in the register file, one pass per distinct opcode */
+		void execute() {
+			/* opcode fetch side effects (see z80_fetch_cycle::replay()), which are the same for all */
+			for (size_t i = 0; i < N; i++) {
+				uint8_t m = _run[i];
+				_rfsh[i] = (_regs.R[i] & m) | (_rfsh[i] & ~m);
+				_regs.R[i] = (((_regs.R[i] + 1) & 0x7F) & m) | (_regs.R[i] & ~m);
+				_regs.PC[i] += m & 1;
+				_regs.instr[i] = (_op[i] & m) | (_regs.instr[i] & ~m);
+				_count[i] += m & 1;
+			}
+
+			/* group lanes by opcode (in lane order) */
+			size_t ops = 0;
+			for (size_t i = 0; i < N; i++) {
+				if (!_run[i]) continue;
+				uint8_t op = _op[i];
+				if (!_members[op]++) { _ops[ops++] = op; _first[op] = (uint32_t)i; }
+				else _next[_last[op]] = (uint32_t)i;
+				_last[op] = (uint32_t)i;
+			}
+
+			/* one masked pass over the lanes spanned by each group, or (for groups spread too thinly for that to pay off) one pass per lane */
+			for (size_t k = 0; k < ops; k++) {
+				uint8_t op = _ops[k];
+				size_t first = _first[op], last = _last[op], members = _members[op];
+				_members[op] = 0;
+				if (members > 1 && last - first < Z80_BATCH_SPREAD * members) {
+					for (size_t i = first; i <= last; i++) _mask[i] = (_run[i] && _op[i] == op) ? 0xFF : 0;
+					exec(op, first, last + 1);
+					for (size_t i = first; i <= last; i++) _mask[i] = 0;
+				}
+				else {
+					for (size_t i = first; members--; i = _next[i]) {
+						_mask[i] = 0xFF;
+						exec(op, i, i + 1);
+						_mask[i] = 0;
+					}
+				}
+			}
+		}
+
+		/* flags from a result byte (as in z80_flag_tables, but computed so that loops over lanes can be vectorised) */
+		static inline uint8_t sz53(uint8_t r) { return (r & (Z80_FLAG_S | Z80_FLAG_F5 | Z80_FLAG_F3)) | ((r) ? 0 : Z80_FLAG_Z); }
+		static inline uint8_t parity(uint8_t r) { // P/V set if the result has even parity
+			uint8_t p = r ^ (r >> 4); p ^= p >> 2; p ^= p >> 1;
+			return (~p & 1) << Z80_FLAGBIT_PV;
+		}
+		static inline uint8_t blend(uint8_t m, uint8_t a, uint8_t b) { return (a & m) | (b & ~m); } // a for lanes in the pass, b for the others
+
+		/* run opcode op on lanes [lo, hi) that have _mask set */
+		void exec(uint8_t op, size_t lo, size_t hi) {
+			uint8_t x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+			uint8_t* r8[8] = { _regs.B, _regs.C, _regs.D, _regs.E, _regs.H, _regs.L, nullptr, _regs.A };
+			const uint8_t* m = _mask;
+			uint8_t* q = _regs.Q;
+			switch (x) {
+			case 0:
+				if (z == 4) exec_inc(r8[y], lo, hi);
+				else if (z == 5) exec_dec(r8[y], lo, hi);
+				else if (z == 7) {
+					switch (y) {
+					case 0: exec_acc<0>(lo, hi); break;
+					case 1: exec_acc<1>(lo, hi); break;
+					case 2: exec_acc<2>(lo, hi); break;
+					case 3: exec_acc<3>(lo, hi); break;
+					case 4: exec_daa(lo, hi); break;
+					case 5: exec_acc<5>(lo, hi); break;
+					case 6: exec_acc<6>(lo, hi); break;
+					default: exec_acc<7>(lo, hi); break;
+					}
+				}
+				else {
+					if (op == 0x08) { // EX AF,AF'
+						exec_swap(_regs.A, _regs.A_s, lo, hi); exec_swap(_regs.F, _regs.F_s, lo, hi);
+					}
+					for (size_t i = lo; i < hi; i++) q[i] &= ~m[i]; // NOP and EX AF,AF' don't set flags
+				}
+				break;
+			case 1: { // LD r,r'
+				uint8_t* dst = r8[y]; const uint8_t* src = r8[z];
+				for (size_t i = lo; i < hi; i++) {
+					dst[i] = blend(m[i], src[i], dst[i]);
+					q[i] &= ~m[i];
+				}
+				break;
+			}
+			case 2:
+				switch (y) {
+				case 0: exec_alu<0>(r8[z], lo, hi); break;
+				case 1: exec_alu<1>(r8[z], lo, hi); break;
+				case 2: exec_alu<2>(r8[z], lo, hi); break;
+				case 3: exec_alu<3>(r8[z], lo, hi); break;
+				case 4: exec_alu<4>(r8[z], lo, hi); break;
+				case 5: exec_alu<5>(r8[z], lo, hi); break;
+				case 6: exec_alu<6>(r8[z], lo, hi); break;
+				default: exec_alu<7>(r8[z], lo, hi); break;
+				}
+				break;
+			default:
+				if (op == 0xD9) { // EXX
+					exec_swap(_regs.B, _regs.B_s, lo, hi); exec_swap(_regs.C, _regs.C_s, lo, hi);
+					exec_swap(_regs.D, _regs.D_s, lo, hi); exec_swap(_regs.E, _regs.E_s, lo, hi);
+					exec_swap(_regs.H, _regs.H_s, lo, hi); exec_swap(_regs.L, _regs.L_s, lo, hi);
+				}
+				else { // EX DE,HL
+					exec_swap(_regs.D, _regs.H, lo, hi); exec_swap(_regs.E, _regs.L, lo, hi);
+				}
+				for (size_t i = lo; i < hi; i++) q[i] &= ~m[i];
+				break;
+			}
+		}
+
+		void exec_swap(uint8_t* a, uint8_t* b, size_t lo, size_t hi) {
+			const uint8_t* m = _mask;
+			for (size_t i = lo; i < hi; i++) {
+				uint8_t t = a[i];
+				a[i] = blend(m[i], b[i], a[i]);
+				b[i] = blend(m[i], t, b[i]);
+			}
+		}
+
+		void exec_inc(uint8_t* r, size_t lo, size_t hi) { // INC r (see z80_instr_decoder::exec_inc_r8())
+			const uint8_t* m = _mask; uint8_t* f = _regs.F; uint8_t* q = _regs.Q;
+			for (size_t i = lo; i < hi; i++) {
+				uint8_t v = r[i] + 1;
+				uint8_t fl = (f[i] & Z80_FLAG_C) | sz53(v)
+					| ((v & 0x0F) ? 0 : Z80_FLAG_H) // carry out of the low nibble
+					| ((v == 0x80) ? Z80_FLAG_PV : 0); // overflow
+				r[i] = blend(m[i], v, r[i]);
+				f[i] = blend(m[i], fl, f[i]);
+				q[i] = blend(m[i], fl, q[i]);
+			}
+		}
+
+		void exec_dec(uint8_t* r, size_t lo, size_t hi) { // DEC r (see z80_instr_decoder::exec_dec_r8())
+			const uint8_t* m = _mask; uint8_t* f = _regs.F; uint8_t* q = _regs.Q;
+			for (size_t i = lo; i < hi; i++) {
+				uint8_t v = r[i] - 1;
+				uint8_t fl = (f[i] & Z80_FLAG_C) | sz53(v) | Z80_FLAG_N
+					| (((v & 0x0F) == 0x0F) ? Z80_FLAG_H : 0) // borrow from the high nibble
+					| ((v == 0x7F) ? Z80_FLAG_PV : 0); // overflow
+				r[i] = blend(m[i], v, r[i]);
+				f[i] = blend(m[i], fl, f[i]);
+				q[i] = blend(m[i], fl, q[i]);
+			}
+		}
+
+		template<int OP> void exec_alu(const uint8_t* src, size_t lo, size_t hi) { // ALU operation OP on A and src (see z80_alu_op())
+			const uint8_t* m = _mask; uint8_t* a = _regs.A; uint8_t* f = _regs.F; uint8_t* q = _regs.Q; uint8_t* wz = _regs.Z;
+			for (size_t i = lo; i < hi; i++) {
+				uint8_t x = a[i], y = src[i], c = (OP == 1 || OP == 3) ? (f[i] & Z80_FLAG_C) : 0, r, fl;
+				if (OP <= 1) { // ADD/ADC
+					r = x + y + c;
+					fl = sz53(r)
+						| ((x ^ y ^ r) & Z80_FLAG_H)
+						| (((x ^ r) & (y ^ r) & 0x80) >> (7 - Z80_FLAGBIT_PV))
+						| (((x & y) | ((x | y) & ~r)) >> 7);
+				}
+				else if (OP == 2 || OP == 3 || OP == 7) { // SUB/SBC/CP
+					r = x - y - c;
+					fl = ((OP == 7) ? ((sz53(r) & (Z80_FLAG_S | Z80_FLAG_Z)) | (y & (Z80_FLAG_F3 | Z80_FLAG_F5))) : sz53(r)) // bits 3 and 5 are copied from the operand for CP
+						| ((x ^ y ^ r) & Z80_FLAG_H)
+						| (((x ^ y) & (x ^ r) & 0x80) >> (7 - Z80_FLAGBIT_PV))
+						| (((~x & y) | (~(x ^ y) & r)) >> 7)
+						| Z80_FLAG_N;
+				}
+				else {
+					r = (OP == 4) ? (x & y) : (OP == 5) ? (x ^ y) : (x | y); // AND/XOR/OR
+					fl = sz53(r) | parity(r) | ((OP == 4) ? Z80_FLAG_H : 0);
+				}
+				if (OP != 7) a[i] = blend(m[i], r, x); // CP discards the result
+				wz[i] = blend(m[i], y, wz[i]); // the operand goes through Z
+				f[i] = blend(m[i], fl, f[i]);
+				q[i] = blend(m[i], fl, q[i]);
+			}
+		}
+
+		template<int Y> void exec_acc(size_t lo, size_t hi) { // RLCA/RRCA/RLA/RRA/CPL/SCF/CCF (see z80_acc_op())
+			const uint8_t* m = _mask; uint8_t* a = _regs.A; uint8_t* f = _regs.F; uint8_t* q = _regs.Q;
+			for (size_t i = lo; i < hi; i++) {
+				uint8_t x = a[i], fo = f[i], r = x, fl;
+				if (Y <= 3) {
+					uint8_t c = (Y & 1) ? (x & 1) : (x >> 7); // bit shifted out
+					uint8_t in = (Y & 2) ? (fo & Z80_FLAG_C) : c; // bit shifted in (old carry for RLA/RRA)
+					r = (Y & 1) ? ((x >> 1) | (in << 7)) : ((x << 1) | in);
+					fl = (fo & (Z80_FLAG_S | Z80_FLAG_Z | Z80_FLAG_PV)) | c | (r & (Z80_FLAG_F3 | Z80_FLAG_F5));
+				}
+				else if (Y == 5) { // CPL
+					r = ~x;
+					fl = (fo & ~(Z80_FLAG_F3 | Z80_FLAG_F5)) | (r & (Z80_FLAG_F3 | Z80_FLAG_F5)) | Z80_FLAG_H | Z80_FLAG_N;
+				}
+				else { // SCF/CCF
+					fl = (fo & ~(Z80_FLAG_H | Z80_FLAG_N | Z80_FLAG_F3 | Z80_FLAG_F5))
+						| (((q[i] ^ fo) | x) & (Z80_FLAG_F3 | Z80_FLAG_F5));
+					fl = (Y == 6) ? (fl | Z80_FLAG_C) : ((fl | ((fo & Z80_FLAG_C) << Z80_FLAGBIT_H)) ^ Z80_FLAG_C);
+				}
+				a[i] = blend(m[i], r, x);
+				f[i] = blend(m[i], fl, fo);
+				q[i] = blend(m[i], fl, q[i]);
+			}
+		}
+
+		void exec_daa(size_t lo, size_t hi) { // DAA (see z80_acc_op())
+			const uint8_t* m = _mask; uint8_t* a = _regs.A; uint8_t* f = _regs.F; uint8_t* q = _regs.Q; uint8_t* w = _regs.W;
+			for (size_t i = lo; i < hi; i++) {
+				uint8_t x = a[i], fo = f[i];
+				uint8_t hc = ((fo & Z80_FLAG_H) || (x & 0x0F) > 9) ? 0x06 : 0;
+				uint8_t cc = ((fo & Z80_FLAG_C) || x > 0x99) ? 0x60 : 0;
+				uint8_t corr = hc | cc, r, h;
+				if (fo & Z80_FLAG_N) {
+					r = x - corr;
+					h = ((x & 0x0F) < hc) ? Z80_FLAG_H : 0;
+				}
+				else {
+					r = x + corr;
+					h = (((x & 0x0F) + hc) & 0xF0) ? Z80_FLAG_H : 0;
+				}
+				uint8_t fl = (fo & Z80_FLAG_N) | ((cc) ? Z80_FLAG_C : 0) | h | sz53(r) | parity(r);
+				a[i] = blend(m[i], r, x);
+				w[i] = blend(m[i], corr, w[i]); // W holds the correction
+				f[i] = blend(m[i], fl, fo);
+				q[i] = blend(m[i], fl, q[i]);
+			}
+		}
+	};
+}
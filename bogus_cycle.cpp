@@ -11,6 +11,14 @@ void z80_bogus_cycle::reset(int cycles) {
 	//_last_half_cb = last_half_cb;
 }
 
+void z80_bogus_cycle::get_state(z80_cycle_state_t& state) const {
+	state.cycles = _cycles; // the T cycle number is neither reset nor used here (and bus release is never staged), so it's left out
+}
+
+void z80_bogus_cycle::set_state(const z80_cycle_state_t& state) {
+	_cycles = state.cycles;
+}
+
 bool z80_bogus_cycle::clock(bool clk) {
 	z80_cycle::clock(clk);
 
@@ -0,0 +1,32 @@
+#include "breakpoints.h"
+#include <string.h>
+
+using namespace llz80emu;
+
+z80_breakpoints::z80_breakpoints() {
+	clear();
+}
+
+void z80_breakpoints::set(uint8_t types, uint16_t addr, size_t len, bool state) {
+	if (len > 0x10000) len = 0x10000;
+	for (int type = 0; type < Z80_BREAK_TYPES; type++) {
+		if (!(types & (1 << type))) continue;
+		for (size_t i = 0; i < len; i++) {
+			uint16_t a = (uint16_t)(addr + i);
+			uint64_t bit = (uint64_t)1 << (a & 63);
+			if (state) _bits[type][a >> 6] |= bit;
+			else _bits[type][a >> 6] &= ~bit;
+		}
+	}
+}
+
+void z80_breakpoints::clear() {
+	memset(_bits, 0, sizeof(_bits));
+}
+
+bool z80_breakpoints::take(z80_break_t& brk) {
+	if (_hits == _taken) return false;
+	_taken = _hits;
+	brk = _last;
+	return true;
+}
\ No newline at end of file
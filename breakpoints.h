@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace llz80emu {
+	/* breakpoint/watchpoint types (see z80emu::set_breakpoint()) */
+	/* bitmap indices */
+	#define Z80_BREAK_IDX_EXEC					0
+	#define Z80_BREAK_IDX_READ					1
+	#define Z80_BREAK_IDX_WRITE					2
+	#define Z80_BREAK_IDX_IN					3
+	#define Z80_BREAK_IDX_OUT					4
+	#define Z80_BREAK_TYPES						5 // number of bitmaps
+
+	typedef enum {
+		Z80_BREAK_EXEC = (1 << Z80_BREAK_IDX_EXEC), // instruction about to be executed (opcode fetch of its first byte)
+		Z80_BREAK_READ = (1 << Z80_BREAK_IDX_READ), // memory read (opcode fetches excluded)
+		Z80_BREAK_WRITE = (1 << Z80_BREAK_IDX_WRITE), // memory write
+		Z80_BREAK_IN = (1 << Z80_BREAK_IDX_IN), // I/O read (full 16-bit port address)
+		Z80_BREAK_OUT = (1 << Z80_BREAK_IDX_OUT), // I/O write (full 16-bit port address)
+		Z80_BREAK_ALL = (1 << Z80_BREAK_TYPES) - 1
+	} z80_break_type_t;
+
+	typedef struct {
+		uint8_t type; // Z80_BREAK_* type of the access that hit
+		uint16_t addr; // memory address or port
+		uint8_t val; // value to be written (Z80_BREAK_WRITE/Z80_BREAK_OUT - 0 otherwise)
+	} z80_break_t;
+
+	/* execute/read/write/in/out bitmaps covering the whole address and port space, so that each access is checked with a single bit test */
+	class z80_breakpoints {
+	public:
+		z80_breakpoints();
+
+		void set(uint8_t types, uint16_t addr, size_t len, bool state); // set or clear the bits for [addr, addr + len) (wrapping around) in the bitmaps of the specified types
+		void clear(); // clear all bitmaps
+
+		inline void check(int type, uint16_t addr, uint8_t val = 0) { // check an access with bitmap index type (Z80_BREAK_IDX_*), and record a hit if its bit is set
+			if ((_bits[type][addr >> 6] >> (addr & 63)) & 1) {
+				_last.type = (uint8_t)(1 << type); _last.addr = addr; _last.val = val;
+				_hits++;
+			}
+		}
+
+		inline uint64_t hits() const { return _hits; } // number of hits recorded
+		bool take(z80_break_t& brk); // get the latest hit, returning false if there hasn't been any since the last call
+	private:
+		uint64_t _bits[Z80_BREAK_TYPES][0x10000 / 64]; // one bit per address/port
+		uint64_t _hits = 0;
+		uint64_t _taken = 0; // value of _hits on the last take()
+		z80_break_t _last = {};
+	};
+}
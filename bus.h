@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "pins.h"
+
+namespace llz80emu {
+	/* host bus callbacks for instruction-level execution (see z80emu::step_instruction()) */
+	typedef uint8_t (*z80_mem_read_cb_t)(void* ctx, uint16_t addr); // memory read (also used for opcode fetches)
+	typedef void (*z80_mem_write_cb_t)(void* ctx, uint16_t addr, uint8_t val); // memory write
+	typedef uint8_t (*z80_io_read_cb_t)(void* ctx, uint16_t addr); // I/O read (full 16-bit port address)
+	typedef void (*z80_io_write_cb_t)(void* ctx, uint16_t addr, uint8_t val); // I/O write (full 16-bit port address)
+	typedef uint8_t (*z80_intack_cb_t)(void* ctx); // interrupt acknowledgment (returns the value placed on the data bus by the interrupting peripheral)
+
+	/* host bus handler for batched pin-level execution (see z80emu::clock_n()) */
+	typedef bool (*z80_pin_handler_t)(void* ctx, const z80_pins_t& pins, z80_pinbits_t& state); // called with the pins following a half-cycle on which the bus is active; the handler updates the input pin state to be used from the next half-cycle on, and returns false to stop clocking
+
+	typedef struct {
+		void* ctx; // opaque pointer passed to all callbacks
+		z80_mem_read_cb_t mem_read;
+		z80_mem_write_cb_t mem_write;
+		z80_io_read_cb_t io_read;
+		z80_io_write_cb_t io_write;
+		z80_intack_cb_t intack; // optional - 0xFF (floating data bus) will be used if this is null
+	} z80_bus_t;
+
+	/*
+	 * bus classes for templated instruction-level execution (see z80emu::step_instruction<Bus>() and z80emu::run<Bus>()) provide:
+	 *  - uint8_t read(uint16_t addr): memory read (also used for opcode fetches)
+	 *  - void write(uint16_t addr, uint8_t val): memory write
+	 *  - uint8_t in(uint16_t port): I/O read (full 16-bit port address)
+	 *  - void out(uint16_t port, uint8_t val): I/O write (full 16-bit port address)
+	 *  - uint8_t intack(): interrupt acknowledgment
+	 * These are called directly (and can be inlined) by the cycle code.
+	 */
+
+	/* bus class going through z80_bus_t callbacks (used by the non-templated execution methods) */
+	class z80_callback_bus {
+	public:
+		inline z80_callback_bus(const z80_bus_t& bus) : _bus(bus) {}
+		inline uint8_t read(uint16_t addr) { return _bus.mem_read(_bus.ctx, addr); }
+		inline void write(uint16_t addr, uint8_t val) { _bus.mem_write(_bus.ctx, addr, val); }
+		inline uint8_t in(uint16_t port) { return _bus.io_read(_bus.ctx, port); }
+		inline void out(uint16_t port, uint8_t val) { _bus.io_write(_bus.ctx, port, val); }
+		inline uint8_t intack() { return (_bus.intack) ? _bus.intack(_bus.ctx) : 0xFF; } // data bus floats high if there's no handler
+	private:
+		const z80_bus_t& _bus;
+	};
+
+	/* z80_bus_t callbacks going through a bus class (for code that can only take callbacks, e.g. the dynarec's translator) */
+	template<class Bus> inline z80_bus_t z80_bus_callbacks(Bus& bus) {
+		z80_bus_t cb = {
+			&bus,
+			[](void* ctx, uint16_t addr) -> uint8_t { return ((Bus*)ctx)->read(addr); },
+			[](void* ctx, uint16_t addr, uint8_t val) { ((Bus*)ctx)->write(addr, val); },
+			[](void* ctx, uint16_t port) -> uint8_t { return ((Bus*)ctx)->in(port); },
+			[](void* ctx, uint16_t port, uint8_t val) { ((Bus*)ctx)->out(port, val); },
+			[](void* ctx) -> uint8_t { return ((Bus*)ctx)->intack(); }
+		};
+		return cb;
+	}
+}
\ No newline at end of file
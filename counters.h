@@ -0,0 +1,32 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cycle.h"
+#include "opinfo.h"
+
+namespace llz80emu {
+	/* performance counters (see z80emu::get_counters()) - compiled out when building with LLZ80EMU_NO_COUNTERS */
+	typedef struct {
+		uint64_t half_cycles; // clock() calls
+		uint64_t tstates; // T cycles run (wait states and bus release included)
+		uint64_t mcycles[Z80_CYCLE_TYPES]; // machine cycles started, indexed by z80_cycle_type_t
+		uint64_t instructions; // instructions retired (prefixes count as part of their instruction - interrupt responses and halted fetches are not included)
+		uint64_t wait_states; // T cycles inserted by WAIT
+		uint64_t busrel_cycles; // T cycles spent with the bus released
+		uint64_t ints; // INT responses
+		uint64_t nmis; // NMI responses
+	} z80_counters_t;
+
+	/* machine cycle counts from z80_opinfo_t are added to mcycles directly */
+	static_assert((int)Z80_MCYCLE_FETCH == (int)Z80_FETCH_CYCLE && (int)Z80_MCYCLE_MEM_READ == (int)Z80_MEM_READ_CYCLE && (int)Z80_MCYCLE_MEM_WRITE == (int)Z80_MEM_WRITE_CYCLE
+		&& (int)Z80_MCYCLE_IO_READ == (int)Z80_IO_READ_CYCLE && (int)Z80_MCYCLE_IO_WRITE == (int)Z80_IO_WRITE_CYCLE && (int)Z80_MCYCLE_BOGUS == (int)Z80_BOGUS_CYCLE,
+		"z80_mcycle_type_t must share its ordering with z80_cycle_type_t");
+
+#if !defined(LLZ80EMU_NO_COUNTERS)
+#define Z80_COUNT(expr)							do { expr; } while (0) // update performance counters
+#else
+#define Z80_COUNT(expr)							do {} while (0)
+#endif
+}
@@ -1,4 +1,5 @@
 #include "cycle.h"
+#include "counters.h"
 
 using namespace llz80emu;
 
@@ -6,13 +7,24 @@ z80_cycle::z80_cycle(z80_pins_t& pins, z80_cycle_type_t cyc_type) : _pins(pins),
 
 }
 
+void z80_cycle::set_counters(uint64_t* wait_states, uint64_t* busrel_cycles) {
+	_wait_states = wait_states;
+	_busrel_cycles = busrel_cycles;
+}
+
 void z80_cycle::reset() {
 	_t = -1; // upon next clock, we will increment this to 0
+	_bus_release = false; // until BUSREQ is sampled (a cycle cut short by RESET or by restoring a snapshot may have left it set)
+}
+
+void z80_cycle::get_state(z80_cycle_state_t& state) const {
+	state.t = _t;
+	state.bus_release = _bus_release;
 }
 
-bool z80_cycle::clock(bool clk) {
-	if (clk) _t++; // increment T cycle
-	return true; // always return true, as we don't know if the cycle has finished
+void z80_cycle::set_state(const z80_cycle_state_t& state) {
+	_t = state.t;
+	_bus_release = state.bus_release;
 }
 
 void z80_cycle::sample_busreq() {
@@ -25,6 +37,7 @@ bool z80_cycle::handle_bus_release(bool clk) {
 
 		sample_busreq(); // resample BUSREQ for next cycle
 		_pins = Z80_PINS_BUSREL;
+		Z80_COUNT((*_busrel_cycles)++);
 	}
 	return true;
 }
\ No newline at end of file
@@ -2,6 +2,8 @@
 
 #include "pins.h"
 #include "registers.h"
+#include "bus.h"
+#include "dirty.h"
 
 namespace llz80emu {
 	typedef enum {
@@ -11,16 +13,42 @@ namespace llz80emu {
 		Z80_IO_READ_CYCLE,
 		Z80_IO_WRITE_CYCLE,
 		Z80_BOGUS_CYCLE,
-		Z80_INTACK_CYCLE
+		Z80_INTACK_CYCLE,
+		Z80_CYCLE_TYPES
 	} z80_cycle_type_t;
 
+	/* state of a cycle in progress (for z80emu::save_state()/load_state()) - fields not used by a cycle type are left alone */
+	typedef struct {
+		int t; // T cycle number
+		bool bus_release; // bus release staged
+		bool wait; // WAIT state to be inserted
+		bool halt; // halted opcode fetch
+		uint16_t addr; // address
+		uint8_t val; // value to be written
+		int cycles; // bogus cycles remaining
+		uint8_t* val_out; // location to read into
+	} z80_cycle_state_t;
+
 	class z80_cycle {
 	public:
 		z80_cycle(z80_pins_t& pins, z80_cycle_type_t cyc_type);
 		const int& t = _t; // T cycle number (constant - for access by z80emu)
 		const z80_cycle_type_t type;
 
-		virtual bool clock(bool clk); // clock the CPU by one half-cycle (rising edge or falling edge) - this will be called by z80emu::clock(), and will return true if the cycle has finished
+		void set_counters(uint64_t* wait_states, uint64_t* busrel_cycles); // set the counters to be incremented on WAIT states and bus release T cycles (see z80emu::get_counters()) - must be done before clocking
+		inline bool releasing() const { return _bus_release; } // return whether the CPU is staged to release (or keep releasing) the bus
+		void get_state(z80_cycle_state_t& state) const; // save the cycle's state (these are shadowed by the subclasses with state of their own)
+		void set_state(const z80_cycle_state_t& state); // restore the cycle's state
+
+		/*
+		 * NOTE: cycle methods are not virtual - z80emu dispatches on type to the concrete cycle class instead. Each subclass provides:
+		 *  - bool clock(bool clk): clock the CPU by one half-cycle (rising edge or falling edge) - this will be called by z80emu::clock(), and will return true if the cycle has finished
+		 *  - template<class Bus> int run(Bus& bus): run the entire cycle at once through a bus class (see bus.h - for instruction-level execution) and return the number of T cycles taken
+		 */
+		inline bool clock(bool clk) {
+			if (clk) _t++; // increment T cycle
+			return true; // always return true, as we don't know if the cycle has finished
+		}
 	protected:
 		void reset(); // prepare cycle instance for invocation
 		z80_pins_t& _pins; // the pins of the Z80 CPU
@@ -30,6 +58,10 @@ namespace llz80emu {
 		void sample_busreq(); // to be called on rising edge of last T cycle
 		bool handle_bus_release(bool clk); // to be called on T cycles after the last one; return false if there was nothing to be done
 		bool _bus_release = false; // set if the CPU is staged to release the bus on the next T cycle
+
+		/* performance counters (owned by z80emu) */
+		uint64_t* _wait_states = nullptr;
+		uint64_t* _busrel_cycles = nullptr;
 	};
 
 	class z80_fetch_cycle : public z80_cycle {
@@ -37,7 +69,12 @@ namespace llz80emu {
 		z80_fetch_cycle(z80_pins_t& pins, z80_registers_t& regs);
 
 		void reset(bool halt);
-		bool clock(bool clk) override;
+		bool clock(bool clk);
+		template<class Bus> inline int run(Bus& bus) { return replay(bus.read(_regs.REG_PC)); } // opcode fetch (the bus is still read while halting)
+		int replay(uint8_t instr); // same as run(), but with an opcode byte that is already known (for the decoded instruction cache)
+		inline bool halting() const { return _halt; }
+		void get_state(z80_cycle_state_t& state) const;
+		void set_state(const z80_cycle_state_t& state);
 	private:
 		z80_registers_t& _regs; // CPU registers
 		bool _wait = false; // set if there's a WAIT state to be inserted in the next cycle (i.e. long T2)
@@ -49,6 +86,8 @@ namespace llz80emu {
 		z80_read_cycle(z80_pins_t& pins, z80_cycle_type_t cyc_type);
 
 		void reset(uint16_t addr, uint8_t& val_out);
+		void get_state(z80_cycle_state_t& state) const;
+		void set_state(const z80_cycle_state_t& state);
 	protected:
 		bool _wait = false; // set if there's a WAIT state to be inserted in the next cycle (i.e. long T2)
 		uint16_t _addr; // address to read from
@@ -60,6 +99,9 @@ namespace llz80emu {
 		z80_write_cycle(z80_pins_t& pins, z80_cycle_type_t cyc_type);
 
 		void reset(uint16_t addr, uint8_t val);
+		inline uint16_t addr() const { return _addr; } // address being written to
+		void get_state(z80_cycle_state_t& state) const;
+		void set_state(const z80_cycle_state_t& state);
 	protected:
 		bool _wait = false; // set if there's a WAIT state to be inserted in the next cycle (i.e. long T2)
 		uint16_t _addr; // address to read from
@@ -69,25 +111,39 @@ namespace llz80emu {
 	class z80_mem_read_cycle : public z80_read_cycle {
 	public:
 		z80_mem_read_cycle(z80_pins_t& pins);
-		bool clock(bool clk) override;
+		bool clock(bool clk);
+		template<class Bus> inline int run(Bus& bus) { *_val_out = bus.read(_addr); return finish(); }
+	private:
+		int finish(); // set the pins and return the T cycles taken once the value has been read (for run())
 	};
 
 	class z80_mem_write_cycle : public z80_write_cycle {
 	public:
 		z80_mem_write_cycle(z80_pins_t& pins);
-		bool clock(bool clk) override;
+		inline void set_dirty_map(z80_dirty_map* dirty) { _dirty = dirty; } // set the dirty page map to be marked when WR is asserted (nullptr = none)
+		bool clock(bool clk);
+		template<class Bus> inline int run(Bus& bus) { bus.write(_addr, _val); return finish(); }
+	private:
+		z80_dirty_map* _dirty = nullptr;
+		int finish(); // set the pins and return the T cycles taken once the value has been written (for run())
 	};
 
 	class z80_io_read_cycle : public z80_read_cycle {
 	public:
 		z80_io_read_cycle(z80_pins_t& pins);
-		bool clock(bool clk) override;
+		bool clock(bool clk);
+		template<class Bus> inline int run(Bus& bus) { *_val_out = bus.in(_addr); return finish(); }
+	private:
+		int finish(); // set the pins and return the T cycles taken once the value has been read (for run())
 	};
 
 	class z80_io_write_cycle : public z80_write_cycle {
 	public:
 		z80_io_write_cycle(z80_pins_t& pins);
-		bool clock(bool clk) override;
+		bool clock(bool clk);
+		template<class Bus> inline int run(Bus& bus) { bus.out(_addr, _val); return finish(); }
+	private:
+		int finish(); // set the pins and return the T cycles taken once the value has been written (for run())
 	};
 
 	//typedef void (*z80_bogus_cycle_cb_t)(z80_registers_t& regs, z80_pins_t& pins); // callback for bogus cycle - called on the last half of the last cycle (used to implement instructions' quirks)
@@ -96,8 +152,12 @@ namespace llz80emu {
 		z80_bogus_cycle(z80_pins_t& pins, z80_registers_t& regs);
 
 		void reset(int cycles);
-		bool clock(bool clk) override;
+		void get_state(z80_cycle_state_t& state) const;
+		void set_state(const z80_cycle_state_t& state);
+		bool clock(bool clk);
+		template<class Bus> inline int run(Bus&) { return finish(); } // bogus cycles don't touch the bus
 	private:
+		int finish(); // return the T cycles taken (for run())
 		z80_registers_t& _regs; // CPU registers
 		int _cycles = 0; // number of cycles remaining
 		//z80_bogus_cycle_cb_t* _last_half_cb = nullptr; // callback for the last half of the last cycle (null = no callback)
@@ -108,10 +168,97 @@ namespace llz80emu {
 		z80_intack_cycle(z80_pins_t& pins, z80_registers_t& regs);
 
 		void reset(uint8_t& val_out);
-		bool clock(bool clk) override;
+		void get_state(z80_cycle_state_t& state) const;
+		void set_state(const z80_cycle_state_t& state);
+		bool clock(bool clk);
+		template<class Bus> inline int run(Bus& bus) { *_out = bus.intack(); return finish(); }
 	private:
+		int finish(); // set the pins and return the T cycles taken once the value has been read (for run())
 		z80_registers_t& _regs; // CPU registers
 		uint8_t* _out = nullptr; // register to save data bus output
 		bool _wait = false; // set if there's a WAIT state to be inserted in the next cycle (i.e. long TW2)
 	};
-}
\ No newline at end of file
+
+	/* run() completion (inline so that templated instruction-level execution can be instantiated outside the library) */
+
+	inline int z80_fetch_cycle::replay(uint8_t instr) {
+		_regs.instr = (_halt) ? 0x00 : instr; // continue halting (by executing NOPs) if needed
+
+		/* leave the pins as they would be at the end of T4 */
+		_pins = Z80_PINS_NOMINAL;
+		_pins.state =
+			(_pins.state & ~(Z80_RFSH | Z80_A_ALL)) // clear RFSH and address lines
+			| ((z80_pinbits_t)_regs.REG_IR << Z80_PIN_A_BASE); // refresh address (I + R prior to incrementing)
+		if (_halt) _pins.state &= ~Z80_HALT;
+
+		_regs.REG_R = (_regs.REG_R + 1) & 0x7F; // increment refresh address, masking the MSB off
+		if (!_halt) _regs.REG_PC++;
+		_bus_release = false;
+		return 4;
+	}
+
+	inline int z80_mem_read_cycle::finish() {
+		/* leave the pins as they would be at the end of T3 */
+		_pins = Z80_PINS_NOMINAL;
+		_pins.state =
+			(_pins.state & ~Z80_A_ALL)
+			| ((z80_pinbits_t)_addr << Z80_PIN_A_BASE)
+			| ((z80_pinbits_t)*_val_out << Z80_PIN_D_BASE); // data lines as driven by the host
+		_bus_release = false;
+		return 3;
+	}
+
+	inline int z80_mem_write_cycle::finish() {
+		/* leave the pins as they would be at the end of T3 */
+		_pins = Z80_PINS_NOMINAL;
+		_pins.dir |= Z80_D_ALL;
+		_pins.state =
+			(_pins.state & ~Z80_A_ALL)
+			| ((z80_pinbits_t)_addr << Z80_PIN_A_BASE)
+			| ((z80_pinbits_t)_val << Z80_PIN_D_BASE);
+		_bus_release = false;
+		return 3;
+	}
+
+	inline int z80_io_read_cycle::finish() {
+		/* leave the pins as they would be at the end of T3 */
+		_pins = Z80_PINS_NOMINAL;
+		_pins.state =
+			(_pins.state & ~Z80_A_ALL)
+			| ((z80_pinbits_t)_addr << Z80_PIN_A_BASE)
+			| ((z80_pinbits_t)*_val_out << Z80_PIN_D_BASE); // data lines as driven by the host
+		_bus_release = false;
+		return 4; // including the implicit wait state
+	}
+
+	inline int z80_io_write_cycle::finish() {
+		/* leave the pins as they would be at the end of T3 */
+		_pins = Z80_PINS_NOMINAL;
+		_pins.dir |= Z80_D_ALL;
+		_pins.state =
+			(_pins.state & ~Z80_A_ALL)
+			| ((z80_pinbits_t)_addr << Z80_PIN_A_BASE)
+			| ((z80_pinbits_t)_val << Z80_PIN_D_BASE);
+		_bus_release = false;
+		return 4; // including the implicit wait state
+	}
+
+	inline int z80_intack_cycle::finish() {
+		/* leave the pins as they would be at the end of T4 */
+		_pins = Z80_PINS_NOMINAL;
+		_pins.state =
+			(_pins.state & ~(Z80_A_ALL | Z80_M1 | Z80_RFSH))
+			| ((z80_pinbits_t)_regs.REG_IR << Z80_PIN_A_BASE) // refresh address (I + R prior to incrementing)
+			| ((z80_pinbits_t)*_out << Z80_PIN_D_BASE);
+
+		_regs.REG_R = (_regs.REG_R + 1) & 0x7F; // increment refresh address, masking the MSB off
+		_bus_release = false;
+		return 6; // including the two implicit wait states
+	}
+
+	inline int z80_bogus_cycle::finish() {
+		int cycles = _cycles; // bogus cycles don't touch the pins
+		_cycles = 0;
+		return cycles;
+	}
+}
@@ -0,0 +1,39 @@
+#include "dirty.h"
+
+using namespace llz80emu;
+
+z80_dirty_map::z80_dirty_map(int page_bits) : _shift(page_bits) {
+
+}
+
+void z80_dirty_map::mark(uint16_t addr, size_t len) {
+	if (!len) return;
+	if (len > 0x10000) len = 0x10000;
+	size_t first = addr >> _shift, last = (addr + len - 1) >> _shift; // last may go past the final page if the range wraps around
+	for (size_t page = first; page <= last; page++) mark((uint16_t)(page << _shift));
+}
+
+size_t z80_dirty_map::find(size_t page, bool state) const {
+	size_t pages = 0x10000 >> _shift;
+	while (page < pages) {
+		uint64_t word = (state) ? _bits[page >> 6] : ~_bits[page >> 6];
+		word >>= (page & 63);
+		if (!word) { // nothing in the rest of this word
+			page = (page | 63) + 1;
+			continue;
+		}
+		while (!(word & 1)) { word >>= 1; page++; }
+		break;
+	}
+	return (page < pages) ? page : pages;
+}
+
+size_t z80_dirty_map::collect(z80_mem_range_t* ranges, size_t max) {
+	size_t n = 0, pages = 0x10000 >> _shift;
+	for (size_t page = find(0, true); n < max && page < pages; page = find(page, true)) {
+		size_t end = find(page, false);
+		ranges[n].addr = (uint16_t)(page << _shift); ranges[n].len = (end - page) << _shift; n++;
+		for (; page < end; page++) _bits[page >> 6] &= ~((uint64_t)1 << (page & 63));
+	}
+	return n;
+}
\ No newline at end of file
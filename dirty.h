@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace llz80emu {
+	/* memory write tracking (see z80emu::set_dirty_tracking()) */
+	#define Z80_DIRTY_MIN_PAGE_BITS				8 // log2 of the smallest page size (256 bytes)
+	#define Z80_DIRTY_MAX_PAGE_BITS				12 // log2 of the largest page size (4K)
+
+	typedef struct {
+		uint16_t addr; // start address
+		size_t len; // length in bytes (not wrapping around the address space)
+	} z80_mem_range_t;
+
+	class z80_dirty_map {
+	public:
+		z80_dirty_map(int page_bits); // create a map with all pages clean (page_bits must be within Z80_DIRTY_MIN_PAGE_BITS and Z80_DIRTY_MAX_PAGE_BITS)
+
+		inline void mark(uint16_t addr) { // mark the page containing addr as dirty
+			size_t page = addr >> _shift;
+			_bits[page >> 6] |= (uint64_t)1 << (page & 63);
+		}
+		void mark(uint16_t addr, size_t len); // mark the pages overlapping [addr, addr + len) (wrapping around) as dirty
+
+		size_t collect(z80_mem_range_t* ranges, size_t max); // store up to max runs of consecutive dirty pages (in ascending order) and mark them clean, then return the number of runs stored
+		inline size_t page_size() const { return (size_t)1 << _shift; }
+	private:
+		uint64_t _bits[(0x10000 >> Z80_DIRTY_MIN_PAGE_BITS) / 64] = {}; // one bit per page
+		int _shift; // log2 of the page size
+
+		size_t find(size_t page, bool state) const; // return the first page from page onwards whose bit equals state (or the number of pages if there's none)
+	};
+}
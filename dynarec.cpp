@@ -0,0 +1,409 @@
+#include "dynarec.h"
+#include "flags.h"
+#include "opinfo.h"
+
+#include <string.h>
+#include <initializer_list>
+
+#if defined(LLZ80EMU_DYNAREC) && (defined(__x86_64__) || defined(_M_X64))
+#define Z80_DYNAREC_X64 // dynarec is compiled in
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+#endif
+
+using namespace llz80emu;
+
+#if defined(Z80_DYNAREC_X64)
+
+/*
+ * Translated blocks are straight runs of register-only unprefixed instructions (no memory accesses other than opcode and operand
+ * fetches, no I/O and nothing that interacts with interrupts), optionally closed by a JP/JR/DJNZ. Loads, exchanges and 16-bit
+ * increments/decrements are emitted as host instructions operating on z80_registers_t; flag-setting instructions call the helpers
+ * below, which share their flag logic with the instruction decoder. Everything else is left to the decoder.
+ */
+
+#define Z80_DYNAREC_BLOCK_CODE			2048 // upper bound of host code bytes emitted for a block
+
+/* instruction helpers called from translated code (arg = opcode, followed by its operand bytes from bit 8 onwards; pc = address following the instruction) */
+typedef uint32_t (*dr_helper_t)(z80_registers_t* regs, uint32_t arg, uint32_t pc);
+
+static inline uint8_t* dr_reg8(z80_registers_t* regs, uint8_t idx) { // B/C/D/E/H/L/-/A
+	switch (idx) {
+	case 0: return &regs->REG_B;
+	case 1: return &regs->REG_C;
+	case 2: return &regs->REG_D;
+	case 3: return &regs->REG_E;
+	case 4: return &regs->REG_H;
+	case 5: return &regs->REG_L;
+	default: return &regs->REG_A;
+	}
+}
+
+static inline bool dr_cond(const z80_registers_t* regs, uint8_t cc) { // NZ/Z/NC/C/PO/PE/P/M
+	switch (cc) {
+	case 0b000: return !(regs->REG_F & Z80_FLAG_Z);
+	case 0b001: return (regs->REG_F & Z80_FLAG_Z);
+	case 0b010: return !(regs->REG_F & Z80_FLAG_C);
+	case 0b011: return (regs->REG_F & Z80_FLAG_C);
+	case 0b100: return !(regs->REG_F & Z80_FLAG_PV);
+	case 0b101: return (regs->REG_F & Z80_FLAG_PV);
+	case 0b110: return !(regs->REG_F & Z80_FLAG_S);
+	default: return (regs->REG_F & Z80_FLAG_S);
+	}
+}
+
+static uint32_t dr_inc_dec_r8(z80_registers_t* regs, uint32_t arg, uint32_t /*pc*/) { // INC/DEC r8
+	uint8_t* r = dr_reg8(regs, (arg >> 3) & 7);
+	if (arg & 1) {
+		(*r)--;
+		regs->Q = regs->REG_F = (regs->REG_F & Z80_FLAG_C) | z80_flag_tables.dec[*r];
+	}
+	else {
+		(*r)++;
+		regs->Q = regs->REG_F = (regs->REG_F & Z80_FLAG_C) | z80_flag_tables.inc[*r];
+	}
+	return 0;
+}
+
+static uint32_t dr_alu_r8(z80_registers_t* regs, uint32_t arg, uint32_t /*pc*/) { // ALU A,r8
+	regs->REG_Z = *dr_reg8(regs, arg & 7); // the decoder goes through Z as well
+	z80_alu_op(*regs, (arg >> 3) & 7);
+	return 0;
+}
+
+static uint32_t dr_alu_i8(z80_registers_t* regs, uint32_t arg, uint32_t /*pc*/) { // ALU A,n
+	regs->REG_Z = (uint8_t)(arg >> 8);
+	z80_alu_op(*regs, (arg >> 3) & 7);
+	return 0;
+}
+
+static uint32_t dr_acc(z80_registers_t* regs, uint32_t arg, uint32_t /*pc*/) { // RLCA/RRCA/RLA/RRA/DAA/CPL/SCF/CCF
+	z80_acc_op(*regs, (arg >> 3) & 7);
+	return 0;
+}
+
+static uint32_t dr_jp(z80_registers_t* regs, uint32_t arg, uint32_t pc) { // JP nn / JP cc,nn - returns whether the jump was taken
+	regs->Q = 0;
+	regs->REG_WZ = (uint16_t)(arg >> 8);
+	regs->MEMPTR = regs->REG_WZ;
+	bool taken = ((arg & 0xFF) == 0xC3) || dr_cond(regs, (arg >> 3) & 7);
+	regs->REG_PC = (taken) ? regs->REG_WZ : (uint16_t)pc;
+	return taken;
+}
+
+static uint32_t dr_jr(z80_registers_t* regs, uint32_t arg, uint32_t pc) { // JR d / JR cc,d / DJNZ d - returns whether the jump was taken
+	regs->Q = 0;
+	bool taken;
+	switch (arg & 0xFF) {
+	case 0x10: taken = (--regs->REG_B != 0); break; // DJNZ
+	case 0x18: taken = true; break; // JR
+	default: taken = dr_cond(regs, ((arg >> 3) & 7) - 4); break; // JR NZ/Z/NC/C
+	}
+	regs->REG_Z = (uint8_t)(arg >> 8);
+	regs->REG_PC = (uint16_t)pc;
+	if (taken) {
+		regs->REG_W = (regs->REG_Z >> 7) * 0xFF; // sign extend
+		regs->REG_PC += regs->REG_WZ; regs->MEMPTR = regs->REG_PC;
+	}
+	return taken;
+}
+
+/* minimal x86-64 emitter - translated code keeps the z80_registers_t pointer in RBX */
+#if defined(_WIN32)
+#define DR_ARG0							0xD9 // mov rcx, rbx (ModRM)
+#else
+#define DR_ARG0							0xDF // mov rdi, rbx (ModRM)
+#endif
+
+#define DR_OFS(member)					((uint8_t)offsetof(z80_registers_t, member))
+
+static inline void dr_emit(uint8_t*& p, std::initializer_list<uint8_t> bytes) {
+	for (uint8_t b : bytes) *p++ = b;
+}
+
+static inline void dr_emit32(uint8_t*& p, uint32_t x) {
+	memcpy(p, &x, 4); p += 4;
+}
+
+static inline void dr_emit64(uint8_t*& p, uint64_t x) {
+	memcpy(p, &x, 8); p += 8;
+}
+
+static void dr_emit_prologue(uint8_t*& p) {
+	dr_emit(p, { 0x53 }); // push rbx
+#if defined(_WIN32)
+	dr_emit(p, { 0x48, 0x89, 0xCB }); // mov rbx, rcx
+	dr_emit(p, { 0x48, 0x83, 0xEC, 0x20 }); // sub rsp, 32 (shadow space - also realigns the stack)
+#else
+	dr_emit(p, { 0x48, 0x89, 0xFB }); // mov rbx, rdi
+#endif
+}
+
+static void dr_emit_epilogue(uint8_t*& p, bool branch) {
+	if (!branch) dr_emit(p, { 0x31, 0xC0 }); // xor eax, eax (otherwise return the closing branch helper's result)
+#if defined(_WIN32)
+	dr_emit(p, { 0x48, 0x83, 0xC4, 0x20 }); // add rsp, 32
+#endif
+	dr_emit(p, { 0x5B, 0xC3 }); // pop rbx; ret
+}
+
+static void dr_emit_call(uint8_t*& p, dr_helper_t helper, uint32_t arg, uint16_t pc) {
+	dr_emit(p, { 0x48, 0x89, DR_ARG0 }); // regs
+#if defined(_WIN32)
+	dr_emit(p, { 0xBA }); dr_emit32(p, arg); // mov edx, arg
+	dr_emit(p, { 0x41, 0xB8 }); dr_emit32(p, pc); // mov r8d, pc
+#else
+	dr_emit(p, { 0xBE }); dr_emit32(p, arg); // mov esi, arg
+	dr_emit(p, { 0xBA }); dr_emit32(p, pc); // mov edx, pc
+#endif
+	dr_emit(p, { 0x48, 0xB8 }); dr_emit64(p, (uint64_t)(uintptr_t)helper); // mov rax, helper
+	dr_emit(p, { 0xFF, 0xD0 }); // call rax
+}
+
+static void dr_emit_mov8(uint8_t*& p, uint8_t dst, uint8_t src) { // register to register
+	dr_emit(p, { 0x8A, 0x43, src }); // mov al, [rbx+src]
+	dr_emit(p, { 0x88, 0x43, dst }); // mov [rbx+dst], al
+}
+
+static void dr_emit_swap16(uint8_t*& p, uint8_t a, uint8_t b) {
+	dr_emit(p, { 0x66, 0x8B, 0x43, a }); // mov ax, [rbx+a]
+	dr_emit(p, { 0x66, 0x8B, 0x4B, b }); // mov cx, [rbx+b]
+	dr_emit(p, { 0x66, 0x89, 0x4B, a }); // mov [rbx+a], cx
+	dr_emit(p, { 0x66, 0x89, 0x43, b }); // mov [rbx+b], ax
+}
+
+static uint8_t dr_reg8_ofs(uint8_t idx) { // B/C/D/E/H/L/-/A
+	switch (idx) {
+	case 0: return DR_OFS(BC.bytes.hi);
+	case 1: return DR_OFS(BC.bytes.lo);
+	case 2: return DR_OFS(DE.bytes.hi);
+	case 3: return DR_OFS(DE.bytes.lo);
+	case 4: return DR_OFS(HL.bytes.hi);
+	case 5: return DR_OFS(HL.bytes.lo);
+	default: return DR_OFS(AF.bytes.hi);
+	}
+}
+
+static uint8_t dr_reg16_ofs(uint8_t idx) { // BC/DE/HL/SP
+	switch (idx) {
+	case 0: return DR_OFS(BC);
+	case 1: return DR_OFS(DE);
+	case 2: return DR_OFS(HL);
+	default: return DR_OFS(SP);
+	}
+}
+
+static inline z80_pinbits_t dr_read_pins(uint16_t addr, uint8_t val) { // pins following a memory read (see z80_mem_read_cycle::run())
+	return (Z80_PINS_NOMINAL.state & ~Z80_A_ALL) | ((z80_pinbits_t)addr << Z80_PIN_A_BASE) | ((z80_pinbits_t)val << Z80_PIN_D_BASE);
+}
+
+#endif
+
+z80_dynarec::z80_dynarec(z80_registers_t& regs) : _regs(regs) {
+#if defined(Z80_DYNAREC_X64)
+#if defined(_WIN32)
+	_code = (uint8_t*)VirtualAlloc(nullptr, Z80_DYNAREC_CODE_SIZE, MEM_COMMIT | MEM_RESERVE, PAGE_EXECUTE_READWRITE);
+#else
+	void* code = mmap(nullptr, Z80_DYNAREC_CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	_code = (code == MAP_FAILED) ? nullptr : (uint8_t*)code;
+#endif
+#endif
+}
+
+z80_dynarec::~z80_dynarec() {
+#if defined(Z80_DYNAREC_X64)
+	if (!_code) return;
+#if defined(_WIN32)
+	VirtualFree(_code, 0, MEM_RELEASE);
+#else
+	munmap(_code, Z80_DYNAREC_CODE_SIZE);
+#endif
+#endif
+}
+
+bool z80_dynarec::supported() {
+#if defined(Z80_DYNAREC_X64)
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool z80_dynarec::ready() const {
+	return _code != nullptr;
+}
+
+void z80_dynarec::invalidate(uint16_t addr, size_t len) {
+	if (!len) return;
+	if (len > 0x10000) len = 0x10000;
+	size_t first = addr >> Z80_DYNAREC_PAGE_BITS, last = (addr + len - 1) >> Z80_DYNAREC_PAGE_BITS; // last may go past the final page if the range wraps around
+	for (size_t page = first; page <= last; page++) _gen[page & ((0x10000 >> Z80_DYNAREC_PAGE_BITS) - 1)]++;
+}
+
+const z80_dynarec_stats_t& z80_dynarec::stats() const {
+	return _stats;
+}
+
+int z80_dynarec::run(const z80_bus_t& bus, z80_pins_t& pins, uint64_t max_tstates, z80_counters_t* counters) {
+#if defined(Z80_DYNAREC_X64)
+	uint16_t pc = _regs.REG_PC;
+	block_t& block = _blocks[pc & (Z80_DYNAREC_ENTRIES - 1)];
+	if (!block.len || block.pc != pc
+		|| block.gen[0] != _gen[pc >> Z80_DYNAREC_PAGE_BITS]
+		|| block.gen[1] != _gen[(uint16_t)(pc + block.len - 1) >> Z80_DYNAREC_PAGE_BITS])
+		translate(bus, block, pc);
+	if (!block.code || block.tstates_taken > max_tstates) return 0; // don't overshoot - the decoder will take it from here
+
+	uint8_t r = _regs.REG_R;
+	bool taken = block.code(&_regs);
+	int t = (taken) ? block.tstates_taken : block.tstates;
+
+	/* replicate the side effects of the opcode fetches, and leave the pins as they would be following the last machine cycle */
+	if (!block.branch) _regs.REG_PC = block.next_pc;
+	_regs.instr = block.last_instr;
+	pins = Z80_PINS_NOMINAL;
+	if (block.pins_fetch) {
+		uint8_t r_last = (block.instrs > 1) ? ((r + block.instrs - 1) & 0x7F) : r; // refresh address of the last fetch
+		pins.state =
+			(pins.state & ~(Z80_RFSH | Z80_A_ALL))
+			| ((z80_pinbits_t)((_regs.REG_I << 8) | r_last) << Z80_PIN_A_BASE);
+	}
+	else pins.state = block.pins;
+	_regs.REG_R = (r + block.instrs) & 0x7F;
+
+	_stats.blocks_run++;
+	_stats.instrs_run += block.instrs;
+	Z80_COUNT(if (counters) {
+		for (int i = 0; i < Z80_MCYCLE_TYPES; i++) counters->mcycles[i] += block.mcycles[taken][i];
+		counters->instructions += block.instrs; counters->tstates += t;
+	});
+	return t;
+#else
+	return 0;
+#endif
+}
+
+void z80_dynarec::translate(const z80_bus_t& bus, block_t& block, uint16_t pc) {
+#if defined(Z80_DYNAREC_X64)
+	if (_code_used + Z80_DYNAREC_BLOCK_CODE > Z80_DYNAREC_CODE_SIZE) {
+		/* out of space - start over */
+		memset(_blocks, 0, sizeof(_blocks));
+		_code_used = 0;
+		_stats.flushes++;
+	}
+
+	uint8_t* start = _code + _code_used;
+	uint8_t* p = start;
+	dr_emit_prologue(p);
+
+	block = {};
+	block.pc = pc; block.tstates = block.tstates_taken = 0;
+	uint16_t addr = pc;
+	bool q_zero = false; // set if Q is to be cleared before the next helper call or the end of the block
+	while (block.instrs < Z80_DYNAREC_BLOCK_INSTRS && !block.branch) {
+		uint8_t op = bus.mem_read(bus.ctx, addr);
+		uint8_t x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+
+		/* instructions that don't set flags (Q = 0) */
+		int len = 1, t = 4;
+		bool pins_fetch = true;
+		if (op == 0x00) {} // NOP
+		else if (x == 1 && y != 6 && z != 6) dr_emit_mov8(p, dr_reg8_ofs(y), dr_reg8_ofs(z)); // LD r8,r8
+		else if (x == 0 && z == 6 && y != 6) { // LD r8,n
+			uint8_t n = bus.mem_read(bus.ctx, addr + 1);
+			dr_emit(p, { 0xC6, 0x43, dr_reg8_ofs(y), n }); // mov byte [rbx+r], n
+			len = 2; t = 7; pins_fetch = false; block.pins = dr_read_pins(addr + 1, n);
+		}
+		else if (x == 0 && z == 1 && !(y & 1)) { // LD r16,nn
+			uint8_t lo = bus.mem_read(bus.ctx, addr + 1), hi = bus.mem_read(bus.ctx, addr + 2);
+			dr_emit(p, { 0x66, 0xC7, 0x43, dr_reg16_ofs(y >> 1), lo, hi }); // mov word [rbx+rp], nn
+			len = 3; t = 10; pins_fetch = false; block.pins = dr_read_pins(addr + 2, hi);
+		}
+		else if (x == 0 && z == 3) { // INC/DEC r16
+			dr_emit(p, { 0x66, 0xFF, (uint8_t)((y & 1) ? 0x4B : 0x43), dr_reg16_ofs(y >> 1) }); // inc/dec word [rbx+rp]
+			t = 6; // pins are left alone by the bogus cycles
+		}
+		else if (op == 0x08) dr_emit_swap16(p, DR_OFS(AF), DR_OFS(AF_s)); // EX AF,AF'
+		else if (op == 0xEB) dr_emit_swap16(p, DR_OFS(DE), DR_OFS(HL)); // EX DE,HL
+		else if (op == 0xD9) { // EXX
+			dr_emit_swap16(p, DR_OFS(BC), DR_OFS(BC_s));
+			dr_emit_swap16(p, DR_OFS(DE), DR_OFS(DE_s));
+			dr_emit_swap16(p, DR_OFS(HL), DR_OFS(HL_s));
+		}
+		else t = 0; // not one of these
+
+		if (t) q_zero = true;
+		else {
+			/* instructions done by helpers */
+			dr_helper_t helper = nullptr; uint32_t arg = op;
+			int t_taken = 0;
+			t = 4;
+			if (x == 0 && (z == 4 || z == 5) && y != 6) helper = dr_inc_dec_r8; // INC/DEC r8
+			else if (x == 0 && z == 7) helper = dr_acc; // RLCA/RRCA/RLA/RRA/DAA/CPL/SCF/CCF
+			else if (x == 2 && z != 6) helper = dr_alu_r8; // ALU A,r8
+			else if (x == 3 && z == 6) { // ALU A,n
+				uint8_t n = bus.mem_read(bus.ctx, addr + 1);
+				helper = dr_alu_i8; arg |= n << 8;
+				len = 2; t = 7; pins_fetch = false; block.pins = dr_read_pins(addr + 1, n);
+			}
+			else if (op == 0xC3 || (x == 3 && z == 2)) { // JP nn / JP cc,nn
+				uint8_t lo = bus.mem_read(bus.ctx, addr + 1), hi = bus.mem_read(bus.ctx, addr + 2);
+				helper = dr_jp; arg |= (lo << 8) | (hi << 16);
+				len = 3; t = t_taken = 10; pins_fetch = false; block.pins = dr_read_pins(addr + 2, hi);
+				block.branch = true;
+			}
+			else if (op == 0x10 || op == 0x18 || (x == 0 && z == 0 && y >= 4)) { // DJNZ d / JR d / JR cc,d
+				uint8_t d = bus.mem_read(bus.ctx, addr + 1);
+				helper = dr_jr; arg |= d << 8;
+				len = 2; pins_fetch = false; block.pins = dr_read_pins(addr + 1, d);
+				switch (op) {
+				case 0x10: t = 8; t_taken = 13; break;
+				case 0x18: t = t_taken = 12; break;
+				default: t = 7; t_taken = 12; break;
+				}
+				block.branch = true;
+			}
+			else break; // end the block before this instruction
+
+			if (q_zero) {
+				dr_emit(p, { 0xC6, 0x43, DR_OFS(Q), 0x00 }); // mov byte [rbx+Q], 0 (SCF/CCF need the previous instruction's Q)
+				q_zero = false;
+			}
+			dr_emit_call(p, helper, arg, (uint16_t)(addr + len));
+			if (block.branch) block.tstates_taken = block.tstates + t_taken;
+		}
+
+		const z80_opinfo_t& info = z80_opinfo_tables.op[Z80_OPSPACE_MAIN][op];
+		for (int i = 0; i < Z80_MCYCLE_TYPES; i++) {
+			block.mcycles[0][i] += info.counts[0][i];
+			block.mcycles[1][i] += info.counts[block.branch][i]; // only the closing branch can be taken
+		}
+		block.instrs++;
+		block.last_instr = op;
+		block.pins_fetch = pins_fetch;
+		block.tstates += t;
+		addr += len;
+	}
+	if (!block.branch) block.tstates_taken = block.tstates;
+
+	block.len = (uint8_t)((uint16_t)(addr - pc));
+	block.next_pc = addr;
+	block.gen[0] = _gen[pc >> Z80_DYNAREC_PAGE_BITS];
+	if (!block.instrs) {
+		/* nothing to translate - remember that so we don't try again every time */
+		block.len = 1; block.gen[1] = block.gen[0];
+		return;
+	}
+	block.gen[1] = _gen[(uint16_t)(addr - 1) >> Z80_DYNAREC_PAGE_BITS];
+
+	if (q_zero) dr_emit(p, { 0xC6, 0x43, DR_OFS(Q), 0x00 });
+	dr_emit_epilogue(p, block.branch);
+	block.code = reinterpret_cast<block_fn_t>(start);
+	_code_used += p - start;
+	_stats.blocks_translated++;
+#endif
+}
\ No newline at end of file
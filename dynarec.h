@@ -0,0 +1,68 @@
+#pragma once
+
+#include "pins.h"
+#include "registers.h"
+#include "bus.h"
+#include "counters.h"
+
+namespace llz80emu {
+	/* dynamic recompiler for instruction-level execution (see z80emu::set_dynarec()) - only functional on x86-64 hosts when built with LLZ80EMU_DYNAREC */
+	#define Z80_DYNAREC_ENTRIES					4096 // number of block cache entries (direct-mapped by PC - must be a power of 2)
+	#define Z80_DYNAREC_PAGE_BITS				8 // log2 of the page size used for invalidation on memory writes
+	#define Z80_DYNAREC_BLOCK_INSTRS			32 // maximum number of instructions in a block
+	#define Z80_DYNAREC_CODE_SIZE				(1 << 20) // size of the host code buffer (flushed entirely once full)
+
+	typedef struct {
+		uint64_t blocks_translated; // number of blocks translated to host code
+		uint64_t blocks_run; // number of block executions
+		uint64_t instrs_run; // number of instructions executed as part of blocks
+		uint64_t flushes; // number of times the host code buffer was flushed for running out of space
+	} z80_dynarec_stats_t;
+
+	class z80_dynarec {
+	public:
+		z80_dynarec(z80_registers_t& regs);
+		~z80_dynarec();
+
+		static bool supported(); // return whether the dynarec has been compiled in for this host
+		bool ready() const; // return whether the host code buffer has been allocated
+
+		int run(const z80_bus_t& bus, z80_pins_t& pins, uint64_t max_tstates, z80_counters_t* counters = nullptr); // run the block starting at PC (translating it first if needed) if it takes no more than max_tstates T cycles, and return the number of T cycles taken (0 if nothing was run) - counters (if given) are updated with the block's machine cycles
+
+		inline void invalidate(uint16_t addr) { // invalidate blocks overlapping the page containing addr
+			_gen[addr >> Z80_DYNAREC_PAGE_BITS]++;
+		}
+		void invalidate(uint16_t addr, size_t len); // invalidate blocks overlapping the specified memory range
+
+		const z80_dynarec_stats_t& stats() const;
+	private:
+		typedef uint32_t (*block_fn_t)(z80_registers_t* regs); // translated block - returns whether its closing branch was taken
+
+		typedef struct {
+			block_fn_t code; // host code (nullptr if no instruction at pc can be translated)
+			uint16_t pc; // address of the first instruction
+			uint16_t next_pc; // PC following the block (unless it has been set by a closing branch)
+			uint8_t len; // number of bytes covered by the block (0 = empty entry)
+			uint8_t instrs; // number of instructions (i.e. opcode fetches)
+			uint8_t last_instr; // opcode of the last instruction (for the instruction register)
+			bool branch; // set if the block ends with a branch (which sets PC by itself)
+			bool pins_fetch; // set if the last machine cycle is an opcode fetch (whose pins depend on R), otherwise pins contains the pins following the last memory read
+			uint16_t tstates; // number of T cycles taken (branch not taken)
+			uint16_t tstates_taken; // number of T cycles taken (branch taken)
+			uint8_t mcycles[2][Z80_MCYCLE_TYPES]; // number of machine cycles of each type, indexed by whether the branch is taken
+			z80_pinbits_t pins; // pin states following the last machine cycle (see pins_fetch)
+			uint32_t gen[2]; // write generation of the pages holding the first and last bytes at the time of translation
+		} block_t;
+
+		z80_registers_t& _regs; // CPU registers
+
+		block_t _blocks[Z80_DYNAREC_ENTRIES] = {};
+		uint32_t _gen[0x10000 >> Z80_DYNAREC_PAGE_BITS] = {}; // per-page write generation counters
+		z80_dynarec_stats_t _stats = {};
+
+		uint8_t* _code = nullptr; // host code buffer (executable)
+		size_t _code_used = 0; // number of bytes used in the code buffer
+
+		void translate(const z80_bus_t& bus, block_t& block, uint16_t pc); // translate the block starting at pc
+	};
+}
\ No newline at end of file
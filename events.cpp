@@ -0,0 +1,68 @@
+#include "events.h"
+
+#include <algorithm>
+
+using namespace llz80emu;
+
+template<typename T> static bool event_later(const T& a, const T& b) { // heap ordering (earliest on top)
+	return (a.event.time != b.event.time) ? (a.event.time > b.event.time) : (a.order > b.order);
+}
+
+z80_event_queue::z80_event_queue() {
+	for (size_t i = 0; i < Z80_EVENT_QUEUE_SIZE; i++) _cells[i].seq.store(i, std::memory_order_relaxed);
+	_pending.reserve(Z80_EVENT_QUEUE_SIZE);
+}
+
+bool z80_event_queue::post(const z80_event_t& event) {
+	size_t pos = _enqueue_pos.load(std::memory_order_relaxed);
+	cell_t* cell;
+	while (true) {
+		cell = &_cells[pos & (Z80_EVENT_QUEUE_SIZE - 1)];
+		size_t seq = cell->seq.load(std::memory_order_acquire);
+		intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+		if (!diff) {
+			if (_enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break; // claimed the cell
+		}
+		else if (diff < 0) return false; // full - the consumer hasn't freed the cell yet
+		else pos = _enqueue_pos.load(std::memory_order_relaxed); // another producer got there first
+	}
+	cell->event = event;
+	cell->seq.store(pos + 1, std::memory_order_release); // hand over to the consumer
+	_posted.store(true, std::memory_order_release);
+	return true;
+}
+
+bool z80_event_queue::process() {
+	/* take in newly posted events (clearing the flag first, so that anything posted from here on gets picked up next time) */
+	if (_posted.exchange(false, std::memory_order_acquire)) {
+		while (true) {
+			cell_t& cell = _cells[_dequeue_pos & (Z80_EVENT_QUEUE_SIZE - 1)];
+			if (cell.seq.load(std::memory_order_acquire) != _dequeue_pos + 1) break; // empty (or the producer is still writing)
+			_pending.push_back({ cell.event, _order++ });
+			std::push_heap(_pending.begin(), _pending.end(), event_later<pending_t>);
+			cell.seq.store(_dequeue_pos + Z80_EVENT_QUEUE_SIZE, std::memory_order_release); // free the cell for the next lap
+			_dequeue_pos++;
+		}
+	}
+
+	/* apply due events */
+	uint64_t now = _now.load(std::memory_order_relaxed);
+	bool nmi = false;
+	while (!_pending.empty() && _pending.front().event.time <= now) {
+		const z80_event_t& event = _pending.front().event;
+		z80_pinbits_t mask = event.mask & Z80_EVENT_PINS_ALLOWED;
+		switch (event.type) {
+		case Z80_EVENT_NMI: nmi = true; break;
+		case Z80_EVENT_PINS:
+			_ovr_mask |= mask;
+			_ovr_state = (_ovr_state & ~mask) | (event.state & mask);
+			break;
+		case Z80_EVENT_PINS_RELEASE: _ovr_mask &= ~mask; break;
+		default: break;
+		}
+		std::pop_heap(_pending.begin(), _pending.end(), event_later<pending_t>);
+		_pending.pop_back();
+	}
+	_next = (_pending.empty()) ? UINT64_MAX : _pending.front().event.time;
+	return nmi;
+}
\ No newline at end of file
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "pins.h"
+
+#include <atomic>
+#include <vector>
+
+namespace llz80emu {
+	/* timestamped input events posted by other threads (see z80emu::set_event_queue()) */
+	#define Z80_EVENT_QUEUE_SIZE				1024 // number of events that can be in flight between producers and the emulation thread (must be a power of 2)
+	#define Z80_EVENT_PINS_ALLOWED				(Z80_INT | Z80_WAIT | Z80_BUSREQ | Z80_RESET) // input pins that can be overridden
+
+	typedef enum {
+		Z80_EVENT_NMI, // NMI falling edge (same as z80emu::trigger_nmi())
+		Z80_EVENT_PINS, // override the input pins in mask (out of Z80_EVENT_PINS_ALLOWED) with the levels in state
+		Z80_EVENT_PINS_RELEASE // stop overriding the input pins in mask
+	} z80_event_type_t;
+
+	typedef struct {
+		uint64_t time; // half-cycle on which the event takes effect (see z80emu::get_event_time()) - events in the past take effect right away
+		uint8_t type; // z80_event_type_t
+		z80_pinbits_t mask; // pins affected (Z80_EVENT_PINS/Z80_EVENT_PINS_RELEASE)
+		z80_pinbits_t state; // pin levels (Z80_EVENT_PINS - low = asserted)
+	} z80_event_t;
+
+	class z80_event_queue {
+	public:
+		z80_event_queue();
+
+		bool post(const z80_event_t& event); // queue an event (thread-safe and lock-free) - return false if the queue is full
+
+		/* emulation thread only */
+		inline uint64_t now() const { return _now.load(std::memory_order_relaxed); } // number of half-cycles run (readable from any thread)
+		inline bool advance(uint64_t half_cycles) { // count half-cycles run, and return whether process() needs to be called
+			uint64_t now = _now.load(std::memory_order_relaxed) + half_cycles;
+			_now.store(now, std::memory_order_relaxed);
+			return now >= _next || _posted.load(std::memory_order_relaxed);
+		}
+		bool process(); // take in newly posted events and apply those that are due, returning whether an NMI edge has occurred
+		inline z80_pinbits_t apply(z80_pinbits_t state) const { // apply pin overrides to input pin states
+			return (state & ~_ovr_mask) | (_ovr_state & _ovr_mask);
+		}
+		inline z80_pinbits_t override_mask() const { return _ovr_mask; }
+		inline z80_pinbits_t override_state() const { return _ovr_state; }
+		inline uint64_t next() const { return _next; } // time of the earliest pending event (UINT64_MAX if none)
+	private:
+		/* bounded multi-producer/single-consumer ring (each cell's sequence number tells whose turn it is) */
+		typedef struct {
+			std::atomic<size_t> seq;
+			z80_event_t event;
+		} cell_t;
+		cell_t _cells[Z80_EVENT_QUEUE_SIZE];
+		std::atomic<size_t> _enqueue_pos{ 0 }; // producers
+		size_t _dequeue_pos = 0; // consumer
+		std::atomic<bool> _posted{ false }; // set by producers after posting, so that the emulation thread doesn't have to poll the ring
+
+		std::atomic<uint64_t> _now{ 0 }; // current time in half-cycles
+		typedef struct {
+			z80_event_t event;
+			uint64_t order; // order of arrival (so that events with the same time are applied in posting order)
+		} pending_t;
+		std::vector<pending_t> _pending; // events taken from the ring but not due yet (min-heap by time, then order)
+		uint64_t _order = 0; // order to be given to the next event taken from the ring
+		uint64_t _next = UINT64_MAX; // time of the earliest event in _pending
+
+		z80_pinbits_t _ovr_mask = 0; // overridden pins
+		z80_pinbits_t _ovr_state = 0; // levels of the overridden pins
+	};
+}
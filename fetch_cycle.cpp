@@ -1,4 +1,5 @@
 #include "cycle.h"
+#include "counters.h"
 
 #if !defined(NO_EXCEPTIONS)
 #include <stdexcept>
@@ -15,6 +16,18 @@ void z80_fetch_cycle::reset(bool halt) {
 	_halt = halt;
 }
 
+void z80_fetch_cycle::get_state(z80_cycle_state_t& state) const {
+	z80_cycle::get_state(state);
+	state.wait = _wait;
+	state.halt = _halt;
+}
+
+void z80_fetch_cycle::set_state(const z80_cycle_state_t& state) {
+	z80_cycle::set_state(state);
+	_wait = state.wait;
+	_halt = state.halt;
+}
+
 bool z80_fetch_cycle::clock(bool clk) {
 	z80_cycle::clock(clk); // call this first to increment our T cycle
 
@@ -36,7 +49,7 @@ bool z80_fetch_cycle::clock(bool clk) {
 		break; // nothing to do here (WAIT and Dx pin sampling are to be done at the start of T3 high)
 	case 4: // T3 high
 		_wait = !(_pins.state & Z80_WAIT); // sample WAIT pin (true = WAIT state activated)
-		if (_wait) _t--; // stay in T2
+		if (_wait) { _t--; Z80_COUNT((*_wait_states)++); } // stay in T2
 		else {
 			if (!_halt) _regs.instr = (uint8_t)((_pins.state & Z80_D_ALL) >> Z80_PIN_D_BASE); // sample Dx pins and store them in the instruction register (only if we're not halting)
 			else _regs.instr = 0x00; // continue halting (by executing NOPs)
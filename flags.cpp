@@ -0,0 +1,76 @@
+#include "flags.h"
+
+using namespace llz80emu;
+
+static constexpr z80_flag_tables_t make_flag_tables() {
+	z80_flag_tables_t t = {};
+
+	for (int i = 0; i < 256; i++) {
+		uint8_t x = (uint8_t)i;
+
+		uint8_t p = x; // parity calculation (even parity = P/V set)
+		p ^= p >> 4; p ^= p >> 2; p ^= p >> 1;
+
+		t.sz53[i] =
+			(x & (Z80_FLAG_S | Z80_FLAG_F3 | Z80_FLAG_F5)) // copy sign bit and bits 3 and 5
+			| ((!x) << Z80_FLAGBIT_Z);
+		t.sz53p[i] = t.sz53[i] | ((~p & 1) << Z80_FLAGBIT_PV);
+		t.inc[i] =
+			t.sz53[i]
+			| ((!(x & 0x0F)) << Z80_FLAGBIT_H) // if r = xxxx0000 then it was xxxx1111 before the operation, and that there was a carry from bit 3 to 4 when we incremented it
+			| ((x == 0x80) << Z80_FLAGBIT_PV); // 0x7F (127) + 1 = 0x80 (-128) -> overflow
+		t.dec[i] =
+			t.sz53[i]
+			| (((x & 0x0F) == 0x0F) << Z80_FLAGBIT_H) // if r = xxxx1111 then it was xxxx0000 before the operation, and that there was a borrow from bit 4 to 3 when we decremented it
+			| ((x == 0x7F) << Z80_FLAGBIT_PV) // 0x80 (-128) - 1 = 0x7F (127) -> underflow
+			| Z80_FLAG_N; // subtract operation
+	}
+
+	for (int i = 0; i < 8; i++) {
+		int a = i & 1, b = (i >> 1) & 1, r = (i >> 2) & 1; // bits of the operands and the result
+		int c = a ^ b ^ r; // carry/borrow into this bit
+		t.hc_add[i] = ((a + b + c) > 1) << Z80_FLAGBIT_H;
+		t.hc_sub[i] = ((a - b - c) < 0) << Z80_FLAGBIT_H;
+		t.ov_add[i] = (a == b && r != a) << Z80_FLAGBIT_PV; // operands with the same sign, but the result has a different sign
+		t.ov_sub[i] = (a != b && r != a) << Z80_FLAGBIT_PV; // operands with different signs, and the result doesn't have the minuend's sign
+	}
+
+	for (int c = 0; c < 2; c++) {
+		for (int y = 0; y < 8; y++) {
+			for (int i = 0; i < 256; i++) {
+				uint8_t x = (uint8_t)i, r = 0, f = 0;
+				switch (y) {
+				case 0b000: // RLC
+					f = x >> 7; r = (x << 1) | (x >> 7);
+					break;
+				case 0b001: // RRC
+					f = x & 1; r = (x >> 1) | (x << 7);
+					break;
+				case 0b010: // RL
+					f = x >> 7; r = (x << 1) | c;
+					break;
+				case 0b011: // RR
+					f = x & 1; r = (x >> 1) | (c << 7);
+					break;
+				case 0b100: // SLA
+					f = x >> 7; r = x << 1;
+					break;
+				case 0b101: // SRA
+					f = x & 1; r = (x & (1 << 7)) | (x >> 1); // preserve bit 7
+					break;
+				case 0b110: // SLL
+					f = x >> 7; r = (x << 1) | 1;
+					break;
+				case 0b111: // SRL
+					f = x & 1; r = x >> 1;
+					break;
+				}
+				t.shift_rot[c][y][i] = (uint16_t)((r << 8) | (f << Z80_FLAGBIT_C) | t.sz53p[r]);
+			}
+		}
+	}
+
+	return t;
+}
+
+constexpr z80_flag_tables_t llz80emu::z80_flag_tables = make_flag_tables();
\ No newline at end of file
@@ -0,0 +1,141 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "registers.h"
+
+namespace llz80emu {
+	/* precomputed flag lookup tables (generated at compile time by flags.cpp) */
+	typedef struct {
+		uint8_t sz53[256]; // S, Z, F5 and F3 flags of a result byte
+		uint8_t sz53p[256]; // same as above, plus P/V set to the result's parity
+		uint8_t inc[256]; // all flags except C following INC r8, indexed by the result
+		uint8_t dec[256]; // all flags except C following DEC r8, indexed by the result
+
+		/* H and P/V flags for ADD/ADC and SUB/SBC/CP, indexed by z80_flags_idx() (H: lower 3 bits, P/V: upper 3 bits) */
+		uint8_t hc_add[8];
+		uint8_t hc_sub[8];
+		uint8_t ov_add[8];
+		uint8_t ov_sub[8];
+
+		uint16_t shift_rot[2][8][256]; // CB prefix shift/rotate operations (result << 8 | flags), indexed by old carry flag, operation (y) and operand
+	} z80_flag_tables_t;
+
+	extern const z80_flag_tables_t z80_flag_tables;
+
+	/* assemble lookup index for half carry/borrow (bit 3) and overflow (bit 7) from both operands and the result */
+	inline uint8_t z80_flags_idx(uint8_t a, uint8_t b, uint8_t r) {
+		return ((a & 0x88) >> 3) | ((b & 0x88) >> 2) | ((r & 0x88) >> 1);
+	}
+
+	/* run ALU operation op (ADD/ADC/SUB/SBC/AND/XOR/OR/CP) on A and the operand in Z, setting flags (and Q) - shared by the instruction decoder and the dynarec */
+	inline void z80_alu_op(z80_registers_t& regs, uint8_t op) {
+		/* perform ALU op and save to tmp */
+		uint16_t tmp = 0;
+		uint8_t carry = (regs.REG_F >> Z80_FLAGBIT_C) & 1, idx = 0;
+		switch (op) {
+		case 0b000: // ADD
+		case 0b001: // ADC
+			tmp = regs.REG_A + regs.REG_Z + ((op & 1) ? carry : 0);
+			idx = z80_flags_idx(regs.REG_A, regs.REG_Z, (uint8_t)tmp);
+			regs.REG_F =
+				z80_flag_tables.sz53[tmp & 0xFF] // S = MSB of result, Z contains whether the result is zero, and copy bits 3 and 5
+				| z80_flag_tables.ov_add[idx >> 4] // PV contains whether an overflow occurs
+				| ((tmp >> 8) & Z80_FLAG_C) // C contains whether there's a carry (unsigned overflow) - N is reset
+				| z80_flag_tables.hc_add[idx & 7];
+			break;
+		case 0b010: // SUB
+		case 0b011: // SBC
+		case 0b111: // CP
+			tmp = regs.REG_A - regs.REG_Z - ((op == 0b011) ? carry : 0);
+			idx = z80_flags_idx(regs.REG_A, regs.REG_Z, (uint8_t)tmp);
+			regs.REG_F =
+				((op == 0b111)
+					? ((z80_flag_tables.sz53[tmp & 0xFF] & (Z80_FLAG_S | Z80_FLAG_Z)) | (regs.REG_Z & (Z80_FLAG_F3 | Z80_FLAG_F5))) // bits 3 and 5 are copied from the operand for CP
+					: z80_flag_tables.sz53[tmp & 0xFF])
+				| z80_flag_tables.ov_sub[idx >> 4] // PV contains whether an overflow occurs
+				| ((tmp >> 8) & Z80_FLAG_C) // C contains whether there's a borrow (unsigned underflow)
+				| Z80_FLAG_N // set subtract flag
+				| z80_flag_tables.hc_sub[idx & 7];
+			break;
+		case 0b100: // AND
+			tmp = regs.REG_A & regs.REG_Z;
+			regs.REG_F = z80_flag_tables.sz53p[tmp] | Z80_FLAG_H; // set H flag to 1
+			break;
+		case 0b101: // XOR
+			tmp = regs.REG_A ^ regs.REG_Z;
+			regs.REG_F = z80_flag_tables.sz53p[tmp];
+			break;
+		case 0b110: // OR
+			tmp = regs.REG_A | regs.REG_Z;
+			regs.REG_F = z80_flag_tables.sz53p[tmp];
+			break;
+		}
+		if (op != 0b111) regs.REG_A = tmp & 0xFF; // CP discards the result
+		regs.Q = regs.REG_F;
+	}
+
+	/* run accumulator/flag operation y (RLCA/RRCA/RLA/RRA/DAA/CPL/SCF/CCF - opcodes 00yyy111), setting flags (and Q) - shared by the instruction decoder and the dynarec */
+	inline void z80_acc_op(z80_registers_t& regs, uint8_t y) {
+		switch (y) {
+		case 0b100: // DAA
+			/* adapted from https://ehaskins.com/2018-01-30%20Z80%20DAA/ */
+			regs.Q = regs.REG_F & Z80_FLAG_N;
+			regs.REG_W = 0; // use W for correction value
+			if ((regs.REG_F & Z80_FLAG_H) || (regs.REG_A & 0xF) > 9)
+				regs.REG_W |= 0x6;
+			if ((regs.REG_F & Z80_FLAG_C) || (regs.REG_A > 0x99)) {
+				regs.REG_W |= 0x60;
+				regs.Q |= Z80_FLAG_C;
+			}
+			if (regs.REG_F & Z80_FLAG_N) {
+				regs.Q |= ((regs.REG_A & 0x0F) < (regs.REG_W & 0x0F)) << Z80_FLAGBIT_H;
+				regs.REG_A -= regs.REG_W;
+			}
+			else {
+				regs.Q |= (bool)(((regs.REG_A & 0x0F) + (regs.REG_W & 0x0F)) & 0xF0) << Z80_FLAGBIT_H;
+				regs.REG_A += regs.REG_W;
+			}
+			regs.Q |= z80_flag_tables.sz53p[regs.REG_A];
+			regs.REG_F = regs.Q;
+			break;
+		case 0b101: // CPL
+			regs.REG_A ^= 0xFF;
+			regs.Q = regs.REG_F =
+				(regs.REG_F & ~(Z80_FLAG_F3 | Z80_FLAG_F5)) // erase F3 and F5 flags so we can copy them from A
+				| (regs.REG_A & (Z80_FLAG_F3 | Z80_FLAG_F5)) // copy bits 3 and 5 from A
+				| Z80_FLAG_H | Z80_FLAG_N; // set H and N flags
+			break;
+		case 0b110: // SCF
+			regs.Q = regs.REG_F =
+				(regs.REG_F & ~(Z80_FLAG_H | Z80_FLAG_N | Z80_FLAG_F3 | Z80_FLAG_F5))
+				| (((regs.Q ^ regs.REG_F) | regs.REG_A) & (Z80_FLAG_F3 | Z80_FLAG_F5))
+				| Z80_FLAG_C;
+			break;
+		case 0b111: // CCF
+			regs.Q = regs.REG_F =
+				(
+					(regs.REG_F & ~(Z80_FLAG_H | Z80_FLAG_N | Z80_FLAG_F3 | Z80_FLAG_F5))
+					| (((regs.REG_F >> Z80_FLAGBIT_C) & 1) << Z80_FLAGBIT_H)
+					| (((regs.Q ^ regs.REG_F) | regs.REG_A) & (Z80_FLAG_F3 | Z80_FLAG_F5))
+				)
+				^ Z80_FLAG_C;
+			break;
+		default: { // RLCA/RRCA/RLA/RRA
+			bool dir = (y & 0b001), c = !(y & 0b010); // dir = true for RRCA/RRA (right shift), and c = true if the instruction is RLCA/RRCA
+			bool shift_bit = regs.REG_F & Z80_FLAG_C; // bit to use for bit 7 (RRA/RRCA) or bit 0 (RLA/RLCA), set to old carry bit (for RLA/RRA)
+			regs.Q =
+				(regs.REG_F & ~(Z80_FLAG_C | Z80_FLAG_N | Z80_FLAG_H | Z80_FLAG_F3 | Z80_FLAG_F5)) // reset C, as well as N and H (as described) and F3 and F5 (for copying bits from A)
+				| ((dir) ? (regs.REG_A & 1) : (regs.REG_A >> 7)) << Z80_FLAGBIT_C; // set carry flag to LSB (RRCA/RRA) or MSB (RLCA/RLA)
+			if (c) shift_bit = regs.Q & Z80_FLAG_C; // RLCA/RRCA uses new carry flag bit instead
+
+			if (dir) regs.REG_A = (regs.REG_A >> 1) | (shift_bit << 7); // right shift
+			else regs.REG_A = (regs.REG_A << 1) | ((uint8_t)shift_bit); // left shift
+			regs.Q |= regs.REG_A & (Z80_FLAG_F3 | Z80_FLAG_F5); // copy bits to flag reg
+			regs.REG_F = regs.Q;
+			break;
+		}
+		}
+	}
+}
\ No newline at end of file
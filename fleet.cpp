@@ -0,0 +1,214 @@
+#include "fleet.h"
+
+#include <string.h>
+#include <chrono>
+
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace llz80emu;
+
+static int64_t fleet_now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* job bus callbacks - ctx is the job's 64K memory */
+static uint8_t fleet_mem_read(void* ctx, uint16_t addr) {
+	return ((uint8_t*)ctx)[addr];
+}
+
+static void fleet_mem_write(void* ctx, uint16_t addr, uint8_t val) {
+	((uint8_t*)ctx)[addr] = val;
+}
+
+static uint8_t fleet_io_read(void* ctx, uint16_t addr) {
+	(void)ctx; (void)addr;
+	return 0xFF; // nothing on the I/O bus
+}
+
+static void fleet_io_write(void* ctx, uint16_t addr, uint8_t val) {
+	(void)ctx; (void)addr; (void)val;
+}
+
+z80_fleet::z80_fleet(size_t threads, bool pin) : _pin(pin) {
+	_results_tail = new result_node_t();
+	_results_tail->next.store(nullptr, std::memory_order_relaxed);
+	_results_head.store(_results_tail, std::memory_order_relaxed);
+
+	if (!threads) threads = std::thread::hardware_concurrency();
+	if (!threads) threads = 1; // hardware_concurrency() may not know
+	for (size_t i = 0; i < threads; i++) _workers.emplace_back(new worker_t());
+	for (size_t i = 0; i < threads; i++) _workers[i]->thread = std::thread(&z80_fleet::worker, this, i); // only once all queues exist, since workers steal from each other
+}
+
+z80_fleet::~z80_fleet() {
+	wait();
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_stop = true;
+	}
+	_work_cv.notify_all();
+	for (auto& w : _workers) w->thread.join();
+
+	/* free unclaimed results */
+	z80_fleet_result_t result;
+	while (poll(result));
+	delete _results_tail;
+}
+
+void z80_fleet::submit(const z80_fleet_job_t& job) {
+	queued_job_t q;
+	q.job = job;
+	if (job.image && job.image_len) {
+		size_t len = (job.image_len > 0x10000 - (size_t)job.image_addr) ? (0x10000 - job.image_addr) : job.image_len; // don't wrap around
+		q.image.assign(job.image, job.image + len);
+	}
+	q.job.image_len = q.image.size();
+	if (job.regs) q.regs = *job.regs;
+
+	int64_t expected = -1;
+	_start_ns.compare_exchange_strong(expected, fleet_now_ns()); // first submission starts the clock
+	_pending++;
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex); // so that a worker about to sleep doesn't miss the wakeup
+		_queued++; // before the job can be taken, so that this never goes below zero
+	}
+	worker_t& w = *_workers[_next++ % _workers.size()];
+	{
+		std::lock_guard<std::mutex> lock(w.lock);
+		w.jobs.push_back(std::move(q)); // pointers into q are fixed up by the worker (the deque may move its elements)
+	}
+	_work_cv.notify_one();
+}
+
+bool z80_fleet::take(size_t idx, queued_job_t& job) {
+	size_t n = _workers.size();
+	for (size_t i = 0; i < n; i++) {
+		worker_t& w = *_workers[(idx + i) % n];
+		std::lock_guard<std::mutex> lock(w.lock);
+		if (w.jobs.empty()) continue;
+		if (!i) { // our own queue - most recently submitted first
+			job = std::move(w.jobs.back());
+			w.jobs.pop_back();
+		}
+		else { // steal the oldest job
+			job = std::move(w.jobs.front());
+			w.jobs.pop_front();
+			_steals++;
+		}
+		_queued--;
+		return true;
+	}
+	return false;
+}
+
+void z80_fleet::worker(size_t idx) {
+	if (_pin) {
+		unsigned cores = std::thread::hardware_concurrency();
+		if (!cores) cores = 1;
+#if defined(_WIN32)
+		SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << (idx % cores % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(idx % cores, &set);
+		pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+	}
+
+	z80emu cpu(false);
+	std::unique_ptr<uint8_t[]> mem(new uint8_t[0x10000]);
+	z80_bus_t bus = { mem.get(), fleet_mem_read, fleet_mem_write, fleet_io_read, fleet_io_write, nullptr }; // no interrupting peripherals
+	cpu.set_bus(bus);
+	cpu.set_direct_ram(mem.get());
+	cpu.set_dcache(true);
+
+	queued_job_t q;
+	while (true) {
+		if (!take(idx, q)) {
+			std::unique_lock<std::mutex> lock(_mutex);
+			_work_cv.wait(lock, [this] { return _stop || _queued > 0; });
+			if (_stop && !_queued) return;
+			continue;
+		}
+
+		q.job.image = (q.image.empty()) ? nullptr : q.image.data();
+		q.job.regs = (q.job.regs) ? &q.regs : nullptr;
+		run_job(cpu, mem.get(), q.job);
+
+		if (!--_pending) {
+			_end_ns.store(fleet_now_ns());
+			std::lock_guard<std::mutex> lock(_mutex);
+			_done_cv.notify_all();
+		}
+	}
+}
+
+void z80_fleet::run_job(z80emu& cpu, uint8_t* mem, const z80_fleet_job_t& job) {
+	/* set up */
+	memset(mem, 0, 0x10000);
+	if (job.image) memcpy(&mem[job.image_addr], job.image, job.image_len);
+	cpu.invalidate_dcache();
+	cpu.reset();
+	if (job.regs) cpu.set_regs(*job.regs);
+	cpu.reset_counters();
+
+	/* run */
+	uint64_t t = cpu.run(job.max_tstates, job.until_halt);
+
+	/* publish result */
+	result_node_t* node = new result_node_t();
+	node->next.store(nullptr, std::memory_order_relaxed);
+	z80_fleet_result_t& result = node->result;
+	result.id = job.id;
+	result.regs = cpu.get_regs();
+	result.mem_hash = 0xCBF29CE484222325ULL; // FNV-1a
+	for (size_t i = 0; i < 0x10000; i++) {
+		result.mem_hash ^= mem[i];
+		result.mem_hash *= 0x100000001B3ULL;
+	}
+	result.tstates = t;
+	result.instructions = cpu.get_counters().instructions;
+	result.halted = job.until_halt && cpu.is_idle(); // nothing can bring the CPU out of HALT (there are no interrupt sources)
+
+	result_node_t* prev = _results_head.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release); // the consumer won't see past prev until this is done
+
+	_jobs++;
+	_tstates += t;
+	_instructions += result.instructions;
+}
+
+bool z80_fleet::poll(z80_fleet_result_t& result) {
+	result_node_t* next = _results_tail->next.load(std::memory_order_acquire);
+	if (!next) return false;
+	result = next->result;
+	delete _results_tail;
+	_results_tail = next; // next becomes the new stub
+	return true;
+}
+
+void z80_fleet::wait() {
+	std::unique_lock<std::mutex> lock(_mutex);
+	_done_cv.wait(lock, [this] { return _pending == 0; });
+}
+
+size_t z80_fleet::threads() const {
+	return _workers.size();
+}
+
+z80_fleet_stats_t z80_fleet::get_stats() const {
+	z80_fleet_stats_t stats;
+	stats.jobs = _jobs.load();
+	stats.tstates = _tstates.load();
+	stats.instructions = _instructions.load();
+	stats.steals = _steals.load();
+	int64_t start = _start_ns.load(), end = (_pending) ? fleet_now_ns() : _end_ns.load();
+	stats.seconds = (start < 0 || end < start) ? 0 : (end - start) / 1e9;
+	return stats;
+}
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "z80emu.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace llz80emu {
+	typedef struct {
+		uint64_t id; // caller-assigned job identifier (reported back in the result)
+		const uint8_t* image; // memory image to be loaded (copied on submission - may be nullptr for an all-zero address space)
+		size_t image_len; // length of the above (clipped to the end of the address space)
+		uint16_t image_addr; // address to load the image at
+		const z80_registers_t* regs; // initial registers (nullptr = state following a normal reset)
+		uint64_t max_tstates; // number of T cycles to run for (at least - see z80emu::run())
+		bool until_halt; // stop early once the CPU halts with no interrupt to service (run-to-completion jobs)
+	} z80_fleet_job_t;
+
+	typedef struct {
+		uint64_t id; // job identifier
+		z80_registers_t regs; // final registers
+		uint64_t mem_hash; // 64-bit FNV-1a hash of the final 64K memory contents
+		uint64_t tstates; // number of T cycles run
+		uint64_t instructions; // number of instructions retired (see z80_counters_t)
+		bool halted; // set if the CPU ended up halted (only for until_halt jobs)
+	} z80_fleet_result_t;
+
+	typedef struct {
+		uint64_t jobs; // number of jobs finished
+		uint64_t tstates; // T cycles run over all jobs
+		uint64_t instructions; // instructions retired over all jobs
+		uint64_t steals; // number of jobs taken from another worker's queue
+		double seconds; // wall-clock time between the first submission and the last job finishing (or now, if jobs are still pending)
+	} z80_fleet_stats_t;
+
+	/*
+	 * Pool of worker threads, each owning a z80emu instance and a 64K memory image, running jobs through instruction-level execution.
+	 * Jobs are distributed round-robin over per-worker queues; idle workers steal from the others. The CPU sees plain RAM (which is also
+	 * registered for direct access and served through the decoded instruction cache), I/O reads return 0xFF, I/O writes are ignored and
+	 * there are no interrupt sources.
+	 */
+	class z80_fleet {
+	public:
+		LLZ80EMU_API z80_fleet(size_t threads = 0, bool pin = false); // start the specified number of workers (0 = one per hardware thread), optionally pinning each to its own core
+		LLZ80EMU_API ~z80_fleet(); // finish pending jobs, then stop the workers
+
+		LLZ80EMU_API void submit(const z80_fleet_job_t& job); // queue a job
+		LLZ80EMU_API bool poll(z80_fleet_result_t& result); // take a finished job's result off the results queue, or return false if there is none (to be called from one thread at a time)
+		LLZ80EMU_API void wait(); // block until every submitted job has finished
+
+		LLZ80EMU_API size_t threads() const; // number of workers
+		LLZ80EMU_API z80_fleet_stats_t get_stats() const; // get aggregate throughput counters
+	private:
+		typedef struct {
+			z80_fleet_job_t job; // job (image and regs pointing into the fields below)
+			std::vector<uint8_t> image; // copy of the memory image
+			z80_registers_t regs; // copy of the initial registers
+		} queued_job_t;
+
+		typedef struct {
+			std::mutex lock; // protects jobs
+			std::deque<queued_job_t> jobs; // the owner takes jobs from the back, thieves from the front
+			std::thread thread;
+		} worker_t;
+		std::vector<std::unique_ptr<worker_t>> _workers;
+		std::atomic<size_t> _next{ 0 }; // worker to submit the next job to
+		bool _pin;
+
+		/* sleeping/waking */
+		std::mutex _mutex; // protects _stop and the condition variables' waits
+		std::condition_variable _work_cv; // signalled on submission and on stopping
+		std::condition_variable _done_cv; // signalled when _pending reaches 0
+		std::atomic<size_t> _queued{ 0 }; // number of jobs waiting in the queues
+		std::atomic<size_t> _pending{ 0 }; // number of jobs submitted but not finished
+		bool _stop = false;
+
+		void worker(size_t idx); // worker thread body
+		bool take(size_t idx, queued_job_t& job); // take a job from our queue, or steal one from another worker's
+		void run_job(z80emu& cpu, uint8_t* mem, const z80_fleet_job_t& job); // run a job and publish its result
+
+		/* lock-free multi-producer/single-consumer results queue (intrusive linked list with a stub node) */
+		typedef struct result_node {
+			z80_fleet_result_t result;
+			std::atomic<struct result_node*> next;
+		} result_node_t;
+		std::atomic<result_node_t*> _results_head; // most recently pushed node (producers)
+		result_node_t* _results_tail; // stub node preceding the oldest result (consumer)
+
+		/* statistics */
+		std::atomic<uint64_t> _jobs{ 0 }, _tstates{ 0 }, _instructions{ 0 }, _steals{ 0 };
+		std::atomic<int64_t> _start_ns{ -1 }, _end_ns{ -1 }; // steady clock timestamps of the first submission and the last job finishing
+	};
+}
@@ -1,15 +1,20 @@
 #include "instr_decoder.h"
 #include "z80emu.h"
+#include "state.h"
+#include <string.h>
 
 using namespace llz80emu;
 
-z80_instr_decoder::z80_instr_decoder(z80emu& ctx, z80_registers_t& regs) : _ctx(ctx), _regs(regs) {
-	//uint8_t* r8[] = { &regs.REG_B, &regs.REG_C, &regs.REG_D, &regs.REG_E, &regs.REG_H, &regs.REG_L, nullptr /* (HL) */, &regs.REG_A };
-	//memcpy(_reg8, r8, sizeof(r8));
-	//uint16_t* r16[] = { &regs.REG_BC, &regs.REG_DE, &regs.REG_HL, &regs.REG_SP };
-	//memcpy(_reg16, r16, sizeof(r16));
-	//r16[3] = &regs.REG_AF; // difference between _reg16 and _reg16_alt
-	//memcpy(_reg16_alt, r16, sizeof(r16));
+z80_instr_decoder::z80_instr_decoder(z80emu& ctx, z80_registers_t& regs) : _ctx(ctx), _regs(regs), _tables(exec_tables()) {
+	uint16_t* hl[3] = { &regs.REG_HL, &regs.REG_IX, &regs.REG_IY }; // HL substitutes for each modifier prefix
+	for (int mod = Z80_MOD_NONE; mod <= Z80_MOD_FD; mod++) {
+		uint8_t* r8[] = { &regs.REG_B, &regs.REG_C, &regs.REG_D, &regs.REG_E, HB_PTR(hl[mod]), LB_PTR(hl[mod]), nullptr /* (HL) */, &regs.REG_A };
+		memcpy(_reg8[mod], r8, sizeof(r8));
+		uint16_t* r16[] = { &regs.REG_BC, &regs.REG_DE, hl[mod], &regs.REG_SP };
+		memcpy(_reg16[mod], r16, sizeof(r16));
+		r16[3] = &regs.REG_AF; // difference between _reg16 and _reg16_alt
+		memcpy(_reg16_alt[mod], r16, sizeof(r16));
+	}
 }
 
 void z80_instr_decoder::start() {
@@ -70,132 +75,266 @@ void z80_instr_decoder::start() {
 		_z = (_regs.instr & 0b00000111);
 	}
 
+	/* resolve executor - this is the only place where we decode the opcode */
+	if (_ctx.is_nmi_pending()) _exec = &z80_instr_decoder::exec_nmi;
+	else if (_ctx.is_int_pending()) _exec = &z80_instr_decoder::exec_int;
+	else {
+		const exec_entry_t* entry = &lookup(_subset, _mod, _regs.instr);
+		_exec = entry->exec;
+		_uop = entry->uop; _uop_pc = 0;
+		_decoded = { _exec, _uop, (uint8_t)_subset, (uint8_t)_mod, _regs.instr };
+	}
+
 	_step = 0; // reset step counter
 	_started = true;
 	next_step(); // start execution
 }
 
+void z80_instr_decoder::start(const decoded_t& instr) {
+	_subset = (decltype(_subset))instr.subset; _mod = (decltype(_mod))instr.mod;
+	_x = (instr.instr & 0b11000000) >> 6;
+	_y = (instr.instr & 0b00111000) >> 3;
+	_z = (instr.instr & 0b00000111);
+	_exec = instr.exec;
+	_uop = instr.uop; _uop_pc = 0;
+	_decoded = instr;
+
+	_step = 0;
+	_started = true;
+	next_step();
+}
+
+void z80_instr_decoder::retire(uint8_t instr) {
+	const exec_entry_t& entry = lookup(Z80_SUBSET_NONE, Z80_MOD_NONE, instr);
+	_x = (instr & 0b11000000) >> 6;
+	_y = (instr & 0b00111000) >> 3;
+	_z = (instr & 0b00000111);
+	_exec = entry.exec;
+	_uop = entry.uop; _uop_pc = 0;
+	_decoded = { _exec, _uop, Z80_SUBSET_NONE, Z80_MOD_NONE, instr };
+	_step = 1; // the executor's only step has been run, and it has gone back to fetching
+}
+
 void z80_instr_decoder::next_step() {
-	if (_ctx.is_nmi_pending()) {
-		/* NMI handling - after opcode fetch */
-		switch (_step) {
-		case 0:
-			_regs.REG_PC--; // decrement PC again to position ourselves at the instruction we just ignored
-			_ctx.start_bogus_cycle(1);
-			break;
-		case 1: // push current PC into stack
-			_ctx.start_mem_write_cycle(--_regs.REG_SP, _regs.REG_PCH);
-			break;
-		case 2:
-			_ctx.start_mem_write_cycle(--_regs.REG_SP, _regs.REG_PCL);
-			break;
-		default: // restart at 0x66
-			_regs.MEMPTR = _regs.REG_PC = 0x0066;
-			reset();
-			break;
-		}
+	(this->*_exec)();
+	_step++;
+}
 
-		goto end;
+void z80_instr_decoder::reset(bool halt) {
+	_subset = Z80_SUBSET_NONE; _mod = Z80_MOD_NONE;
+	_mod_d_ready = _hlptr_ready = _mod_cb_fetched = false;
+	_started = false;
+	_ctx.start_fetch_cycle(halt);
+}
+
+const z80_instr_decoder::exec_entry_t& z80_instr_decoder::lookup(uint8_t subset, uint8_t mod, uint8_t instr) const {
+	switch (subset) {
+	case Z80_SUBSET_CB: return _tables.cb[mod][instr];
+	case Z80_SUBSET_ED: return _tables.ed[instr];
+	default: return _tables.main[mod][instr];
 	}
+}
 
-	else if (_ctx.is_int_pending()) {
-		/* INT handling - after acknowledgment */
-		switch (_step) {
-		case 0:
-			_ctx.start_bogus_cycle(1); // one extra cycle
-			break;
-		case 1: // push current PC into stack
-			_ctx.start_mem_write_cycle(--_regs.REG_SP, _regs.REG_PCH);
-			break;
-		case 2:
-			_ctx.start_mem_write_cycle(--_regs.REG_SP, _regs.REG_PCL);
-			break;
-		case 3:
-			if (_regs.int_mode == 1) {
-				/* mode 1 - jump to 0x0038 */
-				_regs.MEMPTR = _regs.REG_PC = 0x0038;
-				reset();
-			} else {
-				/* mode 2 - calculate new vector and read PC from there */
-				_regs.REG_W = _regs.REG_I; // Z contains the vector's low byte, so now WZ stores the address to read PC from
-				_ctx.start_mem_read_cycle(_regs.REG_WZ + 0, _regs.REG_PCL);
-			}
-			break;
-		case 4: // mode 2 only - read high byte of PC
-			_ctx.start_mem_read_cycle(_regs.REG_WZ + 1, _regs.REG_PCH);
-			break;
-		default:
-			_regs.MEMPTR = _regs.REG_PC;
-			reset();
-			break;
+void z80_instr_decoder::get_state(state_t& state) const {
+	state.started = _started;
+	state.step = _step;
+	state.subset = (uint8_t)_subset; state.mod = (uint8_t)_mod;
+	state.mod_d = _mod_d; state.hl_ptr = _hl_ptr; state.mod_d_ready = _mod_d_ready; state.hlptr_ready = _hlptr_ready;
+	state.mod_cb_instr = _mod_cb_instr; state.mod_cb_fetched = _mod_cb_fetched;
+	state.x = _x; state.y = _y; state.z = _z;
+	state.decoded = (_decoded.exec != nullptr); state.dec_subset = _decoded.subset; state.dec_mod = _decoded.mod; state.dec_instr = _decoded.instr;
+	state.uop_pc = _uop_pc;
+}
+
+bool z80_instr_decoder::set_state(const state_t& state, bool nmi_pending, bool int_pending) {
+	if (state.subset > Z80_SUBSET_ED || state.mod > Z80_MOD_FD || state.dec_subset > Z80_SUBSET_ED || state.dec_mod > Z80_MOD_FD) return false;
+
+	decoded_t decoded = {};
+	if (state.decoded) {
+		const exec_entry_t& entry = lookup(state.dec_subset, state.dec_mod, state.dec_instr);
+		decoded = { entry.exec, entry.uop, state.dec_subset, state.dec_mod, state.dec_instr };
+	}
+
+	/* resolve the executor the same way start() did */
+	exec_t exec = nullptr;
+	if (state.started) {
+		if (nmi_pending) exec = &z80_instr_decoder::exec_nmi;
+		else if (int_pending) exec = &z80_instr_decoder::exec_int;
+		else if (decoded.exec) exec = decoded.exec;
+		else return false; // nothing to execute
+		if (exec == &z80_instr_decoder::exec_uop) { // don't run past the end of the program
+			uint8_t len = 0;
+			while (decoded.uop[len].op != Z80_UOP_END) len++;
+			if (state.uop_pc > len) return false;
 		}
+	}
 
-		goto end;
+	_started = state.started;
+	_step = state.step;
+	_subset = (decltype(_subset))state.subset; _mod = (decltype(_mod))state.mod;
+	_mod_d = state.mod_d; _hl_ptr = state.hl_ptr; _mod_d_ready = state.mod_d_ready; _hlptr_ready = state.hlptr_ready;
+	_mod_cb_instr = state.mod_cb_instr; _mod_cb_fetched = state.mod_cb_fetched;
+	_x = state.x; _y = state.y; _z = state.z;
+	_decoded = decoded;
+	_exec = exec;
+	_uop = decoded.uop; _uop_pc = state.uop_pc;
+	return true;
+}
+
+uint8_t z80_instr_decoder::target_id(const uint8_t* ptr) const {
+	for (uint8_t id = 0; id < Z80_STATE_TARGETS; id++) {
+		if (const_cast<z80_instr_decoder*>(this)->target_ptr(id) == ptr) return id;
 	}
+	return Z80_STATE_TARGET_INVALID;
+}
 
-	/* normal execution */
-	switch (_subset) {
-	case Z80_SUBSET_NONE:
-		exec_main();
-		break;
-	case Z80_SUBSET_CB:
-		exec_cb();
-		break;
-	case Z80_SUBSET_ED:
-		exec_ed();
-		break;
-	default:
-		reset();
-		break;
+uint8_t* z80_instr_decoder::target_ptr(uint8_t id) {
+	switch (id) {
+	case Z80_STATE_TARGET_A: return &_regs.REG_A;
+	case Z80_STATE_TARGET_F: return &_regs.REG_F;
+	case Z80_STATE_TARGET_B: return &_regs.REG_B;
+	case Z80_STATE_TARGET_C: return &_regs.REG_C;
+	case Z80_STATE_TARGET_D: return &_regs.REG_D;
+	case Z80_STATE_TARGET_E: return &_regs.REG_E;
+	case Z80_STATE_TARGET_H: return &_regs.REG_H;
+	case Z80_STATE_TARGET_L: return &_regs.REG_L;
+	case Z80_STATE_TARGET_IXH: return &_regs.REG_IXH;
+	case Z80_STATE_TARGET_IXL: return &_regs.REG_IXL;
+	case Z80_STATE_TARGET_IYH: return &_regs.REG_IYH;
+	case Z80_STATE_TARGET_IYL: return &_regs.REG_IYL;
+	case Z80_STATE_TARGET_SPH: return &_regs.REG_SPH;
+	case Z80_STATE_TARGET_SPL: return &_regs.REG_SPL;
+	case Z80_STATE_TARGET_PCH: return &_regs.REG_PCH;
+	case Z80_STATE_TARGET_PCL: return &_regs.REG_PCL;
+	case Z80_STATE_TARGET_W: return &_regs.REG_W;
+	case Z80_STATE_TARGET_Z: return &_regs.REG_Z;
+	case Z80_STATE_TARGET_INSTR: return &_regs.instr;
+	case Z80_STATE_TARGET_MOD_D: return (uint8_t*)&_mod_d;
+	case Z80_STATE_TARGET_MOD_CB_INSTR: return &_mod_cb_instr;
+	default: return nullptr;
 	}
+}
 
-end:
-	_step++;
+const z80_instr_decoder::exec_tables_t& z80_instr_decoder::exec_tables() {
+	static const exec_tables_t tables = []() {
+		exec_tables_t t = {};
+		/* executors specialised on modifier prefix (indexed by Z80_MOD_*) */
+		typedef struct {
+			exec_t (*main_q0)(uint8_t y, uint8_t z); // main quadrant 0 decoder
+			exec_t (*main_q3)(uint8_t y, uint8_t z); // main quadrant 3 decoder
+			exec_t main_q1; // LD r8,r8
+			exec_t main_q2; // ALU r8
+			exec_t cb[4]; // CB prefix subset (by quadrant)
+		} mod_execs_t;
+#define Z80_MOD_EXECS(M)		{ &decode_main_q0<M>, &decode_main_q3<M>, &z80_instr_decoder::exec_ld_r8<M>, &z80_instr_decoder::exec_alu_r8<M>, { &z80_instr_decoder::exec_shift_rot<M>, &z80_instr_decoder::exec_bit<M>, &z80_instr_decoder::exec_res<M>, &z80_instr_decoder::exec_set<M> } }
+		static const mod_execs_t mods[3] = { Z80_MOD_EXECS(Z80_MOD_NONE), Z80_MOD_EXECS(Z80_MOD_DD), Z80_MOD_EXECS(Z80_MOD_FD) };
+#undef Z80_MOD_EXECS
+
+		for (int i = 0; i < 256; i++) {
+			uint8_t x = (i & 0b11000000) >> 6, y = (i & 0b00111000) >> 3, z = (i & 0b00000111);
+			exec_t e = &z80_instr_decoder::exec_invalid;
+			const z80_uop_t* m_uop = z80_uop_lookup(false, (uint8_t)i);
+			const z80_uop_t* e_uop = z80_uop_lookup(true, (uint8_t)i);
+			switch (x) {
+			case 0b01:
+				e = decode_ed_q1(y, z);
+				break;
+			case 0b10:
+				e = decode_ed_q2(y, z);
+				break;
+			}
+			if (e_uop) e = &z80_instr_decoder::exec_uop; // micro-op programs take precedence
+			t.ed[i] = { e, e_uop };
+
+			for (int mod = Z80_MOD_NONE; mod <= Z80_MOD_FD; mod++) {
+				exec_t m = nullptr;
+				switch (x) {
+				case 0b00: m = mods[mod].main_q0(y, z); break;
+				case 0b01: m = mods[mod].main_q1; break;
+				case 0b10: m = mods[mod].main_q2; break;
+				case 0b11: m = mods[mod].main_q3(y, z); break;
+				}
+				if (m_uop) m = &z80_instr_decoder::exec_uop;
+
+				t.main[mod][i] = { m, m_uop };
+				t.cb[mod][i] = { mods[mod].cb[x], nullptr };
+			}
+		}
+
+		/* HALT (LD (HL),(HL)) */
+		t.main[Z80_MOD_NONE][0x76].exec = &z80_instr_decoder::exec_halt;
+		t.main[Z80_MOD_DD][0x76].exec = t.main[Z80_MOD_FD][0x76].exec = &z80_instr_decoder::exec_nop; // undefined opcode
+
+		return t;
+	}();
+
+	return tables;
 }
 
-void z80_instr_decoder::reset(bool halt) {
-	_subset = Z80_SUBSET_NONE; _mod = Z80_MOD_NONE;
-	_mod_d_ready = _hlptr_ready = _mod_cb_fetched = false;
-	_started = false;
-	_ctx.start_fetch_cycle(halt);
+void z80_instr_decoder::exec_nop() {
+	_regs.Q = 0; // not setting flags
+	reset(_ctx.is_halting()); // keep halting (until an interrupt brings us out of it)
 }
 
-void z80_instr_decoder::exec_main() {
-	switch (_x) {
-	case 0b00:
-		exec_main_q0();
-		break;
-	case 0b01:
-		exec_main_q1();
+void z80_instr_decoder::exec_invalid() {
+	reset();
+}
+
+void z80_instr_decoder::exec_nmi() {
+	/* NMI handling - after opcode fetch */
+	switch (_step) {
+	case 0:
+		_regs.REG_PC--; // decrement PC again to position ourselves at the instruction we just ignored
+		_ctx.start_bogus_cycle(1);
 		break;
-	case 0b10:
-		exec_main_q2();
+	case 1: // push current PC into stack
+		_ctx.start_mem_write_cycle(--_regs.REG_SP, _regs.REG_PCH);
 		break;
-	case 0b11:
-		exec_main_q3();
+	case 2:
+		_ctx.start_mem_write_cycle(--_regs.REG_SP, _regs.REG_PCL);
 		break;
-	default:
+	default: // restart at 0x66
+		_regs.MEMPTR = _regs.REG_PC = 0x0066;
 		reset();
 		break;
 	}
 }
 
-void z80_instr_decoder::exec_ed() {
-	switch (_x) {
-	case 0b01:
-		exec_ed_q1();
+void z80_instr_decoder::exec_int() {
+	/* INT handling - after acknowledgment */
+	switch (_step) {
+	case 0:
+		_ctx.start_bogus_cycle(1); // one extra cycle
+		break;
+	case 1: // push current PC into stack
+		_ctx.start_mem_write_cycle(--_regs.REG_SP, _regs.REG_PCH);
+		break;
+	case 2:
+		_ctx.start_mem_write_cycle(--_regs.REG_SP, _regs.REG_PCL);
+		break;
+	case 3:
+		if (_regs.int_mode == 1) {
+			/* mode 1 - jump to 0x0038 */
+			_regs.MEMPTR = _regs.REG_PC = 0x0038;
+			reset();
+		} else {
+			/* mode 2 - calculate new vector and read PC from there */
+			_regs.REG_W = _regs.REG_I; // Z contains the vector's low byte, so now WZ stores the address to read PC from
+			_ctx.start_mem_read_cycle(_regs.REG_WZ + 0, _regs.REG_PCL);
+		}
 		break;
-	case 0b10:
-		exec_ed_q2();
+	case 4: // mode 2 only - read high byte of PC
+		_ctx.start_mem_read_cycle(_regs.REG_WZ + 1, _regs.REG_PCH);
 		break;
 	default:
+		_regs.MEMPTR = _regs.REG_PC;
 		reset();
 		break;
 	}
 }
 
-bool z80_instr_decoder::process_hlptr(int extra_cycles, bool set_hlptr_ready) {
-	if (_mod == Z80_MOD_NONE) {
+template<int M> bool z80_instr_decoder::process_hlptr(int extra_cycles, bool set_hlptr_ready) {
+	if (M == Z80_MOD_NONE) {
 		/* no modifiers - HL is HL */
 		_hl_ptr = _regs.REG_HL;
 		return true;
@@ -211,7 +350,7 @@ bool z80_instr_decoder::process_hlptr(int extra_cycles, bool set_hlptr_ready) {
 
 	if (!_hlptr_ready) {
 		/* displacement byte has just been read */
-		_regs.MEMPTR = _hl_ptr = ((_mod == Z80_MOD_DD) ? _regs.REG_IX : _regs.REG_IY) + _mod_d; // calculate IX+d / IY+d
+		_regs.MEMPTR = _hl_ptr = *reg16<M>(2) + _mod_d; // calculate IX+d / IY+d
 		if (set_hlptr_ready) _hlptr_ready = true;
 		if (!extra_cycles) return true; // no extra cycles required
 		_ctx.start_bogus_cycle(extra_cycles); // extra cycles for calculating address
@@ -222,6 +361,24 @@ bool z80_instr_decoder::process_hlptr(int extra_cycles, bool set_hlptr_ready) {
 	return true;
 }
 
-bool z80_instr_decoder::started() const {
-	return _started;
+Z80_INSTANTIATE_MOD(bool, process_hlptr, int, bool);
+
+bool z80_instr_decoder::process_hlptr(int extra_cycles, bool set_hlptr_ready) {
+	switch (_mod) {
+	case Z80_MOD_DD: return process_hlptr<Z80_MOD_DD>(extra_cycles, set_hlptr_ready);
+	case Z80_MOD_FD: return process_hlptr<Z80_MOD_FD>(extra_cycles, set_hlptr_ready);
+	default: return process_hlptr<Z80_MOD_NONE>(extra_cycles, set_hlptr_ready);
+	}
 }
+
+const z80_instr_decoder::decoded_t& z80_instr_decoder::decoded() const {
+	return _decoded;
+}
+
+z80_opspace_t z80_instr_decoder::opspace(const decoded_t& instr) {
+	switch (instr.subset) {
+	case Z80_SUBSET_CB: return (instr.mod == Z80_MOD_NONE) ? Z80_OPSPACE_CB : ((instr.mod == Z80_MOD_DD) ? Z80_OPSPACE_DDCB : Z80_OPSPACE_FDCB);
+	case Z80_SUBSET_ED: return Z80_OPSPACE_ED;
+	default: return (instr.mod == Z80_MOD_NONE) ? Z80_OPSPACE_MAIN : ((instr.mod == Z80_MOD_DD) ? Z80_OPSPACE_DD : Z80_OPSPACE_FD);
+	}
+}
\ No newline at end of file
@@ -2,19 +2,55 @@
 
 //#include "z80emu.h"
 #include "registers.h"
+#include "flags.h"
+#include "uops.h"
+#include "opinfo.h"
 
 namespace llz80emu {
 	class z80emu;
 
 	class z80_instr_decoder {
 	public:
+		typedef void (z80_instr_decoder::*exec_t)(); // instruction executor (called once per execution step)
+
+		/* instruction as resolved by start() after taking in all of its prefixes */
+		typedef struct {
+			exec_t exec; // executor
+			const z80_uop_t* uop; // micro-op program (if exec is exec_uop())
+			uint8_t subset; // instruction subset (Z80_SUBSET_*)
+			uint8_t mod; // modifier prefix (Z80_MOD_*)
+			uint8_t instr; // opcode
+		} decoded_t;
+
 		z80_instr_decoder(z80emu& ctx, z80_registers_t& regs);
 
 		void start(); // start decoding and executing the instruction stored in _regs
 		void reset(bool halt = false); // stop instruction execution and start fetch cycle
 		void next_step(); // transition to next step or end execution and go back to fetching
 
-		bool started() const; // return whether instruction execution has started (as opposed to still awaiting prefix and stuff)
+		inline bool started() const { return _started; } // return whether instruction execution has started (as opposed to still awaiting prefix and stuff)
+		inline bool prefixed() const { return (_subset != Z80_SUBSET_NONE || _mod != Z80_MOD_NONE); } // return whether prefix bytes have been taken in for the instruction being decoded
+
+		const decoded_t& decoded() const; // return the last instruction resolved by start() (excluding interrupt servicing)
+		static z80_opspace_t opspace(const decoded_t& instr); // return the opcode space (for z80_opinfo_tables) of a resolved instruction
+		void start(const decoded_t& instr); // start executing an instruction that was resolved earlier (its opcode bytes, prefixes included, must have just been fetched)
+		void retire(uint8_t instr); // leave the state as start() and the executor would have for a single-step unprefixed instruction that was run elsewhere (see z80emu_batch)
+
+		/* execution state (for z80emu::save_state()/load_state()) */
+		typedef struct {
+			bool started;
+			int step;
+			uint8_t subset, mod; // instruction subset and modifier prefix
+			int8_t mod_d; uint16_t hl_ptr; bool mod_d_ready, hlptr_ready; // DD/FD displacement and (HL) pointer
+			uint8_t mod_cb_instr; bool mod_cb_fetched; // DDCB/FDCB opcode
+			uint8_t x, y, z; // broken down opcode
+			bool decoded; uint8_t dec_subset, dec_mod, dec_instr; // last instruction resolved by start() - its executor and micro-op program are looked up again from these
+			uint8_t uop_pc; // micro-op program position
+		} state_t;
+		void get_state(state_t& state) const;
+		bool set_state(const state_t& state, bool nmi_pending, bool int_pending); // restore the state (with z80emu's interrupt flags deciding the executor for interrupt servicing) - return false, leaving things untouched, if it is invalid
+		uint8_t target_id(const uint8_t* ptr) const; // encode a location that a read cycle may be reading into as a Z80_STATE_TARGET_* ID (Z80_STATE_TARGET_INVALID if it isn't one)
+		uint8_t* target_ptr(uint8_t id); // decode the above (nullptr if the ID is invalid)
 	private:
 		bool _started = false;
 
@@ -40,178 +76,160 @@ namespace llz80emu {
 		bool _hlptr_ready = false; // set when _hl_ptr is ready
 		uint8_t _mod_cb_instr = 0; // instruction byte following DDCB/FDCB+d
 		bool _mod_cb_fetched = false; // set when the pseudo opcode fetch following DDCB/FDCB+d has been staged
-		bool process_hlptr(int extra_cycles = 5, bool set_hlptr_ready = true); // return false if the current exec step is to be stopped immediately after this (i.e. to read displacement byte); otherwise, _hl_ptr will contain the pointer for use in (HL)
+		template<int M> bool process_hlptr(int extra_cycles = 5, bool set_hlptr_ready = true); // return false if the current exec step is to be stopped immediately after this (i.e. to read displacement byte); otherwise, _hl_ptr will contain the pointer for use in (HL) - M is the modifier prefix
+		bool process_hlptr(int extra_cycles = 5, bool set_hlptr_ready = true); // same as above, dispatching on _mod
 
 		uint8_t _x = 0xFF, _y = 0xFF, _z = 0xFF; // broken down parts of the opcode (xx yyy zzz)
 
 		/* instruction executor helpers */
-		//uint8_t* _reg8[8]; // 8-bit registers (used by main quadrant 1 and 2)
-		//uint16_t* _reg16[4]; // 16-bit registers (used by some main quadrant 0 instructions)
-		//uint16_t* _reg16_alt[4]; // 16-bit registers (used by PUSH and POP instructions)
+		/* register pointer tables, indexed by modifier prefix (so that DD/FD substitute IX/IY for HL) and register index - built by the constructor */
+		uint8_t* _reg8[3][8]; // 8-bit registers (used by main quadrant 1 and 2) - index 6 ((HL)) is nullptr
+		uint16_t* _reg16[3][4]; // 16-bit registers (used by some main quadrant 0 instructions)
+		uint16_t* _reg16_alt[3][4]; // 16-bit registers (used by PUSH and POP instructions)
 
 		inline uint8_t* reg8_nomod(uint8_t idx) {
-			switch (idx) {
-			case 0: return &_regs.REG_B;
-			case 1: return &_regs.REG_C;
-			case 2: return &_regs.REG_D;
-			case 3: return &_regs.REG_E;
-			case 4: return &_regs.REG_H;
-			case 5: return &_regs.REG_L;
-			case 7: return &_regs.REG_A;
-			default: return nullptr;
-			}
+			return _reg8[Z80_MOD_NONE][idx];
 		}
 
 		inline uint8_t* reg8(uint8_t idx) {
-			switch (idx) {
-			case 0: return &_regs.REG_B;
-			case 1: return &_regs.REG_C;
-			case 2: return &_regs.REG_D;
-			case 3: return &_regs.REG_E;
-			case 7: return &_regs.REG_A;
-			case 4:
-				switch (_mod) {
-				case Z80_MOD_NONE: return &_regs.REG_H;
-				case Z80_MOD_DD: return &_regs.REG_IXH;
-				case Z80_MOD_FD: return &_regs.REG_IYH;
-				default: return nullptr;
-				}
-				break;
-			case 5:
-				switch (_mod) {
-				case Z80_MOD_NONE: return &_regs.REG_L;
-				case Z80_MOD_DD: return &_regs.REG_IXL;
-				case Z80_MOD_FD: return &_regs.REG_IYL;
-				default: return nullptr;
-				}
-				break;
-			default: return nullptr;
-			}
+			return _reg8[_mod][idx];
 		}
 
 		inline uint16_t* reg16_nomod(uint8_t idx) {
-			switch (idx) {
-			case 0: return &_regs.REG_BC;
-			case 1: return &_regs.REG_DE;
-			case 2: return &_regs.REG_HL;
-			case 3: return &_regs.REG_SP;
-			default: return nullptr;
-			}
+			return _reg16[Z80_MOD_NONE][idx];
 		}
 
 		inline uint16_t* reg16(uint8_t idx) {
-			switch (idx) {
-			case 0: return &_regs.REG_BC;
-			case 1: return &_regs.REG_DE;
-			case 2:
-				switch (_mod) {
-				case Z80_MOD_NONE: return &_regs.REG_HL;
-				case Z80_MOD_DD: return &_regs.REG_IX;
-				case Z80_MOD_FD: return &_regs.REG_IY;
-				default: return nullptr;
-				}
-				break;
-			case 3: return &_regs.REG_SP;
-			default: return nullptr;
-			}
+			return _reg16[_mod][idx];
 		}
 
 		inline uint16_t* reg16_alt_nomod(uint8_t idx) {
-			switch (idx) {
-			case 0: return &_regs.REG_BC;
-			case 1: return &_regs.REG_DE;
-			case 2: return &_regs.REG_HL;
-			case 3: return &_regs.REG_AF;
-			default: return nullptr;
-			}
+			return _reg16_alt[Z80_MOD_NONE][idx];
 		}
 
 		inline uint16_t* reg16_alt(uint8_t idx) {
-			switch (idx) {
-			case 0: return &_regs.REG_BC;
-			case 1: return &_regs.REG_DE;
-			case 2:
-				switch (_mod) {
-				case Z80_MOD_NONE: return &_regs.REG_HL;
-				case Z80_MOD_DD: return &_regs.REG_IX;
-				case Z80_MOD_FD: return &_regs.REG_IY;
-				default: return nullptr;
-				}
-				break;
-			case 3: return &_regs.REG_AF;
-			default: return nullptr;
-			}
+			return _reg16_alt[_mod][idx];
+		}
+
+		/* same as above, but for executors specialised on modifier prefix M */
+		template<int M> inline uint8_t* reg8(uint8_t idx) {
+			return _reg8[M][idx];
+		}
+
+		template<int M> inline uint16_t* reg16(uint8_t idx) {
+			return _reg16[M][idx];
 		}
 
 		inline uint8_t parity(uint8_t x) {
-			x ^= x >> 4; // 4/4
-			x ^= x >> 2; // 2/2
-			x ^= x >> 1; // 1/1
-			return (~x) & 1;
+			return (z80_flag_tables.sz53p[x] >> Z80_FLAGBIT_PV) & 1;
+		}
+
+		inline bool check_cond(uint8_t cc) { // NZ/Z/NC/C/PO/PE/P/M
+			switch (cc) {
+			case 0b000: return !(_regs.REG_F & Z80_FLAG_Z);
+			case 0b001: return (_regs.REG_F & Z80_FLAG_Z);
+			case 0b010: return !(_regs.REG_F & Z80_FLAG_C);
+			case 0b011: return (_regs.REG_F & Z80_FLAG_C);
+			case 0b100: return !(_regs.REG_F & Z80_FLAG_PV);
+			case 0b101: return (_regs.REG_F & Z80_FLAG_PV);
+			case 0b110: return !(_regs.REG_F & Z80_FLAG_S);
+			case 0b111: return (_regs.REG_F & Z80_FLAG_S);
+			default: return false;
+			}
 		}
 
 		inline void swap(uint16_t& a, uint16_t& b) {
 			uint16_t t = a; a = b; b = t;
 		}
 
-		/* instruction executors */
-
-		void exec_main(); // main instruction subset (no prefixes)
+		/* instruction dispatch */
+		typedef struct {
+			exec_t exec; // executor
+			const z80_uop_t* uop; // micro-op program (if exec is exec_uop())
+		} exec_entry_t;
+		typedef struct {
+			exec_entry_t main[3][256]; // main subset (no prefixes), indexed by modifier prefix and opcode
+			exec_entry_t cb[3][256]; // CB prefix subset, indexed by modifier prefix and opcode (the one following DDCB/FDCB+d for DD/FD)
+			exec_entry_t ed[256]; // ED prefix subset (DD/FD prefixes are disregarded)
+		} exec_tables_t;
+		static const exec_tables_t& exec_tables(); // opcode to executor lookup tables (built on first use)
+		const exec_entry_t& lookup(uint8_t subset, uint8_t mod, uint8_t instr) const; // look up the executor for an opcode in the tables
+		const exec_tables_t& _tables; // cached reference to the above (so we don't need to go through the initialisation guard on every instruction)
+		exec_t _exec = nullptr; // executor for the instruction being executed (resolved once by start())
+		decoded_t _decoded = {}; // see decoded()
+
+		/* micro-op program interpreter (instr_uop.cpp) */
+		const z80_uop_t* _uop = nullptr; // program for the instruction being executed
+		uint8_t _uop_pc = 0; // index of the next micro-op to run
+		uint16_t uop_addr(uint8_t sel); // evaluate z80_uop_addr_t
+		uint8_t* uop_data(uint8_t sel); // evaluate z80_uop_data_t
+		bool uop_cond(uint8_t sel); // evaluate z80_uop_cond_t
+		void exec_uop(); // run micro-ops until the next bus cycle has been staged (or the program has ended)
+
+		/* opcode decoders (xx yyy zzz) for building the tables above - these return nullptr for opcodes with micro-op programs, and the instantiations of executors specialised on modifier prefix M otherwise */
+		template<int M> static exec_t decode_main_q0(uint8_t y, uint8_t z);
+		template<int M> static exec_t decode_main_q3(uint8_t y, uint8_t z);
+		static exec_t decode_ed_q1(uint8_t y, uint8_t z);
+		static exec_t decode_ed_q2(uint8_t y, uint8_t z);
+
+		/* instruction executors - those templated on modifier prefix M (Z80_MOD_*) are instantiated once per prefix, so the unprefixed ones carry no IX/IY or displacement handling */
+
+		void exec_nop(); // NOP, as well as undefined opcodes that behave like one
+		void exec_invalid(); // undefined ED opcodes outside quadrants 1 and 2 (return to fetching without touching Q)
+		void exec_nmi(); // NMI handling (after the ignored opcode fetch)
+		void exec_int(); // mode 1/2 INT handling (after acknowledgment)
 
 		/* main quadrant 0 (xx = 00) */
-		void exec_main_q0();
-		void exec_inc_r8();
-		void exec_dec_r8();
-		void exec_incdec_r16();
-		void exec_ld16_p16(); // also shared with ED quadrant 1
+		void exec_ex_af();
+		template<int M> void exec_inc_r8();
+		template<int M> void exec_dec_r8();
 		void exec_ld8_p16();
-		void exec_ld_i16();
-		void exec_add_hl_r16();
-		void exec_ld_i8();
-		void exec_jr_stub(bool take_branch = true, int step_start = 0); // JR/DJNZ stub (read displacement byte to Z, then perform relative jump if take_branch is true)
-		void exec_shift_a();
+		template<int M> void exec_add_hl_r16();
+		template<int M> void exec_ld_i8(); // LD (HL),n (LD r8,n is done by a micro-op program)
+		void exec_acc(); // RLCA/RRCA/RLA/RRA/DAA/CPL/SCF/CCF
 
 		/* main quadrant 1 (xx = 01) - LD and HALT */
-		void exec_main_q1();
+		template<int M> void exec_ld_r8();
+		void exec_halt();
 
 		/* main quadrant 2 (xx = 10) - ALU operations */
-		void exec_main_q2();
+		template<int M> void exec_alu_r8();
 		void exec_alu_stub(bool do_reset = true); // run ALU operations with operand in Z register and operation selector in _y (for sharing with main quadrant 3)
 
 		/* main quadrant 3 (xx = 11) */
-		void exec_main_q3();
-		void exec_cond_ret();
-		void exec_uncond_ret();
-		void exec_jp(bool cond);
-		void exec_call(bool cond);
-		void exec_push();
-		void exec_pop();
-		void exec_io_i8(bool out, uint8_t& reg); // IN r8,(n) / OUT (n),r8
-		void exec_rst();
-		void exec_ex_stack_hl();
-
-		void exec_ed(); // ED prefix subset
+		void exec_exx();
+		template<int M> void exec_jp_hl();
+		void exec_io_i8(); // IN A,(n) / OUT (n),A
+		void exec_ex_de_hl();
+		void exec_di();
+		void exec_ei();
 
 		/* ED quadrant 1 (xx = 01) */
-		void exec_ed_q1();
-		void exec_io_r8(bool out);
+		void exec_io_r8(); // IN r8,(C) / OUT (C),r8
 		void exec_adc_sbc_hl_r16();
 		//void exec_ld_r16_p16();
+		void exec_neg();
+		void exec_im();
 		void exec_ld_ir(); // LD I,A / LD R,A / LD A,I / LD A,R
 		void exec_bcd_rotate(); // RRD / RLD
 
 		/* ED quadrant 2 (xx = 10) - block transfer operations */
-		void exec_ed_q2();
 		void exec_blk_ld(); // LDI/LDD/LDIR/LDDR 
 		void exec_blk_cp(); // CPI/CPD/CPIR/CPDR
 		void exec_blk_in(); // INI/IND/INIR/INDR
 		void exec_blk_out(); // OUTI/OUTD/OTIR/OTDR
 
-		void exec_cb(); // CB prefix subset (all contained in instr_cb.cpp)
-		void exec_shift_rot(); // CB quadrant 0
-		void exec_bit(); // CB quadrant 1
-		void exec_res(); // CB quadrant 2
-		void exec_set(); // CB quadrant 3
+		/* CB prefix subset (all contained in instr_cb.cpp) */
+		template<int M> void exec_shift_rot(); // CB quadrant 0
+		template<int M> void exec_bit(); // CB quadrant 1
+		template<int M> void exec_res(); // CB quadrant 2
+		template<int M> void exec_set(); // CB quadrant 3
 	};
+
+	/* explicitly instantiate a member function template specialised on modifier prefix (see above) for all prefixes */
+	#define Z80_INSTANTIATE_MOD(ret, fn, ...) \
+		template ret z80_instr_decoder::fn<z80_instr_decoder::Z80_MOD_NONE>(__VA_ARGS__); \
+		template ret z80_instr_decoder::fn<z80_instr_decoder::Z80_MOD_DD>(__VA_ARGS__); \
+		template ret z80_instr_decoder::fn<z80_instr_decoder::Z80_MOD_FD>(__VA_ARGS__)
 }
 
@@ -3,7 +3,8 @@
 
 using namespace llz80emu;
 
-void z80_instr_decoder::exec_io_r8(bool out) {
+void z80_instr_decoder::exec_io_r8() {
+	bool out = (_z & 1); // OUT (C),r8 (as opposed to IN r8,(C))
 	switch (_step) {
 	case 0:
 		if (out) _ctx.start_io_write_cycle(_regs.REG_BC, (_y == 0b110) ? 0 : *reg8(_y));
@@ -15,9 +16,7 @@ void z80_instr_decoder::exec_io_r8(bool out) {
 			/* IN - affect flags */
 			_regs.Q = _regs.REG_F =
 				(_regs.REG_F & Z80_FLAG_C) // all other flags are modified
-				| (_regs.REG_Z & (Z80_FLAG_F3 | Z80_FLAG_F5 | Z80_FLAG_S))
-				| ((bool)!_regs.REG_Z << Z80_FLAGBIT_Z)
-				| (parity(_regs.REG_Z) << Z80_FLAGBIT_PV);
+				| z80_flag_tables.sz53p[_regs.REG_Z];
 			if (_y != 0b110) *reg8(_y) = _regs.REG_Z; // copy result
 		}
 		else _regs.Q = 0;
@@ -35,24 +34,26 @@ void z80_instr_decoder::exec_adc_sbc_hl_r16() {
 		if (_y & 1) {
 			/* ADC */
 			tmp = _regs.REG_HL + addend + carry;
+			uint8_t idx = z80_flags_idx(_regs.REG_H, addend >> 8, tmp >> 8); // high bytes (bits 11 and 15)
 			_regs.Q = _regs.REG_F =
 				((tmp >> 8) & (Z80_FLAG_S | Z80_FLAG_F3 | Z80_FLAG_F5)) // S = MSB of result, and copy bits 3 and 5 (from high byte)
 				| (((bool)!(tmp & 0xFFFF)) << Z80_FLAGBIT_Z) // Z contains whether the result is zero
-				| (((_regs.REG_HL & (1 << 15)) == (addend & (1 << 15)) && (_regs.REG_HL & (1 << 15)) != (tmp & (1 << 15))) << Z80_FLAGBIT_PV) // PV contains whether an overflow occurs
+				| z80_flag_tables.ov_add[idx >> 4] // PV contains whether an overflow occurs
 				| (((bool)(tmp & 0xFFFF0000)) << Z80_FLAGBIT_C) // C contains whether there's a carry (unsigned overflow)
 				| (0 << Z80_FLAGBIT_N) // reset subtract flag
-				| (((bool)(((_regs.REG_HL & 0x0FFF) + (addend & 0x0FFF) + carry) & 0xF000)) << Z80_FLAGBIT_H); // crude way to detect half carry
+				| z80_flag_tables.hc_add[idx & 7]; // half carry from bit 11
 		}
 		else {
 			/* SBC */
 			tmp = _regs.REG_HL - addend - carry;
+			uint8_t idx = z80_flags_idx(_regs.REG_H, addend >> 8, tmp >> 8);
 			_regs.Q = _regs.REG_F =
 				((tmp >> 8) & (Z80_FLAG_S | Z80_FLAG_F3 | Z80_FLAG_F5)) // S = MSB of result, and copy bits 3 and 5 (from high byte)
 				| (((bool)!(tmp & 0xFFFF)) << Z80_FLAGBIT_Z) // Z contains whether the result is zero
-				| (((_regs.REG_HL & (1 << 15)) != (addend & (1 << 15)) && (_regs.REG_HL & (1 << 15)) != (tmp & (1 << 15))) << Z80_FLAGBIT_PV) // PV contains whether an overflow occurs
+				| z80_flag_tables.ov_sub[idx >> 4] // PV contains whether an overflow occurs
 				| ((_regs.REG_HL < (addend + carry)) << Z80_FLAGBIT_C) // C contains whether there's a borrow (unsigned underflow)
 				| (1 << Z80_FLAGBIT_N) // set subtract flag
-				| (((_regs.REG_HL & 0x0FFF) < (((addend & 0x0FFF) + carry))) << Z80_FLAGBIT_H); // crude way to detect half borrow
+				| z80_flag_tables.hc_sub[idx & 7]; // half borrow from bit 12
 		}
 		_regs.REG_HL = (uint16_t)tmp;
 
@@ -95,8 +96,7 @@ void z80_instr_decoder::exec_ld_ir() {
 			_regs.Q = _regs.REG_F =
 				(_regs.REG_F & Z80_FLAG_C)
 				| (_regs.iff2 << Z80_FLAGBIT_PV)
-				| (_regs.REG_A & (Z80_FLAG_S | Z80_FLAG_F3 | Z80_FLAG_F5))
-				| (!_regs.REG_A << Z80_FLAGBIT_Z);
+				| z80_flag_tables.sz53[_regs.REG_A];
 		}
 		else {
 			ir = _regs.REG_A; // LD I/R,A
@@ -140,69 +140,53 @@ void z80_instr_decoder::exec_bcd_rotate() {
 	default:
 		_regs.Q = _regs.REG_F =
 			(_regs.REG_F & Z80_FLAG_C)
-			| (parity(_regs.REG_A) << Z80_FLAGBIT_PV)
-			| (_regs.REG_A & (Z80_FLAG_S | Z80_FLAG_F3 | Z80_FLAG_F5))
-			| ((bool)!_regs.REG_A << Z80_FLAGBIT_Z);
+			| z80_flag_tables.sz53p[_regs.REG_A];
 		_regs.MEMPTR = _regs.REG_HL + 1;
 		reset();
 		break;
 	}
 }
 
-void z80_instr_decoder::exec_ed_q1() {
-	switch (_z) {
-	case 0b000: // IN r8,(C)
-		exec_io_r8(false);
-		break;
-	case 0b001: // OUT (C),r8
-		exec_io_r8(true);
-		break;
-	case 0b010: // ADC/SBC HL,BC/DE/HL/SP
-		exec_adc_sbc_hl_r16();
-		break;
-	case 0b011: // LD (nn),BC/DE/HL/SP / LD BC/DE/HL/SP,(nn)
-		//exec_ld_r16_p16();
-		exec_ld16_p16();
-		break;
-	case 0b100: // NEG - reuse exec_alu_stub() for this
-		_y = 0b010; // SUB
-		_regs.REG_Z = _regs.REG_A; _regs.REG_A = 0; // A = 0 - A
-		exec_alu_stub();
+void z80_instr_decoder::exec_neg() {
+	/* reuse exec_alu_stub() for this */
+	_y = 0b010; // SUB
+	_regs.REG_Z = _regs.REG_A; _regs.REG_A = 0; // A = 0 - A
+	exec_alu_stub();
+}
+
+void z80_instr_decoder::exec_im() {
+	switch (_y & 0b011) {
+	case 0b10:
+		_regs.int_mode = 1;
 		break;
-	case 0b101: // RETI/RETN
-		if (!_step) _regs.iff1 = _regs.iff2; // restore IFF1
-		exec_uncond_ret(); // other than that it's the same thing as RET
-		_regs.Q = 0; // not setting flags
+	case 0b11:
+		_regs.int_mode = 2;
 		break;
-	case 0b110: // IM 0/1/2
-		switch (_y & 0b011) {
-		case 0b10:
-			_regs.int_mode = 1;
-			break;
-		case 0b11:
-			_regs.int_mode = 2;
-			break;
-		default:
-			_regs.int_mode = 0;
-			break;
-		}
-		_regs.Q = 0; // not setting flags
-		reset();
+	default:
+		_regs.int_mode = 0;
 		break;
-	case 0b111: // assorted instructions
-		switch (_y >> 1) {
+	}
+	_regs.Q = 0; // not setting flags
+	reset();
+}
+
+z80_instr_decoder::exec_t z80_instr_decoder::decode_ed_q1(uint8_t y, uint8_t z) {
+	switch (z) {
+	case 0b000: // IN r8,(C)
+	case 0b001: // OUT (C),r8
+		return &z80_instr_decoder::exec_io_r8;
+	case 0b010: return &z80_instr_decoder::exec_adc_sbc_hl_r16; // ADC/SBC HL,BC/DE/HL/SP
+	case 0b011: return nullptr; // LD (nn),BC/DE/HL/SP / LD BC/DE/HL/SP,(nn)
+	case 0b100: return &z80_instr_decoder::exec_neg; // NEG
+	case 0b101: return nullptr; // RETI/RETN
+	case 0b110: return &z80_instr_decoder::exec_im; // IM 0/1/2
+	default: // assorted instructions
+		switch (y >> 1) {
 		case 0b00:
 		case 0b01:
-			exec_ld_ir();
-			break;
-		case 0b10:
-			exec_bcd_rotate();
-			break;
-		default:
-			_regs.Q = 0; // not setting flags
-			reset();
-			break;
+			return &z80_instr_decoder::exec_ld_ir; // LD I,A / LD R,A / LD A,I / LD A,R
+		case 0b10: return &z80_instr_decoder::exec_bcd_rotate; // RRD / RLD
+		default: return &z80_instr_decoder::exec_nop;
 		}
-		break;
 	}
 }
\ No newline at end of file
@@ -220,26 +220,13 @@ void z80_instr_decoder::exec_blk_out() {
 	}
 }
 
-void z80_instr_decoder::exec_ed_q2() {
-	if (!(_y & 0b100) || (_x & 0b100)) {
-		/* empty opcode slots */
-		reset();
-		_regs.Q = 0; // not setting flags
-		return;
-	}
+z80_instr_decoder::exec_t z80_instr_decoder::decode_ed_q2(uint8_t y, uint8_t z) {
+	if (!(y & 0b100) || (z & 0b100)) return &z80_instr_decoder::exec_nop; // empty opcode slots
 
-	switch (_z) {
-	case 0b000:
-		exec_blk_ld();
-		break;
-	case 0b001:
-		exec_blk_cp();
-		break;
-	case 0b010:
-		exec_blk_in();
-		break;
-	case 0b011:
-		exec_blk_out();
-		break;
+	switch (z) {
+	case 0b000: return &z80_instr_decoder::exec_blk_ld;
+	case 0b001: return &z80_instr_decoder::exec_blk_cp;
+	case 0b010: return &z80_instr_decoder::exec_blk_in;
+	default: return &z80_instr_decoder::exec_blk_out;
 	}
 }
\ No newline at end of file
@@ -4,30 +4,22 @@
 
 using namespace llz80emu;
 
-void z80_instr_decoder::exec_main_q1() {
+void z80_instr_decoder::exec_halt() {
 	_regs.Q = 0; // we don't modify flags here
+	// _regs.REG_PC--;
+	reset(true);
+}
 
-	if(_regs.instr == 0x76) {
-		if (_mod == Z80_MOD_NONE) {
-			// HALT
-			// _regs.REG_PC--;
-			reset(true);
-			return;
-		}
-		else {
-			// undefined opcode
-			reset();
-			return;
-		}
-	}
+template<int M> void z80_instr_decoder::exec_ld_r8() {
+	_regs.Q = 0; // we don't modify flags here
 
 	/* decode source and destination register */
-	const uint8_t* src = reg8(_z); uint8_t* dst = reg8(_y);
+	const uint8_t* src = reg8<M>(_z); uint8_t* dst = reg8<M>(_y);
 	assert(src || dst); // at least one must be non-null
 	if (!src || !dst) {
 		/* two-step operation: initiate memory read/write on step=0, then return to fetching on step=1 */
 		if (!_step) {
-			if (!process_hlptr()) return; // _hl_ptr isn't ready yet
+			if (!process_hlptr<M>()) return; // _hl_ptr isn't ready yet
 			if(!src) _ctx.start_mem_read_cycle(_hl_ptr, *reg8_nomod(_y)); // read from (HL) - if (HL) is already used then L/H won't be replaced with IXL/IXH or IYL/IYH
 			else _ctx.start_mem_write_cycle(_hl_ptr, *reg8_nomod(_z)); // write to (HL)
 			return;
@@ -35,4 +27,6 @@ void z80_instr_decoder::exec_main_q1() {
 	} else *dst = *src; // copy from source to destination (normal business, takes a single step)
 
 	reset(); // return to fetching
-}
\ No newline at end of file
+}
+
+Z80_INSTANTIATE_MOD(void, exec_ld_r8);
\ No newline at end of file
@@ -0,0 +1,270 @@
+#include "instr_decoder.h"
+#include "z80emu.h"
+
+using namespace llz80emu;
+
+/* micro-op programs - each READ/WRITE/BOGUS ends an execution step (i.e. stages exactly one cycle) */
+#define UOP(op)							{ Z80_UOP_##op, Z80_UOP_ADDR_NONE, 0 }
+#define UOP_ARG(op, arg)				{ Z80_UOP_##op, Z80_UOP_ADDR_NONE, (arg) }
+#define UOP_READ(addr, data)			{ Z80_UOP_READ, Z80_UOP_ADDR_##addr, Z80_UOP_DATA_##data }
+#define UOP_WRITE(addr, data)			{ Z80_UOP_WRITE, Z80_UOP_ADDR_##addr, Z80_UOP_DATA_##data }
+
+static constexpr z80_uop_t prog_ld_r_n[] = { // LD r8,n
+	UOP_READ(PC_INC, R8), UOP(END)
+};
+
+static constexpr z80_uop_t prog_ld_rp_nn[] = { // LD r16,nn
+	UOP_READ(PC_INC, RP_L), UOP_READ(PC_INC, RP_H), UOP(END)
+};
+
+static constexpr z80_uop_t prog_ld_pnn_rp[] = { // LD (nn),r16
+	UOP_READ(PC_INC, Z), UOP_READ(PC_INC, W),
+	UOP_WRITE(WZ_INC, RP_L), UOP_WRITE(WZ, RP_H), UOP(MEMPTR_WZ), UOP(END)
+};
+
+static constexpr z80_uop_t prog_ld_rp_pnn[] = { // LD r16,(nn)
+	UOP_READ(PC_INC, Z), UOP_READ(PC_INC, W),
+	UOP_READ(WZ_INC, RP_L), UOP_READ(WZ, RP_H), UOP(MEMPTR_WZ), UOP(END)
+};
+
+static constexpr z80_uop_t prog_incdec_rp[] = { // INC/DEC r16
+	UOP(INCDEC_RP), UOP_ARG(BOGUS, 2), UOP(END)
+};
+
+static constexpr z80_uop_t prog_ld_sp_hl[] = { // LD SP,HL
+	UOP_ARG(BOGUS, 2), UOP(LD_SP_HL), UOP(END)
+};
+
+static constexpr z80_uop_t prog_jr[] = { // JR d
+	UOP_READ(PC_INC, Z), UOP(JUMP_REL), UOP_ARG(BOGUS, 5), UOP(END)
+};
+
+static constexpr z80_uop_t prog_jr_cc[] = { // JR cc,d
+	UOP_READ(PC_INC, Z), UOP_ARG(END_IF_NOT, Z80_UOP_COND_CC_JR), UOP(JUMP_REL), UOP_ARG(BOGUS, 5), UOP(END)
+};
+
+static constexpr z80_uop_t prog_djnz[] = { // DJNZ d
+	UOP(DEC_B), UOP_ARG(BOGUS, 1),
+	UOP_READ(PC_INC, Z), UOP_ARG(END_IF_NOT, Z80_UOP_COND_B_NZ), UOP(JUMP_REL), UOP_ARG(BOGUS, 5), UOP(END)
+};
+
+static constexpr z80_uop_t prog_jp[] = { // JP nn
+	UOP_READ(PC_INC, Z), UOP_READ(PC_INC, W), UOP(MEMPTR_WZ), UOP(JUMP), UOP(END)
+};
+
+static constexpr z80_uop_t prog_jp_cc[] = { // JP cc,nn
+	UOP_READ(PC_INC, Z), UOP_READ(PC_INC, W), UOP(MEMPTR_WZ), UOP_ARG(END_IF_NOT, Z80_UOP_COND_CC), UOP(JUMP), UOP(END)
+};
+
+static constexpr z80_uop_t prog_call[] = { // CALL nn
+	UOP_READ(PC_INC, Z), UOP_READ(PC_INC, W), UOP(MEMPTR_WZ), UOP_ARG(BOGUS, 1),
+	UOP_WRITE(SP_DEC, PCH), UOP_WRITE(SP_DEC, PCL), UOP(JUMP), UOP(END)
+};
+
+static constexpr z80_uop_t prog_call_cc[] = { // CALL cc,nn
+	UOP_READ(PC_INC, Z), UOP_READ(PC_INC, W), UOP(MEMPTR_WZ), UOP_ARG(END_IF_NOT, Z80_UOP_COND_CC), UOP_ARG(BOGUS, 1),
+	UOP_WRITE(SP_DEC, PCH), UOP_WRITE(SP_DEC, PCL), UOP(JUMP), UOP(END)
+};
+
+static constexpr z80_uop_t prog_ret[] = { // RET
+	UOP_READ(SP_INC, PCL), UOP_READ(SP_INC, PCH), UOP(MEMPTR_PC), UOP(END)
+};
+
+static constexpr z80_uop_t prog_ret_cc[] = { // RET cc
+	UOP_ARG(BOGUS, 1), UOP_ARG(END_IF_NOT, Z80_UOP_COND_CC),
+	UOP_READ(SP_INC, PCL), UOP_READ(SP_INC, PCH), UOP(MEMPTR_PC), UOP(END)
+};
+
+static constexpr z80_uop_t prog_retn[] = { // RETI/RETN
+	UOP(RESTORE_IFF), UOP_READ(SP_INC, PCL), UOP_READ(SP_INC, PCH), UOP(MEMPTR_PC), UOP(END)
+};
+
+static constexpr z80_uop_t prog_rst[] = { // RST
+	UOP_ARG(BOGUS, 1), UOP_WRITE(SP_DEC, PCH), UOP_WRITE(SP_DEC, PCL), UOP(RST), UOP(END)
+};
+
+static constexpr z80_uop_t prog_push[] = { // PUSH r16
+	UOP_ARG(BOGUS, 1), UOP_WRITE(SP_DEC, RP2_H), UOP_WRITE(SP_DEC, RP2_L), UOP(END)
+};
+
+static constexpr z80_uop_t prog_pop[] = { // POP r16
+	UOP_READ(SP_INC, RP2_L), UOP_READ(SP_INC, RP2_H), UOP(END)
+};
+
+static constexpr z80_uop_t prog_ex_sp_hl[] = { // EX (SP),HL
+	UOP_READ(SP, Z), UOP_READ(SP_1, W), UOP_ARG(BOGUS, 1),
+#if defined(LLZ80EMU_EX_SPHL_ALT_TIMING)
+	UOP_WRITE(SP, HL_L), UOP_WRITE(SP_1, HL_H),
+#else
+	UOP_WRITE(SP_1, HL_H), UOP_WRITE(SP, HL_L),
+#endif
+	UOP(EX_SP_HL), UOP_ARG(BOGUS, 2), UOP(END)
+};
+
+static constexpr z80_uop_t prog_alu_n[] = { // ADD/ADC/SUB/SBC/AND/XOR/OR/CP n
+	UOP_READ(PC_INC, Z), UOP(ALU), UOP(END)
+};
+
+const z80_uop_t* llz80emu::z80_uop_lookup(bool ed, uint8_t opcode) {
+	uint8_t x = (opcode & 0b11000000) >> 6, y = (opcode & 0b00111000) >> 3, z = (opcode & 0b00000111);
+
+	if (ed) {
+		if (x != 0b01) return nullptr;
+		switch (z) {
+		case 0b011: return (y & 1) ? prog_ld_rp_pnn : prog_ld_pnn_rp; // LD BC/DE/HL/SP,(nn) / LD (nn),BC/DE/HL/SP
+		case 0b101: return prog_retn;
+		default: return nullptr;
+		}
+	}
+
+	switch (x) {
+	case 0b00:
+		switch (z) {
+		case 0b000:
+			switch (y) {
+			case 0b000: // NOP
+			case 0b001: // EX AF,AF'
+				return nullptr;
+			case 0b010: return prog_djnz;
+			case 0b011: return prog_jr;
+			default: return prog_jr_cc;
+			}
+		case 0b001: return (y & 1) ? nullptr : prog_ld_rp_nn; // ADD HL,r16 is done by exec_add_hl_r16()
+		case 0b010:
+			if ((y & 0b110) != 0b100) return nullptr; // LD (BC/DE/nn),A / LD A,(BC/DE/nn)
+			return (y & 1) ? prog_ld_rp_pnn : prog_ld_pnn_rp; // LD HL,(nn) / LD (nn),HL
+		case 0b011: return prog_incdec_rp;
+		case 0b110: return (y == 0b110) ? nullptr : prog_ld_r_n; // LD (HL),n needs the DD/FD displacement handling in exec_ld_i8()
+		default: return nullptr;
+		}
+	case 0b11:
+		switch (z) {
+		case 0b000: return prog_ret_cc;
+		case 0b001:
+			if (!(y & 1)) return prog_pop;
+			if (y == 0b001) return prog_ret;
+			if (y == 0b111) return prog_ld_sp_hl;
+			return nullptr;
+		case 0b010: return prog_jp_cc;
+		case 0b011:
+			if (y == 0b000) return prog_jp;
+			if (y == 0b100) return prog_ex_sp_hl;
+			return nullptr;
+		case 0b100: return prog_call_cc;
+		case 0b101:
+			if (!(y & 1)) return prog_push;
+			if (y == 0b001) return prog_call;
+			return nullptr; // prefixes
+		case 0b110: return prog_alu_n;
+		default: return prog_rst;
+		}
+	default:
+		return nullptr;
+	}
+}
+
+uint16_t z80_instr_decoder::uop_addr(uint8_t sel) {
+	switch (sel) {
+	case Z80_UOP_ADDR_PC_INC: return _regs.REG_PC++;
+	case Z80_UOP_ADDR_SP_INC: return _regs.REG_SP++;
+	case Z80_UOP_ADDR_SP_DEC: return --_regs.REG_SP;
+	case Z80_UOP_ADDR_SP: return _regs.REG_SP;
+	case Z80_UOP_ADDR_SP_1: return _regs.REG_SP + 1;
+	case Z80_UOP_ADDR_WZ: return _regs.REG_WZ;
+	case Z80_UOP_ADDR_WZ_INC: return _regs.REG_WZ++;
+	default: return 0;
+	}
+}
+
+uint8_t* z80_instr_decoder::uop_data(uint8_t sel) {
+	switch (sel) {
+	case Z80_UOP_DATA_Z: return &_regs.REG_Z;
+	case Z80_UOP_DATA_W: return &_regs.REG_W;
+	case Z80_UOP_DATA_PCL: return &_regs.REG_PCL;
+	case Z80_UOP_DATA_PCH: return &_regs.REG_PCH;
+	case Z80_UOP_DATA_R8: return reg8(_y);
+	case Z80_UOP_DATA_RP_L: return LB_PTR(reg16(_y >> 1));
+	case Z80_UOP_DATA_RP_H: return HB_PTR(reg16(_y >> 1));
+	case Z80_UOP_DATA_RP2_L: return LB_PTR(reg16_alt(_y >> 1));
+	case Z80_UOP_DATA_RP2_H: return HB_PTR(reg16_alt(_y >> 1));
+	case Z80_UOP_DATA_HL_L: return reg8(5);
+	case Z80_UOP_DATA_HL_H: return reg8(4);
+	default: return &_regs.REG_Z;
+	}
+}
+
+bool z80_instr_decoder::uop_cond(uint8_t sel) {
+	switch (sel) {
+	case Z80_UOP_COND_CC: return check_cond(_y);
+	case Z80_UOP_COND_CC_JR: return check_cond(_y - 4);
+	case Z80_UOP_COND_B_NZ: return _regs.REG_B;
+	default: return false;
+	}
+}
+
+void z80_instr_decoder::exec_uop() {
+	_regs.Q = 0; // none of the programs set flags, except for ALU which sets Q on its own
+
+	while (true) {
+		const z80_uop_t& uop = _uop[_uop_pc++];
+		switch (uop.op) {
+		case Z80_UOP_READ:
+			{
+				uint16_t addr = uop_addr(uop.addr); // evaluate address first (the order of evaluating function arguments is unspecified)
+				_ctx.start_mem_read_cycle(addr, *uop_data(uop.arg));
+			}
+			return;
+		case Z80_UOP_WRITE:
+			{
+				uint16_t addr = uop_addr(uop.addr);
+				_ctx.start_mem_write_cycle(addr, *uop_data(uop.arg));
+			}
+			return;
+		case Z80_UOP_BOGUS:
+			_ctx.start_bogus_cycle(uop.arg);
+			return;
+		case Z80_UOP_END_IF_NOT:
+			if (uop_cond(uop.arg)) break;
+			reset(); // condition not met
+			return;
+		case Z80_UOP_JUMP:
+			_regs.REG_PC = _regs.REG_WZ;
+			break;
+		case Z80_UOP_JUMP_REL:
+			_regs.REG_W = (_regs.REG_Z >> 7) * 0xFF; // lazy 8->16bit sign extend operation
+			_regs.REG_PC += _regs.REG_WZ; _regs.MEMPTR = _regs.REG_PC;
+			break;
+		case Z80_UOP_RST:
+			_regs.MEMPTR = _regs.REG_PC = _y << 3; // set PC to the selected vector
+			break;
+		case Z80_UOP_MEMPTR_WZ:
+			_regs.MEMPTR = _regs.REG_WZ;
+			break;
+		case Z80_UOP_MEMPTR_PC:
+			_regs.MEMPTR = _regs.REG_PC;
+			break;
+		case Z80_UOP_LD_SP_HL:
+			_regs.REG_SP = *reg16(2);
+			break;
+		case Z80_UOP_EX_SP_HL:
+			_regs.MEMPTR = *reg16(2) = _regs.REG_WZ; // do the exchange
+			break;
+		case Z80_UOP_INCDEC_RP:
+			if (_y & 1) (*reg16(_y >> 1))--; // DEC r16
+			else (*reg16(_y >> 1))++; // INC r16
+			break;
+		case Z80_UOP_DEC_B:
+			_regs.REG_B--;
+			break;
+		case Z80_UOP_RESTORE_IFF:
+			_regs.iff1 = _regs.iff2;
+			break;
+		case Z80_UOP_ALU:
+			exec_alu_stub(false);
+			break;
+		default: // Z80_UOP_END
+			reset();
+			return;
+		}
+	}
+}
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "cycle.h"
+#include "counters.h"
 
 #if !defined(NO_EXCEPTIONS)
 #include <stdexcept>
@@ -15,6 +16,18 @@ void z80_intack_cycle::reset(uint8_t& val_out) {
 	_out = &val_out;
 }
 
+void z80_intack_cycle::get_state(z80_cycle_state_t& state) const {
+	z80_cycle::get_state(state);
+	state.wait = _wait;
+	state.val_out = _out;
+}
+
+void z80_intack_cycle::set_state(const z80_cycle_state_t& state) {
+	z80_cycle::set_state(state);
+	_wait = state.wait;
+	_out = state.val_out;
+}
+
 bool z80_intack_cycle::clock(bool clk) {
 	z80_cycle::clock(clk); // call this first to increment our T cycle
 
@@ -43,7 +56,7 @@ bool z80_intack_cycle::clock(bool clk) {
 		break; // nothing to do here (WAIT pin sampling will be done in the next T half)
 	case 8: // T3 high
 		_wait = !(_pins.state & Z80_WAIT); // sample WAIT pin (true = WAIT state activated)
-		if (_wait) _t--; // stay in TW2
+		if (_wait) { _t--; Z80_COUNT((*_wait_states)++); } // stay in TW2
 		else {
 			*_out = (uint8_t)((_pins.state & Z80_D_ALL) >> Z80_PIN_D_BASE); // sample Dx pins
 			_pins.state =
@@ -1,4 +1,5 @@
 #include "cycle.h"
+#include "counters.h"
 
 #if !defined(NO_EXCEPTIONS)
 #include <stdexcept>
@@ -36,7 +37,7 @@ bool z80_io_read_cycle::clock(bool clk) {
 		break;
 	case 6: // T3 high
 		_wait = !(_pins.state & Z80_WAIT); // sample WAIT pin (true = WAIT state activated)
-		if (_wait) _t--; // stay in T2
+		if (_wait) { _t--; Z80_COUNT((*_wait_states)++); } // stay in T2
 		sample_busreq();
 		break;
 	case 7: // T3 low
@@ -90,7 +91,7 @@ bool z80_io_write_cycle::clock(bool clk) {
 		break;
 	case 6: // T3 high
 		_wait = !(_pins.state & Z80_WAIT); // sample WAIT pin (true = WAIT state activated)
-		if (_wait) _t--; // stay in T2
+		if (_wait) { _t--; Z80_COUNT((*_wait_states)++); } // stay in T2
 		sample_busreq();
 		break;
 	case 7: // T3 low
@@ -109,4 +110,4 @@ bool z80_io_write_cycle::clock(bool clk) {
 	}
 
 	return false;
-} 
\ No newline at end of file
+}
\ No newline at end of file
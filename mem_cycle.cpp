@@ -1,4 +1,5 @@
 #include "cycle.h"
+#include "counters.h"
 
 #if !defined(NO_EXCEPTIONS)
 #include <stdexcept>
@@ -32,7 +33,7 @@ bool z80_mem_read_cycle::clock(bool clk) {
 		break; // nothing to do here (WAIT and Dx pin sampling are to be done at the start of T3 high)
 	case 4: // T3 high
 		_wait = !(_pins.state & Z80_WAIT); // sample WAIT pin (true = WAIT state activated)
-		if (_wait) _t--; // stay in T2
+		if (_wait) { _t--; Z80_COUNT((*_wait_states)++); } // stay in T2
 		sample_busreq();
 		break;
 	case 5: // T3 low
@@ -79,10 +80,11 @@ bool z80_mem_write_cycle::clock(bool clk) {
 		break; // nothing to do here
 	case 3: // T2 low
 		_pins.state &= ~Z80_WR; // start memory write
+		if (_dirty) _dirty->mark(_addr); // the host may make the write from here on (it's marked again once the cycle completes - see z80emu::end_cycle())
 		break;
 	case 4: // T3 high
 		_wait = !(_pins.state & Z80_WAIT); // sample WAIT pin (true = WAIT state activated)
-		if (_wait) _t--; // stay in T2
+		if (_wait) { _t--; Z80_COUNT((*_wait_states)++); } // stay in T2
 		sample_busreq();
 		break;
 	case 5: // T3 low
@@ -0,0 +1,73 @@
+#include "memmap.h"
+
+#if !defined(NO_EXCEPTIONS)
+#include <stdexcept>
+#endif
+
+using namespace llz80emu;
+
+z80_memory_map::z80_memory_map(size_t pages) : _pages_n(pages) {
+	if (pages != 16 && pages != 64) {
+#if defined(NO_EXCEPTIONS)
+		abort();
+#else
+		throw std::invalid_argument("Memory maps must have 16 or 64 pages");
+#endif
+	}
+	_shift = (pages == 16) ? 12 : 10;
+	_mask = (uint16_t)((1 << _shift) - 1);
+}
+
+bool z80_memory_map::set_pages(uint16_t addr, size_t len, const page_t& page, size_t stride) {
+	if ((addr & _mask) || (len & _mask) || addr + len > 0x10000) return false;
+	page_t p = page;
+	for (size_t i = addr >> _shift; i < (addr + len) >> _shift; i++) {
+		_pages[i] = p;
+		if (p.read) p.read += stride;
+		if (p.write) p.write += stride;
+	}
+	return true;
+}
+
+bool z80_memory_map::map_ram(uint16_t addr, size_t len, uint8_t* mem) {
+	page_t page = {};
+	page.read = page.write = mem;
+	return set_pages(addr, len, page, page_size());
+}
+
+bool z80_memory_map::map_rom(uint16_t addr, size_t len, const uint8_t* mem) {
+	page_t page = {};
+	page.read = mem;
+	return set_pages(addr, len, page, page_size());
+}
+
+bool z80_memory_map::map_handler(uint16_t addr, size_t len, const z80_mem_handler_t& handler) {
+	page_t page = {};
+	page.handler = handler;
+	return set_pages(addr, len, page, 0);
+}
+
+bool z80_memory_map::unmap(uint16_t addr, size_t len) {
+	return set_pages(addr, len, {}, 0);
+}
+
+size_t z80_memory_map::pages() const {
+	return _pages_n;
+}
+
+size_t z80_memory_map::page_size() const {
+	return (size_t)1 << _shift;
+}
+
+const uint8_t* z80_memory_map::host_ptr(uint16_t addr) const {
+	const page_t& page = _pages[addr >> _shift];
+	return (page.read) ? &page.read[addr & _mask] : nullptr;
+}
+
+uint8_t z80_memory_map::mem_read_cb(void* ctx, uint16_t addr) {
+	return ((const z80_memory_map*)ctx)->read(addr);
+}
+
+void z80_memory_map::mem_write_cb(void* ctx, uint16_t addr, uint8_t val) {
+	((z80_memory_map*)ctx)->write(addr, val);
+}
\ No newline at end of file
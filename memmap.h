@@ -0,0 +1,71 @@
+#pragma once
+
+#include "z80emu.h"
+
+namespace llz80emu {
+	#define Z80_MEMMAP_MAX_PAGES				64 // maximum number of page table entries (1K pages)
+
+	/* handler for memory-mapped devices (or anything else that isn't plain host memory) */
+	typedef struct {
+		void* ctx; // opaque pointer passed to read and write
+		z80_mem_read_cb_t read; // optional - 0xFF (floating data bus) will be returned if this is null
+		z80_mem_write_cb_t write; // optional - writes will be ignored if this is null
+	} z80_mem_handler_t;
+
+	/*
+	 * Paged memory map: the address space is split into 16 (4K) or 64 (1K) pages, each pointing to host memory (RAM or ROM, accessed in place)
+	 * or to a handler. Pages can be remapped at any time (e.g. for bank switching), which only swaps the page's pointers.
+	 * Reads from unmapped pages return 0xFF, and writes to ROM or unmapped pages are ignored.
+	 */
+	class z80_memory_map {
+	public:
+		LLZ80EMU_API z80_memory_map(size_t pages = 16); // create a map with the specified number of pages (16 or 64), all unmapped
+
+		LLZ80EMU_API bool map_ram(uint16_t addr, size_t len, uint8_t* mem); // map host memory for reading and writing to [addr, addr + len) - return false if addr or len isn't page-aligned
+		LLZ80EMU_API bool map_rom(uint16_t addr, size_t len, const uint8_t* mem); // same as above, but read-only
+		LLZ80EMU_API bool map_handler(uint16_t addr, size_t len, const z80_mem_handler_t& handler); // have accesses to [addr, addr + len) go through a handler (which is given the full address)
+		LLZ80EMU_API bool unmap(uint16_t addr, size_t len); // unmap [addr, addr + len)
+
+		LLZ80EMU_API size_t pages() const; // number of pages
+		LLZ80EMU_API size_t page_size() const; // size of each page in bytes
+		LLZ80EMU_API const uint8_t* host_ptr(uint16_t addr) const; // return the host memory backing addr (nullptr if it's going through a handler or unmapped)
+
+		inline uint8_t read(uint16_t addr) const {
+			const page_t& page = _pages[addr >> _shift];
+			if (page.read) return page.read[addr & _mask]; // common case - no calls
+			return (page.handler.read) ? page.handler.read(page.handler.ctx, addr) : 0xFF;
+		}
+
+		inline void write(uint16_t addr, uint8_t val) {
+			const page_t& page = _pages[addr >> _shift];
+			if (page.write) page.write[addr & _mask] = val;
+			else if (page.handler.write) page.handler.write(page.handler.ctx, addr, val);
+		}
+
+		/* callbacks for z80_bus_t (with ctx pointing to the map) */
+		LLZ80EMU_API static uint8_t mem_read_cb(void* ctx, uint16_t addr);
+		LLZ80EMU_API static void mem_write_cb(void* ctx, uint16_t addr, uint8_t val);
+	private:
+		typedef struct {
+			const uint8_t* read; // host memory to read from (null = go through the handler)
+			uint8_t* write; // host memory to write to (null = go through the handler)
+			z80_mem_handler_t handler; // used if the above are null (all null if the page is read-only or unmapped)
+		} page_t;
+		page_t _pages[Z80_MEMMAP_MAX_PAGES] = {};
+		size_t _pages_n; // number of pages in use
+		int _shift; // log2 of the page size
+		uint16_t _mask; // page size - 1
+
+		bool set_pages(uint16_t addr, size_t len, const page_t& page, size_t stride); // point the pages in [addr, addr + len) to page (with memory pointers advanced by stride for each page) - return false if not page-aligned
+	};
+
+	/* bus class with memory accesses going through a map and the rest through z80_bus_t callbacks (see bus.h) */
+	class z80_memory_map_bus : public z80_callback_bus {
+	public:
+		inline z80_memory_map_bus(z80_memory_map& mem, const z80_bus_t& bus) : z80_callback_bus(bus), _mem(mem) {}
+		inline uint8_t read(uint16_t addr) { return _mem.read(addr); }
+		inline void write(uint16_t addr, uint8_t val) { _mem.write(addr, val); }
+	private:
+		z80_memory_map& _mem;
+	};
+}
@@ -0,0 +1,237 @@
+#include "opinfo.h"
+
+using namespace llz80emu;
+
+/* append machine cycle to entry (T cycles default to the cycle type's nominal length) */
+static constexpr void mc(z80_opinfo_t& e, uint8_t type, uint8_t addr, uint8_t tstates = 0) {
+	if (!tstates) tstates = (type == Z80_MCYCLE_MEM_READ || type == Z80_MCYCLE_MEM_WRITE) ? 3 : 4;
+	e.seq[e.mcycles_taken++] = { type, addr, tstates };
+}
+
+static constexpr void fetch(z80_opinfo_t& e) { mc(e, Z80_MCYCLE_FETCH, Z80_OPADDR_PC); }
+static constexpr void read(z80_opinfo_t& e, uint8_t addr) { mc(e, Z80_MCYCLE_MEM_READ, addr); }
+static constexpr void write(z80_opinfo_t& e, uint8_t addr) { mc(e, Z80_MCYCLE_MEM_WRITE, addr); }
+static constexpr void bogus(z80_opinfo_t& e, uint8_t tstates) { mc(e, Z80_MCYCLE_BOGUS, Z80_OPADDR_NONE, tstates); }
+
+/* end the condition not met/last iteration case here - cycles appended after this are only run if the condition is met */
+static constexpr void cond(z80_opinfo_t& e, uint8_t flag = Z80_OPINFO_COND) {
+	e.flags |= flag;
+	e.mcycles = e.mcycles_taken;
+}
+
+/* (HL) operand - for DD/FD prefixes, read displacement byte and spend 5 T cycles calculating IX+d/IY+d */
+static constexpr uint8_t hl_ptr(z80_opinfo_t& e, bool idx) {
+	if (!idx) return Z80_OPADDR_HL;
+	read(e, Z80_OPADDR_PC);
+	bogus(e, 5);
+	return Z80_OPADDR_IDX;
+}
+
+/* unprefixed instructions (following the DD/FD prefix fetch if idx is set) */
+static constexpr void gen_main(z80_opinfo_t& e, uint8_t op, bool idx) {
+	uint8_t x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+	uint8_t addr = 0;
+	fetch(e);
+	switch (x) {
+	case 0b00:
+		switch (z) {
+		case 0b000:
+			if (y == 0b010) { // DJNZ d
+				bogus(e, 1); read(e, Z80_OPADDR_PC);
+				cond(e); bogus(e, 5);
+			}
+			else if (y == 0b011) { // JR d
+				read(e, Z80_OPADDR_PC); bogus(e, 5);
+			}
+			else if (y & 0b100) { // JR NZ/Z/NC/C,d
+				read(e, Z80_OPADDR_PC);
+				cond(e); bogus(e, 5);
+			}
+			break; // NOP / EX AF,AF'
+		case 0b001:
+			if (y & 1) bogus(e, 7); // ADD HL,rr
+			else { read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC); } // LD rr,nn
+			break;
+		case 0b010:
+			switch (y) {
+			case 0b000: write(e, Z80_OPADDR_BC); break; // LD (BC),A
+			case 0b001: read(e, Z80_OPADDR_BC); break; // LD A,(BC)
+			case 0b010: write(e, Z80_OPADDR_DE); break; // LD (DE),A
+			case 0b011: read(e, Z80_OPADDR_DE); break; // LD A,(DE)
+			case 0b100: read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC); write(e, Z80_OPADDR_NN); write(e, Z80_OPADDR_NN); break; // LD (nn),HL
+			case 0b101: read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_NN); read(e, Z80_OPADDR_NN); break; // LD HL,(nn)
+			case 0b110: read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC); write(e, Z80_OPADDR_NN); break; // LD (nn),A
+			case 0b111: read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_NN); break; // LD A,(nn)
+			}
+			break;
+		case 0b011: bogus(e, 2); break; // INC/DEC rr
+		case 0b100:
+		case 0b101: // INC/DEC r
+			if (y == 0b110) {
+				addr = hl_ptr(e, idx);
+				read(e, addr); bogus(e, 1); write(e, addr);
+			}
+			break;
+		case 0b110: // LD r,n
+			if (y == 0b110 && idx) { // LD (IX+d),n / LD (IY+d),n - displacement calculation overlaps with reading n
+				read(e, Z80_OPADDR_PC);
+#if defined(LLZ80EMU_LDI8_DDFD_ALT_TIMING)
+				bogus(e, 2); read(e, Z80_OPADDR_PC);
+#else
+				read(e, Z80_OPADDR_PC); bogus(e, 2);
+#endif
+				write(e, Z80_OPADDR_IDX);
+			}
+			else {
+				read(e, Z80_OPADDR_PC);
+				if (y == 0b110) write(e, Z80_OPADDR_HL);
+			}
+			break;
+		default: break; // RLCA/RRCA/RLA/RRA/DAA/CPL/SCF/CCF
+		}
+		break;
+	case 0b01: // LD r,r' / HALT
+		if (op == 0x76) break;
+		if (y == 0b110) write(e, hl_ptr(e, idx));
+		else if (z == 0b110) read(e, hl_ptr(e, idx));
+		break;
+	case 0b10: // ALU r
+		if (z == 0b110) read(e, hl_ptr(e, idx));
+		break;
+	case 0b11:
+		switch (z) {
+		case 0b000: // RET cc
+			bogus(e, 1);
+			cond(e); read(e, Z80_OPADDR_SP); read(e, Z80_OPADDR_SP);
+			break;
+		case 0b001:
+			switch (y) {
+			case 0b011: case 0b101: break; // EXX / JP (HL)
+			case 0b111: bogus(e, 2); break; // LD SP,HL
+			default: read(e, Z80_OPADDR_SP); read(e, Z80_OPADDR_SP); break; // POP rr / RET
+			}
+			break;
+		case 0b010: // JP cc,nn
+			read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC);
+			cond(e);
+			break;
+		case 0b011:
+			switch (y) {
+			case 0b000: read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC); break; // JP nn
+			case 0b010: read(e, Z80_OPADDR_PC); mc(e, Z80_MCYCLE_IO_WRITE, Z80_OPADDR_PORT_N); break; // OUT (n),A
+			case 0b011: read(e, Z80_OPADDR_PC); mc(e, Z80_MCYCLE_IO_READ, Z80_OPADDR_PORT_N); break; // IN A,(n)
+			case 0b100: // EX (SP),HL
+				read(e, Z80_OPADDR_SP); read(e, Z80_OPADDR_SP); bogus(e, 1);
+				write(e, Z80_OPADDR_SP); write(e, Z80_OPADDR_SP); bogus(e, 2);
+				break;
+			default: break; // EX DE,HL / DI / EI
+			}
+			break;
+		case 0b100: // CALL cc,nn
+			read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC);
+			cond(e); bogus(e, 1); write(e, Z80_OPADDR_SP); write(e, Z80_OPADDR_SP);
+			break;
+		case 0b101: // PUSH rr / CALL nn
+			if (y == 0b001) { read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC); }
+			bogus(e, 1); write(e, Z80_OPADDR_SP); write(e, Z80_OPADDR_SP);
+			break;
+		case 0b110: read(e, Z80_OPADDR_PC); break; // ALU n
+		case 0b111: bogus(e, 1); write(e, Z80_OPADDR_SP); write(e, Z80_OPADDR_SP); break; // RST
+		}
+		break;
+	}
+}
+
+/* ED prefixed instructions */
+static constexpr void gen_ed(z80_opinfo_t& e, uint8_t op) {
+	uint8_t x = op >> 6, y = (op >> 3) & 7, z = op & 7;
+	fetch(e); fetch(e);
+	if (x == 0b01) {
+		switch (z) {
+		case 0b000: mc(e, Z80_MCYCLE_IO_READ, Z80_OPADDR_PORT_C); break; // IN r,(C)
+		case 0b001: mc(e, Z80_MCYCLE_IO_WRITE, Z80_OPADDR_PORT_C); break; // OUT (C),r
+		case 0b010: bogus(e, 7); break; // SBC/ADC HL,rr
+		case 0b011: // LD (nn),rr / LD rr,(nn)
+			read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC);
+			if (y & 1) { read(e, Z80_OPADDR_NN); read(e, Z80_OPADDR_NN); }
+			else { write(e, Z80_OPADDR_NN); write(e, Z80_OPADDR_NN); }
+			break;
+		case 0b101: read(e, Z80_OPADDR_SP); read(e, Z80_OPADDR_SP); break; // RETN/RETI
+		case 0b111:
+			if (y < 0b100) bogus(e, 1); // LD I,A / LD R,A / LD A,I / LD A,R
+			else if (y < 0b110) { read(e, Z80_OPADDR_HL); bogus(e, 4); write(e, Z80_OPADDR_HL); } // RRD / RLD
+			break;
+		default: break; // NEG / IM
+		}
+	}
+	else if (x == 0b10 && (y & 0b100) && !(z & 0b100)) {
+		switch (z) {
+		case 0b000: read(e, Z80_OPADDR_HL); write(e, Z80_OPADDR_DE); bogus(e, 2); break; // LDI/LDD/LDIR/LDDR
+		case 0b001: read(e, Z80_OPADDR_HL); bogus(e, 5); break; // CPI/CPD/CPIR/CPDR
+		case 0b010: bogus(e, 1); mc(e, Z80_MCYCLE_IO_READ, Z80_OPADDR_PORT_C); write(e, Z80_OPADDR_HL); break; // INI/IND/INIR/INDR
+		case 0b011: bogus(e, 1); read(e, Z80_OPADDR_HL); mc(e, Z80_MCYCLE_IO_WRITE, Z80_OPADDR_PORT_C); break; // OUTI/OUTD/OTIR/OTDR
+		}
+		if (y & 0b010) { // repeating
+			cond(e, Z80_OPINFO_REPEAT); bogus(e, 5);
+		}
+	}
+}
+
+/* CB prefixed instructions (following DD/FD and the displacement byte if idx is set) */
+static constexpr void gen_cb(z80_opinfo_t& e, uint8_t op, bool idx) {
+	uint8_t x = op >> 6, z = op & 7;
+	fetch(e);
+	if (idx) {
+		fetch(e); read(e, Z80_OPADDR_PC); read(e, Z80_OPADDR_PC); bogus(e, 2); // CB fetch, displacement byte and opcode read
+	}
+	else fetch(e);
+	if (z == 0b110 || idx) {
+		uint8_t addr = (idx) ? Z80_OPADDR_IDX : Z80_OPADDR_HL;
+		read(e, addr); bogus(e, 1);
+		if (x != 0b01) write(e, addr); // BIT doesn't write back
+	}
+}
+
+static constexpr z80_opinfo_t make_opinfo(int space, uint8_t op) {
+	z80_opinfo_t e = {};
+	bool idx = (space == Z80_OPSPACE_DD || space == Z80_OPSPACE_FD);
+
+	switch (space) {
+	case Z80_OPSPACE_MAIN:
+	case Z80_OPSPACE_DD:
+	case Z80_OPSPACE_FD:
+		if (idx) fetch(e); // DD/FD prefix
+		if (op == 0xCB || op == 0xDD || op == 0xED || op == 0xFD) {
+			fetch(e);
+			e.flags |= Z80_OPINFO_PREFIX;
+		}
+		else gen_main(e, op, idx);
+		break;
+	case Z80_OPSPACE_CB: gen_cb(e, op, false); break;
+	case Z80_OPSPACE_ED: gen_ed(e, op); break;
+	default: gen_cb(e, op, true); break; // DDCB/FDCB
+	}
+
+	if (!(e.flags & (Z80_OPINFO_COND | Z80_OPINFO_REPEAT))) e.mcycles = e.mcycles_taken;
+	for (int i = 0; i < e.mcycles_taken; i++) {
+		const z80_mcycle_info_t& c = e.seq[i];
+		if (c.addr == Z80_OPADDR_PC && (c.type == Z80_MCYCLE_FETCH || c.type == Z80_MCYCLE_MEM_READ)) e.len++; // opcode and operand bytes
+		if (i < e.mcycles) {
+			e.tstates += c.tstates;
+			e.counts[0][c.type]++;
+		}
+		e.tstates_taken += c.tstates;
+		e.counts[1][c.type]++;
+	}
+	return e;
+}
+
+static constexpr z80_opinfo_tables_t make_opinfo_tables() {
+	z80_opinfo_tables_t t = {};
+	for (int space = 0; space < Z80_OPSPACES; space++) {
+		for (int i = 0; i < 256; i++) t.op[space][i] = make_opinfo(space, (uint8_t)i);
+	}
+	return t;
+}
+
+constexpr z80_opinfo_tables_t llz80emu::z80_opinfo_tables = make_opinfo_tables();
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace llz80emu {
+	/* per-opcode metadata (generated at compile time by opinfo.cpp) - see z80emu::get_opinfo() */
+	#define Z80_OPINFO_MAX_MCYCLES				10 // maximum number of machine cycles in an instruction (excluding redundant prefixes)
+
+	typedef enum {
+		Z80_OPSPACE_MAIN, // no prefixes
+		Z80_OPSPACE_CB, // CB prefix
+		Z80_OPSPACE_ED, // ED prefix
+		Z80_OPSPACE_DD, // DD prefix (IX)
+		Z80_OPSPACE_FD, // FD prefix (IY)
+		Z80_OPSPACE_DDCB, // DDCB+d prefix (indexed by the opcode following the displacement byte)
+		Z80_OPSPACE_FDCB, // FDCB+d prefix
+		Z80_OPSPACES
+	} z80_opspace_t;
+
+	typedef enum {
+		Z80_MCYCLE_FETCH, // opcode fetch (4 T cycles)
+		Z80_MCYCLE_MEM_READ, // memory read (3 T cycles)
+		Z80_MCYCLE_MEM_WRITE, // memory write (3 T cycles)
+		Z80_MCYCLE_IO_READ, // I/O read (4 T cycles)
+		Z80_MCYCLE_IO_WRITE, // I/O write (4 T cycles)
+		Z80_MCYCLE_BOGUS, // internal operation (bus idle)
+		Z80_MCYCLE_TYPES
+	} z80_mcycle_type_t;
+
+	typedef enum {
+		Z80_OPADDR_NONE, // no address (internal operation)
+		Z80_OPADDR_PC, // PC (opcode, displacement and immediate operand bytes)
+		Z80_OPADDR_HL, // (HL)
+		Z80_OPADDR_BC, // (BC)
+		Z80_OPADDR_DE, // (DE)
+		Z80_OPADDR_SP, // stack
+		Z80_OPADDR_IDX, // (IX+d) / (IY+d)
+		Z80_OPADDR_NN, // absolute address taken from the immediate operand (nn)
+		Z80_OPADDR_PORT_N, // I/O port A:n
+		Z80_OPADDR_PORT_C, // I/O port BC
+	} z80_opaddr_t;
+
+	/* opinfo flags */
+	#define Z80_OPINFO_PREFIX					(1 << 0) // opcode is a prefix byte (the entry covers the fetch of the prefix itself)
+	#define Z80_OPINFO_COND						(1 << 1) // conditional instruction (the taken case is the condition being met)
+	#define Z80_OPINFO_REPEAT					(1 << 2) // repeating block instruction (the taken case is another iteration being scheduled)
+
+	typedef struct {
+		uint8_t type; // z80_mcycle_type_t
+		uint8_t addr; // z80_opaddr_t
+		uint8_t tstates; // T cycles taken (excluding wait states)
+	} z80_mcycle_info_t;
+
+	typedef struct {
+		uint8_t len; // instruction length in bytes (prefixes, displacement and immediate operands included)
+		uint8_t flags; // Z80_OPINFO_*
+		uint8_t tstates; // T cycles taken (condition not met/last iteration)
+		uint8_t tstates_taken; // T cycles taken (condition met/repeating) - same as tstates for unconditional instructions
+		uint8_t mcycles; // number of machine cycles (condition not met/last iteration) - these are the first entries of seq
+		uint8_t mcycles_taken; // number of machine cycles (condition met/repeating)
+		uint8_t counts[2][Z80_MCYCLE_TYPES]; // number of machine cycles of each type, indexed by whether the condition is met
+		z80_mcycle_info_t seq[Z80_OPINFO_MAX_MCYCLES]; // machine cycle sequence (condition met/repeating)
+	} z80_opinfo_t;
+
+	typedef struct {
+		z80_opinfo_t op[Z80_OPSPACES][256]; // indexed by opcode space and opcode
+	} z80_opinfo_tables_t;
+
+	extern const z80_opinfo_tables_t z80_opinfo_tables;
+}
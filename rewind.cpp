@@ -0,0 +1,124 @@
+#include "rewind.h"
+#include <string.h>
+#include <algorithm>
+
+using namespace llz80emu;
+
+z80_rewind::z80_rewind(z80emu& cpu, uint8_t* mem, uint64_t interval, size_t keyframes, size_t delta_size, const z80_rewind_host_t* host) :
+	_frames(std::max<size_t>(keyframes, 1)),
+	_slots(delta_size / Z80_REWIND_PAGE_SIZE * Z80_REWIND_PAGE_SIZE), _slot_page(delta_size / Z80_REWIND_PAGE_SIZE), _shadow(mem, mem + 0x10000),
+	_cpu(cpu), _mem(mem), _interval(std::max<uint64_t>(interval, 1) << 1) {
+	if (host) {
+		_host = *host;
+		_host_states.resize(_frames.size() * _host.size);
+	}
+	_cpu.set_dirty_tracking(Z80_REWIND_PAGE_SIZE); // all clean, matching the shadow copy
+}
+
+size_t z80_rewind::collect(uint8_t* pages) {
+	z80_mem_range_t ranges[128]; // enough for every page (see z80emu::collect_dirty())
+	size_t n = 0, count = _cpu.collect_dirty(ranges, 128);
+	for (size_t i = 0; i < count; i++) {
+		for (size_t off = 0; off < ranges[i].len; off += Z80_REWIND_PAGE_SIZE) {
+			size_t page = (ranges[i].addr + off) / Z80_REWIND_PAGE_SIZE;
+			if (memcmp(&_shadow[page * Z80_REWIND_PAGE_SIZE], _mem + page * Z80_REWIND_PAGE_SIZE, Z80_REWIND_PAGE_SIZE)) pages[n++] = (uint8_t)page; // skip pages that were written with what they already held
+		}
+	}
+	return n;
+}
+
+void z80_rewind::drop() {
+	keyframe_t& frame = _frames[index(0)];
+	if (frame.delta_pages) { // the oldest delta is at the start of the ring
+		_slot_first = (_slot_first + frame.delta_pages) % _slot_page.size();
+		_slot_count -= frame.delta_pages;
+	}
+	_first = index(1); _count--;
+	_dropped++;
+}
+
+void z80_rewind::keyframe(z80_pinbits_t state) {
+	uint8_t pages[0x10000 / Z80_REWIND_PAGE_SIZE];
+	size_t n = collect(pages);
+
+	/* store the previous contents of the pages written as the delta of the previous keyframe */
+	while (_count && _slot_count + n > _slot_page.size()) drop(); // make room (if the delta doesn't fit at all, the previous keyframe goes as well, since RAM can't be rolled back to it)
+	if (_count && n) {
+		keyframe_t& prev = _frames[index(_count - 1)];
+		prev.delta = (_slot_first + _slot_count) % _slot_page.size(); prev.delta_pages = n;
+		for (size_t i = 0; i < n; i++) {
+			size_t slot = (prev.delta + i) % _slot_page.size();
+			memcpy(&_slots[slot * Z80_REWIND_PAGE_SIZE], &_shadow[pages[i] * Z80_REWIND_PAGE_SIZE], Z80_REWIND_PAGE_SIZE);
+			_slot_page[slot] = pages[i];
+		}
+		_slot_count += n;
+	}
+	for (size_t i = 0; i < n; i++) memcpy(&_shadow[pages[i] * Z80_REWIND_PAGE_SIZE], _mem + pages[i] * Z80_REWIND_PAGE_SIZE, Z80_REWIND_PAGE_SIZE);
+
+	if (_count == _frames.size()) drop();
+	size_t idx = index(_count++);
+	keyframe_t& frame = _frames[idx];
+	frame.time = _now; frame.state = state;
+	_cpu.save_state(frame.snapshot, sizeof(frame.snapshot));
+	frame.delta = 0; frame.delta_pages = 0;
+	if (_host.save) _host.save(_host.ctx, &_host_states[idx * _host.size]);
+}
+
+uint64_t z80_rewind::run(uint64_t half_cycles, z80_pinbits_t& state, z80_pin_handler_t handler, void* ctx) {
+	if (!_count) keyframe(state); // first call
+	uint64_t done = 0;
+	while (done < half_cycles) {
+		uint64_t next = (_now / _interval + 1) * _interval; // time of the next keyframe
+		uint64_t count = std::min(half_cycles - done, next - _now);
+		uint64_t ran = _cpu.clock_n((size_t)count, state, handler, ctx);
+		_now += ran; done += ran;
+		if (_now == next) keyframe(state);
+		if (ran < count) break; // breakpoint hit
+	}
+	return done;
+}
+
+bool z80_rewind::seek(uint64_t time, z80_pinbits_t& state, z80_pin_handler_t handler, void* ctx) {
+	if (!_count || time < _frames[index(0)].time || time > _now) return false;
+
+	/* roll RAM back to the latest keyframe */
+	uint8_t pages[0x10000 / Z80_REWIND_PAGE_SIZE];
+	size_t n = collect(pages);
+	for (size_t i = 0; i < n; i++) memcpy(_mem + pages[i] * Z80_REWIND_PAGE_SIZE, &_shadow[pages[i] * Z80_REWIND_PAGE_SIZE], Z80_REWIND_PAGE_SIZE);
+
+	/* then through the deltas to the keyframe at or before time, discarding the ones in between */
+	while (_frames[index(_count - 1)].time > time) {
+		_count--;
+		keyframe_t& frame = _frames[index(_count - 1)];
+		for (size_t i = 0; i < frame.delta_pages; i++) {
+			size_t slot = (frame.delta + i) % _slot_page.size();
+			size_t off = _slot_page[slot] * Z80_REWIND_PAGE_SIZE;
+			memcpy(_mem + off, &_slots[slot * Z80_REWIND_PAGE_SIZE], Z80_REWIND_PAGE_SIZE);
+			memcpy(&_shadow[off], &_slots[slot * Z80_REWIND_PAGE_SIZE], Z80_REWIND_PAGE_SIZE);
+		}
+		_slot_count -= frame.delta_pages; // the newest delta is at the end of the ring
+		frame.delta_pages = 0;
+	}
+
+	size_t idx = index(_count - 1);
+	const keyframe_t& frame = _frames[idx];
+	_cpu.load_state(frame.snapshot, sizeof(frame.snapshot));
+	if (_host.load) _host.load(_host.ctx, &_host_states[idx * _host.size]);
+	state = frame.state; _now = frame.time;
+
+	/* re-execute up to time (which comes before the next keyframe would be taken) */
+	while (_now < time) _now += _cpu.clock_n((size_t)(time - _now), state, handler, ctx);
+	return true;
+}
+
+uint64_t z80_rewind::now() const {
+	return _now;
+}
+
+uint64_t z80_rewind::oldest() const {
+	return (_count) ? _frames[index(0)].time : _now;
+}
+
+z80_rewind_stats_t z80_rewind::get_stats() const {
+	return { _count, oldest(), _slot_count, _dropped };
+}
\ No newline at end of file
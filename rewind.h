@@ -0,0 +1,80 @@
+#pragma once
+
+#include "z80emu.h"
+
+#include <vector>
+
+namespace llz80emu {
+	#define Z80_REWIND_PAGE_SIZE				256 // granularity of memory deltas (the finest dirty tracking page size)
+
+	/* host-side state (e.g. peripherals) to be stored with each keyframe */
+	typedef void (*z80_rewind_save_t)(void* ctx, void* buf); // write the host's state (of the size given in z80_rewind_host_t) into buf
+	typedef void (*z80_rewind_load_t)(void* ctx, const void* buf); // restore the host's state from buf
+
+	typedef struct {
+		void* ctx; // opaque pointer passed to save and load
+		size_t size; // size of the host's state in bytes
+		z80_rewind_save_t save;
+		z80_rewind_load_t load;
+	} z80_rewind_host_t;
+
+	typedef struct {
+		size_t keyframes; // number of keyframes held
+		uint64_t oldest; // time of the oldest keyframe (the earliest time that can be sought to)
+		size_t delta_pages; // number of pages held in memory deltas
+		uint64_t dropped; // number of keyframes dropped to make room for newer ones
+	} z80_rewind_stats_t;
+
+	/*
+	 * Rewind buffer for a pin-level z80emu instance and the 64K of plain host RAM its pin handler serves. The CPU is clocked through run(),
+	 * and a keyframe (a state snapshot - see state.h - along with the input pins and the host's state, if any) is taken every specified
+	 * number of T cycles. Memory is handled through the CPU's dirty page tracking, which the rewind buffer takes over: a shadow copy of RAM
+	 * as of the latest keyframe provides the previous contents of pages written since, which are kept as a delta restoring RAM to the
+	 * keyframe before. seek() rolls RAM back through the deltas, restores the nearest keyframe at or before the target time and
+	 * re-executes up to it (so the pin handler and the host's state must be deterministic), discarding the keyframes that follow.
+	 * Keyframes and deltas live in ring buffers allocated up front, with the oldest keyframes dropped when either is full.
+	 * Time is counted in half-cycles from the first run() call. Changes to RAM not made by the CPU must be reported through
+	 * z80emu::mark_dirty().
+	 */
+	class z80_rewind {
+	public:
+		LLZ80EMU_API z80_rewind(z80emu& cpu, uint8_t* mem, uint64_t interval, size_t keyframes, size_t delta_size, const z80_rewind_host_t* host = nullptr); // attach to cpu (enabling its dirty tracking), with the first keyframe taken by the first run() call - interval is in T cycles, delta_size is in bytes (rounded down to whole pages), and host (copied) is optional
+
+		LLZ80EMU_API uint64_t run(uint64_t half_cycles, z80_pinbits_t& state, z80_pin_handler_t handler, void* ctx); // clock the CPU through z80emu::clock_n() (stopping early on breakpoint hits), taking keyframes along the way, and return the number of half-cycles run
+		LLZ80EMU_API bool seek(uint64_t time, z80_pinbits_t& state, z80_pin_handler_t handler, void* ctx); // go back to the specified time (breakpoints hit while re-executing don't stop it) - return false, leaving things untouched, if it is before oldest() or after now()
+
+		LLZ80EMU_API uint64_t now() const; // number of half-cycles run
+		LLZ80EMU_API uint64_t oldest() const; // earliest time that can be sought to
+		LLZ80EMU_API z80_rewind_stats_t get_stats() const; // get buffer usage statistics
+	private:
+		typedef struct {
+			uint64_t time;
+			z80_pinbits_t state; // input pins
+			uint8_t snapshot[Z80_STATE_SIZE];
+			size_t delta; // first delta slot (of the changes made between this keyframe and the next)
+			size_t delta_pages; // number of delta slots
+		} keyframe_t;
+		std::vector<keyframe_t> _frames; // keyframe ring
+		size_t _first = 0, _count = 0; // oldest keyframe and number of keyframes held
+
+		std::vector<uint8_t> _host_states; // host's state for each keyframe slot
+		z80_rewind_host_t _host = {};
+
+		/* memory deltas */
+		std::vector<uint8_t> _slots; // delta slot ring (Z80_REWIND_PAGE_SIZE bytes each)
+		std::vector<uint8_t> _slot_page; // page number of each slot
+		size_t _slot_first = 0, _slot_count = 0; // oldest slot in use and number of slots in use
+		std::vector<uint8_t> _shadow; // RAM as of the latest keyframe
+
+		z80emu& _cpu;
+		uint8_t* _mem;
+		uint64_t _interval; // keyframe interval in half-cycles
+		uint64_t _now = 0;
+		uint64_t _dropped = 0;
+
+		inline size_t index(size_t i) const { return (_first + i) % _frames.size(); } // slot of the i-th oldest keyframe
+		void keyframe(z80_pinbits_t state); // take a keyframe of the current state, storing the delta of the previous one
+		void drop(); // drop the oldest keyframe (and its delta)
+		size_t collect(uint8_t* pages); // collect the pages written since the latest keyframe into pages, and return their number
+	};
+}
@@ -15,6 +15,20 @@ void z80_read_cycle::reset(uint16_t addr, uint8_t& val_out) {
 	_wait = false;
 }
 
+void z80_read_cycle::get_state(z80_cycle_state_t& state) const {
+	z80_cycle::get_state(state);
+	state.wait = _wait;
+	state.addr = _addr;
+	state.val_out = _val_out;
+}
+
+void z80_read_cycle::set_state(const z80_cycle_state_t& state) {
+	z80_cycle::set_state(state);
+	_wait = state.wait;
+	_addr = state.addr;
+	_val_out = state.val_out;
+}
+
 /* write cycle base class methods */
 
 z80_write_cycle::z80_write_cycle(z80_pins_t& pins, z80_cycle_type_t cyc_type) : z80_cycle(pins, cyc_type) {
@@ -27,3 +41,17 @@ void z80_write_cycle::reset(uint16_t addr, uint8_t val) {
 	_val = val;
 	_wait = false;
 }
+
+void z80_write_cycle::get_state(z80_cycle_state_t& state) const {
+	z80_cycle::get_state(state);
+	state.wait = _wait;
+	state.addr = _addr;
+	state.val = _val;
+}
+
+void z80_write_cycle::set_state(const z80_cycle_state_t& state) {
+	z80_cycle::set_state(state);
+	_wait = state.wait;
+	_addr = state.addr;
+	_val = state.val;
+}
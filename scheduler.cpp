@@ -0,0 +1,217 @@
+#include "scheduler.h"
+
+using namespace llz80emu;
+
+#define Z80_SCHED_INPUTS					(Z80_INT | Z80_WAIT | Z80_RESET) // input pins left to the host
+#define Z80_SCHED_CTL						(Z80_M1 | Z80_MREQ | Z80_IORQ | Z80_RD | Z80_WR) // bus control outputs
+
+z80_bus_scheduler::z80_bus_scheduler(const z80_bus_t& bus) : _bus(bus) {
+
+}
+
+size_t z80_bus_scheduler::add_cpu(z80emu& cpu, int priority) {
+	master_t m = {};
+	m.cpu = &cpu;
+	m.priority = priority;
+	m.request = true;
+	m.request_time = UINT64_MAX;
+	m.inputs = Z80_SCHED_INPUTS;
+	m.busreq = true; // until arbitration grants it the bus
+	m.data = 0xFF;
+	_masters.push_back(m);
+	_rearbitrate = true;
+	return _masters.size() - 1;
+}
+
+size_t z80_bus_scheduler::add_device(const z80_bus_device_t& dev, int priority) {
+	master_t m = {};
+	m.dev = dev;
+	m.priority = priority;
+	m.request_time = UINT64_MAX;
+	_masters.push_back(m);
+	return _masters.size() - 1;
+}
+
+void z80_bus_scheduler::request(size_t master, bool state) {
+	if (_masters[master].request == state) return;
+	_masters[master].request = state;
+	_rearbitrate = true;
+}
+
+void z80_bus_scheduler::request_at(size_t master, uint64_t time) {
+	_masters[master].request_time = time;
+	_rearbitrate = true; // the window may have to be cut short
+}
+
+void z80_bus_scheduler::set_inputs(size_t master, z80_pinbits_t state) {
+	_masters[master].inputs = state & Z80_SCHED_INPUTS;
+	_rearbitrate = true; // CPUs that were skipped through may come back onto the bus
+}
+
+void z80_bus_scheduler::set_timeslice(uint64_t half_cycles) {
+	_timeslice = half_cycles;
+}
+
+void z80_bus_scheduler::set_memory_map(z80_memory_map* map) {
+	_mem = map;
+}
+
+uint64_t z80_bus_scheduler::now() const {
+	return _now;
+}
+
+int z80_bus_scheduler::owner() const {
+	return _owner;
+}
+
+z80_bus_sched_stats_t z80_bus_scheduler::get_stats() const {
+	return _stats;
+}
+
+bool z80_bus_scheduler::on_bus(const master_t& m) const {
+	return (m.cpu->get_pins().dir & Z80_MREQ) != 0; // control lines float during reset and bus release
+}
+
+bool z80_bus_scheduler::off_bus(const master_t& m) const {
+	return m.busreq && (m.cpu->is_bus_released() || (!(m.inputs & Z80_RESET) && !on_bus(m))); // released, or held in reset
+}
+
+void z80_bus_scheduler::arbitrate() {
+	_rearbitrate = false;
+	for (auto& m : _masters) {
+		if (m.request_time <= _now) {
+			m.request = true;
+			m.request_time = UINT64_MAX;
+		}
+	}
+
+	/* pick the requesting master with the highest priority, going round-robin from the owner among equals */
+	size_t n = _masters.size();
+	bool expired = _timeslice && _owner >= 0 && _now - _owned_since >= _timeslice;
+	int best = -1;
+	for (size_t k = 0; k < n; k++) {
+		int i = (int)((_owner < 0) ? k : (_owner + 1 + k) % n); // the owner comes last
+		const master_t& m = _masters[i];
+		if (!m.request) continue;
+		if (best < 0 || m.priority > _masters[best].priority || (m.priority == _masters[best].priority && i == _owner && !expired)) best = i;
+	}
+
+	/* hand over once everyone else is off the bus (CPUs with BUSREQ held low release it at the end of their current machine cycle) */
+	if (best != _owner) {
+		_owner = -1;
+		bool clear = true;
+		for (size_t i = 0; i < n && clear; i++) {
+			if ((int)i != best && _masters[i].cpu && on_bus(_masters[i])) clear = false;
+		}
+		if (clear && best >= 0) {
+			_owner = best;
+			_owned_since = _now;
+			_stats.handovers++;
+		}
+		else if (best >= 0) _rearbitrate = true; // check again on the next half-cycle
+	}
+	for (size_t i = 0; i < n; i++) _masters[i].busreq = ((int)i != _owner);
+}
+
+uint64_t z80_bus_scheduler::window(uint64_t end) const {
+	if (_rearbitrate) return _now + 1; // handover in progress
+	uint64_t until = end;
+	for (auto& m : _masters) {
+		if (m.request_time < until) until = m.request_time;
+	}
+	if (_timeslice && _owner >= 0) {
+		for (size_t i = 0; i < _masters.size(); i++) {
+			if ((int)i != _owner && _masters[i].request && _masters[i].priority == _masters[_owner].priority) { // someone's waiting for their turn
+				if (_owned_since + _timeslice < until) until = _owned_since + _timeslice;
+				break;
+			}
+		}
+	}
+	return (until > _now) ? until : _now + 1;
+}
+
+void z80_bus_scheduler::clock_cpu(master_t& m) {
+	z80_pins_t pins = m.cpu->clock((m.inputs & Z80_SCHED_INPUTS) | ((m.busreq) ? 0 : Z80_BUSREQ) | ((z80_pinbits_t)m.data << Z80_PIN_D_BASE));
+	z80_pinbits_t ctl = ~pins.state & pins.dir & Z80_SCHED_CTL;
+	z80_pinbits_t start = ctl & ~m.ctl; // signals asserted on this half-cycle
+	m.ctl = ctl;
+
+	if (start) {
+		uint16_t addr = (uint16_t)((pins.state & Z80_A_ALL) >> Z80_PIN_A_BASE);
+		uint8_t out = (uint8_t)((pins.state & Z80_D_ALL) >> Z80_PIN_D_BASE);
+		if (ctl & Z80_MREQ) {
+			if (_mem) {
+				if (start & Z80_RD) m.data = _mem->read(addr);
+				else if (start & Z80_WR) _mem->write(addr, out);
+			}
+			else if (start & Z80_RD) m.data = _bus.mem_read(_bus.ctx, addr);
+			else if (start & Z80_WR) _bus.mem_write(_bus.ctx, addr, out);
+		}
+		else if (ctl & Z80_IORQ) {
+			if ((ctl & Z80_M1) && (start & Z80_IORQ)) m.data = (_bus.intack) ? _bus.intack(_bus.ctx) : 0xFF; // interrupt acknowledgment
+			else if (start & Z80_RD) m.data = _bus.io_read(_bus.ctx, addr);
+			else if (start & Z80_WR) _bus.io_write(_bus.ctx, addr, out);
+		}
+	}
+	if (!(ctl & (Z80_RD | Z80_IORQ))) m.data = 0xFF; // nothing is driving the data bus
+}
+
+uint64_t z80_bus_scheduler::run(uint64_t half_cycles) {
+	uint64_t end = _now + half_cycles;
+	while (_now < end) {
+		arbitrate();
+		uint64_t until = window(end);
+
+		/* CPUs off the bus for good can be skipped through - the rest (the owner, CPUs finishing their machine cycle or coming out of reset) are clocked half-cycle by half-cycle */
+		_active.clear();
+		for (size_t i = 0; i < _masters.size(); i++) {
+			master_t& m = _masters[i];
+			if (!m.cpu) continue;
+			m.active = !off_bus(m);
+			if (m.active) _active.push_back(&m);
+		}
+
+		uint64_t start = _now; // _now is kept current for the callbacks
+		if (_owner >= 0 && !_masters[_owner].cpu) {
+			/* device owning the bus - let it run its transfers in one go */
+			master_t& dev = _masters[_owner];
+			uint64_t max = until - _now;
+			uint64_t n = dev.dev.run(dev.dev.ctx, _bus, max);
+			if (n >= max) n = max;
+			else {
+				dev.request = false; // done (if it gave the bus back straight away, no time passes and the next owner takes over)
+				_rearbitrate = true;
+			}
+			for (uint64_t j = 0; j < n; j++) {
+				for (auto m : _active) clock_cpu(*m);
+				_now++;
+			}
+		}
+		else if (_active.empty()) _now = until; // nobody on the bus
+		else {
+			bool settle = _active.size() > 1 || _owner < 0; // CPUs other than the owner are to be skipped through once they're off the bus
+			do {
+				for (auto m : _active) clock_cpu(*m);
+				_now++;
+				if (settle) {
+					int driving = 0;
+					for (auto m : _active) {
+						driving += on_bus(*m);
+						if ((m - &_masters[0]) != _owner && off_bus(*m)) _rearbitrate = true; // start a new window without it
+					}
+					if (driving > 1) _stats.conflicts++;
+				}
+			} while (_now < until && !_rearbitrate);
+		}
+
+		uint64_t n = _now - start;
+		for (auto& m : _masters) {
+			if (!m.cpu || m.active) continue;
+			m.cpu->skip_released((size_t)n, (m.inputs & Z80_SCHED_INPUTS) | Z80_D_ALL); // BUSREQ held low
+			m.ctl = 0;
+			_stats.skipped += n;
+		}
+		_stats.half_cycles += n;
+	}
+	return half_cycles;
+}
\ No newline at end of file
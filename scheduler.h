@@ -0,0 +1,86 @@
+#pragma once
+
+#include "z80emu.h"
+#include "memmap.h"
+
+#include <vector>
+
+namespace llz80emu {
+	/* non-CPU bus master (e.g. a DMA controller) */
+	typedef uint64_t (*z80_bus_device_run_t)(void* ctx, const z80_bus_t& bus, uint64_t half_cycles); // the device has been granted the bus: make its transfers through bus for up to the specified number of half-cycles, and return the number taken (returning fewer hands the bus back and withdraws the device's request)
+
+	typedef struct {
+		void* ctx; // opaque pointer passed to run
+		z80_bus_device_run_t run;
+	} z80_bus_device_t;
+
+	typedef struct {
+		uint64_t half_cycles; // half-cycles run
+		uint64_t handovers; // number of times the bus changed hands
+		uint64_t skipped; // CPU half-cycles skipped in bulk (summed over CPUs that were off the bus)
+		uint64_t conflicts; // half-cycles on which more than one CPU drove the bus (e.g. a CPU coming out of reset while another master owns the bus)
+	} z80_bus_sched_stats_t;
+
+	/*
+	 * System-level scheduler clocking several pin-level z80emu instances and non-CPU bus masters sharing one bus (the host's z80_bus_t
+	 * callbacks) in lockstep. Bus ownership goes to the requesting master with the highest priority (ties going to the current owner, or
+	 * rotating every time slice if one is set), and is handed over through the CPUs' own BUSREQ/BUSACK handling: every CPU but the owner
+	 * has BUSREQ held low, and the next master only gets the bus once the others have released it. The owning CPU is clocked half-cycle by
+	 * half-cycle with its bus cycles serviced through the callbacks, devices run in bulk, and CPUs that are off the bus (released or held in
+	 * reset) are skipped through in one go.
+	 * All CPUs must share the same clock phase. Time is counted in half-cycles from the scheduler's creation.
+	 */
+	class z80_bus_scheduler {
+	public:
+		LLZ80EMU_API z80_bus_scheduler(const z80_bus_t& bus);
+
+		LLZ80EMU_API size_t add_cpu(z80emu& cpu, int priority = 0); // add a CPU (requesting the bus) and return its master index - the CPU is not reset
+		LLZ80EMU_API size_t add_device(const z80_bus_device_t& dev, int priority = 1); // add a non-CPU bus master (not requesting the bus) and return its master index
+
+		LLZ80EMU_API void request(size_t master, bool state); // assert or withdraw a master's bus request (can be called from bus callbacks and device run functions)
+		LLZ80EMU_API void request_at(size_t master, uint64_t time); // assert a master's bus request once the specified time is reached
+		LLZ80EMU_API void set_inputs(size_t master, z80_pinbits_t state); // set a CPU's INT, WAIT and RESET pin levels (all inactive by default - BUSREQ and the data bus are driven by the scheduler)
+		LLZ80EMU_API void set_timeslice(uint64_t half_cycles); // rotate the bus among requesting masters of equal priority every specified number of half-cycles (0 = never, the default)
+		LLZ80EMU_API void set_memory_map(z80_memory_map* map); // have the CPUs' memory accesses go through map instead of the mem_read/mem_write callbacks (nullptr = use the callbacks, the default) - devices are still given the bus callbacks
+
+		LLZ80EMU_API uint64_t run(uint64_t half_cycles); // run the system for the specified number of half-cycles, and return the number run
+
+		LLZ80EMU_API uint64_t now() const; // number of half-cycles run (kept current during bus callbacks - device run functions see the time their run started)
+		LLZ80EMU_API int owner() const; // index of the master owning the bus (-1 if none)
+		LLZ80EMU_API z80_bus_sched_stats_t get_stats() const; // get scheduling statistics
+	private:
+		typedef struct {
+			z80emu* cpu; // null for devices
+			z80_bus_device_t dev;
+			int priority;
+			bool request; // whether the master wants the bus
+			uint64_t request_time; // time at which to assert the request (UINT64_MAX = none)
+
+			/* CPU bus state */
+			z80_pinbits_t inputs; // INT/WAIT/RESET levels set by the host
+			bool busreq; // whether BUSREQ is held low
+			z80_pinbits_t ctl; // active bus control signals following the last half-cycle (for catching the start of accesses)
+			uint8_t data; // value driven onto the data bus (0xFF = floating)
+			bool active; // whether the CPU is in _active
+		} master_t;
+		std::vector<master_t> _masters;
+		z80_bus_t _bus;
+		z80_memory_map* _mem = nullptr;
+
+		uint64_t _now = 0;
+		int _owner = -1; // master owning the bus
+		uint64_t _owned_since = 0; // time at which _owner got the bus
+		uint64_t _timeslice = 0;
+		bool _rearbitrate = false; // set when requests or inputs change mid-window
+
+		std::vector<master_t*> _active; // CPUs clocked half-cycle by half-cycle in the current window
+
+		z80_bus_sched_stats_t _stats = {};
+
+		void arbitrate(); // take in timed requests, pick the next owner and hand the bus over once everyone else is off it
+		uint64_t window(uint64_t end) const; // return the time until which the current arrangement can be run without rearbitration
+		bool on_bus(const master_t& m) const; // return whether a CPU is driving the bus
+		bool off_bus(const master_t& m) const; // return whether a CPU will stay off the bus for the time being (so that it can be skipped through)
+		void clock_cpu(master_t& m); // clock a CPU by one half-cycle, servicing its bus accesses
+	};
+}
@@ -0,0 +1,184 @@
+#include "z80emu.h"
+#include "state.h"
+#include <string.h>
+#include <assert.h>
+
+using namespace llz80emu;
+
+namespace {
+	/* section sizes as written by save_state() (and checked against the stream position at the end of each section) */
+	constexpr size_t STATE_HEADER_END = 4 + 2 + 2; // signature, version, size
+	constexpr size_t STATE_REGS_END = STATE_HEADER_END + 14 * 2 + 1 + 2 + 1 + 3; // register pairs, Q, MEMPTR, instruction register, IFF1/IFF2/interrupt mode
+	constexpr size_t STATE_PINS_END = STATE_REGS_END + 8 + 8 + 2 + 4 + 8; // pin states and directions, flags, reset cycle count, INT timer
+	constexpr size_t STATE_CYCLE_END = STATE_PINS_END + 1 + 4 + 1 + 2 + 1 + 4 + 1; // type, T cycle, flags, address, value, cycle count, read target
+	constexpr size_t STATE_DECODER_END = STATE_CYCLE_END + 1 + 4 + 1 + 1 + 1 + 2 + 1 + 3 + 4; // flags, step, subset/prefix, displacement, (HL) pointer, DDCB/FDCB opcode, x/y/z, decoded instruction and micro-op PC
+	constexpr size_t STATE_COUNTERS_END = STATE_DECODER_END + (2 + Z80_CYCLE_TYPES + 5) * 8; // half-cycles, T cycles, machine cycles per type, instructions, wait states, bus release cycles, INTs and NMIs
+	static_assert(STATE_COUNTERS_END == Z80_STATE_SIZE, "Z80_STATE_SIZE doesn't match the snapshot layout (bump Z80_STATE_VERSION along with it)");
+
+	/* little-endian byte stream writer/reader */
+	class state_writer {
+	public:
+		inline state_writer(uint8_t* p) : _p(p), _start(p) {}
+		inline void u8(uint8_t v) { *_p++ = v; }
+		inline void u16(uint16_t v) { u8((uint8_t)v); u8((uint8_t)(v >> 8)); }
+		inline void u32(uint32_t v) { u16((uint16_t)v); u16((uint16_t)(v >> 16)); }
+		inline void u64(uint64_t v) { u32((uint32_t)v); u32((uint32_t)(v >> 32)); }
+		inline size_t pos() const { return (size_t)(_p - _start); }
+	private:
+		uint8_t* _p;
+		const uint8_t* _start;
+	};
+
+	class state_reader {
+	public:
+		inline state_reader(const uint8_t* p) : _p(p), _start(p) {}
+		inline uint8_t u8() { return *_p++; }
+		inline uint16_t u16() { uint16_t v = u8(); return v | ((uint16_t)u8() << 8); }
+		inline uint32_t u32() { uint32_t v = u16(); return v | ((uint32_t)u16() << 16); }
+		inline uint64_t u64() { uint64_t v = u32(); return v | ((uint64_t)u32() << 32); }
+		inline size_t pos() const { return (size_t)(_p - _start); }
+	private:
+		const uint8_t* _p;
+		const uint8_t* _start;
+	};
+}
+
+size_t z80emu::save_state(void* buf, size_t size) const {
+	if (size < Z80_STATE_SIZE) return 0;
+	state_writer w((uint8_t*)buf);
+
+	/* header */
+	w.u8('L'); w.u8('Z'); w.u8('8'); w.u8('0');
+	w.u16(Z80_STATE_VERSION); w.u16(Z80_STATE_SIZE);
+	assert(w.pos() == STATE_HEADER_END);
+
+	/* registers */
+	const z80_regpair_t* pairs[] = { &_regs.AF, &_regs.BC, &_regs.DE, &_regs.HL, &_regs.AF_s, &_regs.BC_s, &_regs.DE_s, &_regs.HL_s, &_regs.IX, &_regs.IY, &_regs.SP, &_regs.PC, &_regs.IR, &_regs.WZ };
+	for (const z80_regpair_t* pair : pairs) w.u16(pair->word);
+	w.u8(_regs.Q); w.u16(_regs.MEMPTR); w.u8(_regs.instr);
+	w.u8(_regs.iff1); w.u8(_regs.iff2); w.u8(_regs.int_mode);
+	assert(w.pos() == STATE_REGS_END);
+
+	/* pins, clock, reset and interrupts */
+	w.u64(_pins.state); w.u64(_pins.dir);
+	w.u16(_clkpin | (_por << 1) | (_intpin << 2) | (_int_skip << 3) | (_int_pending << 4) | (_nmiff << 5) | (_nmi_skip << 6) | (_nmi_pending << 7) | (_reset_m1t2 << 8));
+	w.u32((uint32_t)_reset_cycles); w.u64(_int_timer);
+	assert(w.pos() == STATE_PINS_END);
+
+	/* machine cycle in progress */
+	z80_cycle_state_t cycle = {};
+	if (_cycle) {
+		switch (_cycle->type) {
+		case Z80_FETCH_CYCLE: _fetch_cycle.get_state(cycle); break;
+		case Z80_MEM_READ_CYCLE: _mem_read_cycle.get_state(cycle); break;
+		case Z80_MEM_WRITE_CYCLE: _mem_write_cycle.get_state(cycle); break;
+		case Z80_IO_READ_CYCLE: _io_read_cycle.get_state(cycle); break;
+		case Z80_IO_WRITE_CYCLE: _io_write_cycle.get_state(cycle); break;
+		case Z80_BOGUS_CYCLE: _bogus_cycle.get_state(cycle); break;
+		case Z80_INTACK_CYCLE: _intack_cycle.get_state(cycle); break;
+		default: break;
+		}
+	}
+	w.u8((_cycle) ? (uint8_t)_cycle->type : Z80_STATE_NO_CYCLE);
+	w.u32((uint32_t)cycle.t); w.u8(cycle.bus_release | (cycle.wait << 1) | (cycle.halt << 2));
+	w.u16(cycle.addr); w.u8(cycle.val); w.u32((uint32_t)cycle.cycles);
+	w.u8((cycle.val_out) ? _instr.target_id(cycle.val_out) : (uint8_t)Z80_STATE_TARGET_INVALID);
+	assert(w.pos() == STATE_CYCLE_END);
+
+	/* instruction decoder */
+	z80_instr_decoder::state_t dec;
+	_instr.get_state(dec);
+	w.u8(dec.started | (dec.mod_d_ready << 1) | (dec.hlptr_ready << 2) | (dec.mod_cb_fetched << 3) | (dec.decoded << 4));
+	w.u32((uint32_t)dec.step); w.u8(dec.subset); w.u8(dec.mod);
+	w.u8((uint8_t)dec.mod_d); w.u16(dec.hl_ptr); w.u8(dec.mod_cb_instr);
+	w.u8(dec.x); w.u8(dec.y); w.u8(dec.z);
+	w.u8(dec.dec_subset); w.u8(dec.dec_mod); w.u8(dec.dec_instr); w.u8(dec.uop_pc);
+	assert(w.pos() == STATE_DECODER_END);
+
+	/* performance counters */
+	w.u64(_counters.half_cycles); w.u64(_counters.tstates);
+	for (int i = 0; i < Z80_CYCLE_TYPES; i++) w.u64(_counters.mcycles[i]);
+	w.u64(_counters.instructions); w.u64(_counters.wait_states); w.u64(_counters.busrel_cycles); w.u64(_counters.ints); w.u64(_counters.nmis);
+	assert(w.pos() == STATE_COUNTERS_END);
+
+	return Z80_STATE_SIZE;
+}
+
+bool z80emu::load_state(const void* buf, size_t size) {
+	if (size < Z80_STATE_SIZE) return false;
+	state_reader r((const uint8_t*)buf);
+
+	/* header */
+	if (r.u8() != 'L' || r.u8() != 'Z' || r.u8() != '8' || r.u8() != '0') return false;
+	if (r.u16() != Z80_STATE_VERSION || r.u16() != Z80_STATE_SIZE) return false;
+	assert(r.pos() == STATE_HEADER_END);
+
+	/* everything is read into temporaries and checked first, so that nothing changes if the snapshot turns out to be invalid */
+	z80_registers_t regs;
+	memset(&regs, 0, sizeof(regs));
+	z80_regpair_t* pairs[] = { &regs.AF, &regs.BC, &regs.DE, &regs.HL, &regs.AF_s, &regs.BC_s, &regs.DE_s, &regs.HL_s, &regs.IX, &regs.IY, &regs.SP, &regs.PC, &regs.IR, &regs.WZ };
+	for (z80_regpair_t* pair : pairs) pair->word = r.u16();
+	regs.Q = r.u8(); regs.MEMPTR = r.u16(); regs.instr = r.u8();
+	regs.iff1 = r.u8(); regs.iff2 = r.u8(); regs.int_mode = r.u8();
+	assert(r.pos() == STATE_REGS_END);
+
+	z80_pins_t pins;
+	pins.state = r.u64(); pins.dir = r.u64();
+	uint16_t flags = r.u16();
+	int reset_cycles = (int)r.u32(); uint64_t int_timer = r.u64();
+	assert(r.pos() == STATE_PINS_END);
+	bool nmi_pending = (flags >> 7) & 1, int_pending = (flags >> 4) & 1;
+
+	uint8_t type = r.u8();
+	z80_cycle_state_t cycle = {};
+	cycle.t = (int)r.u32();
+	uint8_t cflags = r.u8();
+	cycle.bus_release = cflags & 1; cycle.wait = (cflags >> 1) & 1; cycle.halt = (cflags >> 2) & 1;
+	cycle.addr = r.u16(); cycle.val = r.u8(); cycle.cycles = (int)r.u32();
+	uint8_t target = r.u8();
+	assert(r.pos() == STATE_CYCLE_END);
+	if (type >= Z80_CYCLE_TYPES && type != Z80_STATE_NO_CYCLE) return false;
+	if (type == Z80_MEM_READ_CYCLE || type == Z80_IO_READ_CYCLE || type == Z80_INTACK_CYCLE) {
+		cycle.val_out = _instr.target_ptr(target);
+		if (!cycle.val_out) return false; // reading into nowhere
+	}
+
+	z80_instr_decoder::state_t dec;
+	uint8_t dflags = r.u8();
+	dec.started = dflags & 1; dec.mod_d_ready = (dflags >> 1) & 1; dec.hlptr_ready = (dflags >> 2) & 1; dec.mod_cb_fetched = (dflags >> 3) & 1; dec.decoded = (dflags >> 4) & 1;
+	dec.step = (int)r.u32(); dec.subset = r.u8(); dec.mod = r.u8();
+	dec.mod_d = (int8_t)r.u8(); dec.hl_ptr = r.u16(); dec.mod_cb_instr = r.u8();
+	dec.x = r.u8(); dec.y = r.u8(); dec.z = r.u8();
+	dec.dec_subset = r.u8(); dec.dec_mod = r.u8(); dec.dec_instr = r.u8(); dec.uop_pc = r.u8();
+	assert(r.pos() == STATE_DECODER_END);
+	if (!_instr.set_state(dec, nmi_pending, int_pending)) return false; // last check (this applies the decoder's state if it passes)
+
+	/* apply the rest */
+	_regs = regs;
+	_pins = pins;
+	_clkpin = flags & 1; _por = (flags >> 1) & 1; _intpin = (flags >> 2) & 1; _int_skip = (flags >> 3) & 1; _int_pending = int_pending;
+	_nmiff = (flags >> 5) & 1; _nmi_skip = (flags >> 6) & 1; _nmi_pending = nmi_pending; _reset_m1t2 = (flags >> 8) & 1;
+	_reset_cycles = reset_cycles; _int_timer = int_timer;
+
+	switch (type) {
+	case Z80_FETCH_CYCLE: _fetch_cycle.set_state(cycle); _cycle = &_fetch_cycle; break;
+	case Z80_MEM_READ_CYCLE: _mem_read_cycle.set_state(cycle); _cycle = &_mem_read_cycle; break;
+	case Z80_MEM_WRITE_CYCLE: _mem_write_cycle.set_state(cycle); _cycle = &_mem_write_cycle; break;
+	case Z80_IO_READ_CYCLE: _io_read_cycle.set_state(cycle); _cycle = &_io_read_cycle; break;
+	case Z80_IO_WRITE_CYCLE: _io_write_cycle.set_state(cycle); _cycle = &_io_write_cycle; break;
+	case Z80_BOGUS_CYCLE: _bogus_cycle.set_state(cycle); _cycle = &_bogus_cycle; break;
+	case Z80_INTACK_CYCLE: _intack_cycle.set_state(cycle); _cycle = &_intack_cycle; break;
+	default: _cycle = nullptr; break;
+	}
+
+	_counters.half_cycles = r.u64(); _counters.tstates = r.u64();
+	for (int i = 0; i < Z80_CYCLE_TYPES; i++) _counters.mcycles[i] = r.u64();
+	_counters.instructions = r.u64(); _counters.wait_states = r.u64(); _counters.busrel_cycles = r.u64(); _counters.ints = r.u64(); _counters.nmis = r.u64();
+	assert(r.pos() == STATE_COUNTERS_END);
+
+	_opinfo_len = 0; _opinfo_skip = true; // the opcode metadata self-test has no record of the instruction in progress
+
+	/* memory may have been restored along with the snapshot */
+	invalidate_dcache(); invalidate_dynarec();
+	return true;
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace llz80emu {
+	/*
+	 * Emulator state snapshots (see z80emu::save_state()): a fixed-size little-endian byte stream starting with the "LZ80" signature, the format version and the snapshot size,
+	 * followed by the registers, pins, interrupt/reset state, the machine cycle in progress, the instruction decoder's state and the performance counters.
+	 * Locations that a read cycle in progress is reading into are stored as the target IDs below.
+	 */
+	#define Z80_STATE_VERSION					1 // format version (bumped on any layout change - older snapshots are rejected)
+	#define Z80_STATE_SIZE						217 // size of a snapshot in bytes
+
+	typedef enum {
+		Z80_STATE_TARGET_A,
+		Z80_STATE_TARGET_F,
+		Z80_STATE_TARGET_B,
+		Z80_STATE_TARGET_C,
+		Z80_STATE_TARGET_D,
+		Z80_STATE_TARGET_E,
+		Z80_STATE_TARGET_H,
+		Z80_STATE_TARGET_L,
+		Z80_STATE_TARGET_IXH,
+		Z80_STATE_TARGET_IXL,
+		Z80_STATE_TARGET_IYH,
+		Z80_STATE_TARGET_IYL,
+		Z80_STATE_TARGET_SPH,
+		Z80_STATE_TARGET_SPL,
+		Z80_STATE_TARGET_PCH,
+		Z80_STATE_TARGET_PCL,
+		Z80_STATE_TARGET_W,
+		Z80_STATE_TARGET_Z,
+		Z80_STATE_TARGET_INSTR, // instruction register
+		Z80_STATE_TARGET_MOD_D, // DD/FD displacement byte
+		Z80_STATE_TARGET_MOD_CB_INSTR, // opcode following DDCB/FDCB+d
+		Z80_STATE_TARGETS,
+		Z80_STATE_TARGET_INVALID = 0xFF // also used when there's no read in progress
+	} z80_state_target_t;
+
+	#define Z80_STATE_NO_CYCLE					0xFF // cycle type stored while in reset
+}
@@ -0,0 +1,227 @@
+/*
+ * Lockstep batch regression check (see batch.h).
+ * z80emu_batch runs register-only instructions in its own register file, with flags computed arithmetically instead of through the
+ * tables in flags.h. This steps every opcode the register file runs across all accumulator/flag values (and, for arithmetic/logic on
+ * another register, all operand values, with both carry inputs for ADC/SBC), comparing each lane's full snapshot and T cycles against a single
+ * z80emu's step_instruction(). It then runs random code (mostly register-only, some identical across lanes, some lanes with the decoded
+ * instruction cache enabled) with random NMI/INT activity through both, comparing snapshots, memory, bus accesses, pins and T cycles.
+ *
+ * usage: llz80emu_batch_check [seeds]
+ *   seeds	number of random programs to run (default: 16)
+ * The exit status is 0 if every check passed.
+ */
+
+#include "batch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory>
+
+using namespace llz80emu;
+
+#define CHECK_LANES							256 // lanes of the exhaustive check (one per accumulator value)
+#define CHECK_RANDOM_LANES					24 // lanes of the random runs
+#define CHECK_ROUNDS						200 // step()/run()/interrupt rounds of each random run
+
+static int check_fails = 0;
+static long check_steps = 0; // number of lane instructions compared
+
+static void check_fail(const char* what, const char* where, int lane) { // report a failure (only the first few are printed)
+	if (check_fails++ < 10) printf("%s, lane %d: %s\n", where, lane, what);
+}
+
+static uint32_t check_rnd(uint64_t& rng) {
+	rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+	return (uint32_t)rng;
+}
+
+/* memory and a hash of every bus access made */
+typedef struct {
+	uint8_t mem[0x10000];
+	uint64_t hash, accesses;
+} check_sys_t;
+
+static void check_mix(check_sys_t* sys, uint64_t v) {
+	sys->hash = (sys->hash ^ v) * 0x100000001B3ULL; sys->accesses++;
+}
+
+static uint8_t check_mem_read(void* ctx, uint16_t addr) {
+	check_sys_t* sys = (check_sys_t*)ctx;
+	check_mix(sys, addr);
+	return sys->mem[addr];
+}
+
+static void check_mem_write(void* ctx, uint16_t addr, uint8_t val) {
+	check_sys_t* sys = (check_sys_t*)ctx;
+	check_mix(sys, 0x10000 | addr | ((uint64_t)val << 17));
+	sys->mem[addr] = val;
+}
+
+static uint8_t check_io_read(void* ctx, uint16_t addr) {
+	check_mix((check_sys_t*)ctx, 0x3000000 | addr);
+	return (uint8_t)(addr * 7 + (addr >> 8));
+}
+
+static void check_io_write(void* ctx, uint16_t addr, uint8_t val) {
+	check_mix((check_sys_t*)ctx, 0x4000000 | addr | ((uint64_t)val << 17));
+}
+
+static uint8_t check_int_ack(void* ctx) {
+	check_mix((check_sys_t*)ctx, 0x5000000);
+	return 0xFF;
+}
+
+static z80_bus_t check_bus(check_sys_t& sys) {
+	z80_bus_t bus = { &sys, check_mem_read, check_mem_write, check_io_read, check_io_write, check_int_ack };
+	return bus;
+}
+
+static bool check_same_state(z80emu& a, z80emu& b) {
+	uint8_t sa[Z80_STATE_SIZE], sb[Z80_STATE_SIZE];
+	a.save_state(sa, sizeof(sa)); b.save_state(sb, sizeof(sb));
+	return !memcmp(sa, sb, sizeof(sa));
+}
+
+/* every register-file opcode over every A/F value */
+static void check_exhaustive() {
+	static z80emu_batch<CHECK_LANES> batch;
+	static std::unique_ptr<z80emu> ref[CHECK_LANES];
+	static check_sys_t sys; // (shared, since nothing is written)
+	for (int i = 0; i < CHECK_LANES; i++) {
+		ref[i].reset(new z80emu(false));
+		ref[i]->set_bus(check_bus(sys)); batch.lane(i).set_bus(check_bus(sys));
+		ref[i]->reset(); batch.lane(i).reset();
+	}
+
+	for (int op = 0; op < 0x100; op++) {
+		if (!z80emu_batch<CHECK_LANES>::lockstep_op((uint8_t)op)) continue;
+		sys.mem[0x100] = (uint8_t)op;
+		int y = (op >> 3) & 7, z = op & 7;
+		bool operand = ((op >> 6) == 2 && z != 7); // arithmetic/logic on a register other than A
+		int carry = (operand && (y == 1 || y == 3)); // ADC/SBC (the only ones with results depending on F)
+		for (int outer = 0; outer < (0x100 << carry); outer++) {
+			/* without an operand, the outer loop goes through F; with one, through the operand (and the carry input for ADC/SBC) */
+			uint8_t val = (uint8_t)(outer >> carry), f = (operand) ? (uint8_t)((val * 0x65 & 0xFE) | (outer & 1)) : (uint8_t)outer;
+			for (int i = 0; i < CHECK_LANES; i++) {
+				z80_registers_t r = ref[i]->get_regs();
+				r.REG_PC = 0x100; r.REG_A = (uint8_t)i; r.REG_F = f; r.Q = (uint8_t)(f * 37 + i);
+				r.REG_B = (uint8_t)(i * 91 + f); r.REG_C = (uint8_t)(f ^ i); r.REG_D = (uint8_t)(i + f); r.REG_E = (uint8_t)(i - f); r.REG_H = (uint8_t)(255 - i); r.REG_L = f; // (each covering every value across the lanes)
+				if (operand) {
+					uint8_t* regs[6] = { &r.REG_B, &r.REG_C, &r.REG_D, &r.REG_E, &r.REG_H, &r.REG_L };
+					*regs[z] = val;
+				}
+				ref[i]->set_regs(r); batch.lane(i).set_regs(r);
+			}
+
+			int tstates[CHECK_LANES];
+			char where[64];
+			snprintf(where, sizeof(where), "opcode %02X, F %02X, operand %02X", op, f, (operand) ? val : 0);
+			batch.step(tstates);
+			for (int i = 0; i < CHECK_LANES; i++) {
+				if (ref[i]->step_instruction() != tstates[i]) check_fail("T cycles differ", where, i);
+				else if (!check_same_state(*ref[i], batch.lane(i))) check_fail("state differs", where, i);
+				check_steps++;
+			}
+		}
+	}
+}
+
+static uint8_t check_lockstep_op(uint64_t& rng) { // random register-only opcode
+	for (;;) {
+		uint8_t op = (uint8_t)(check_rnd(rng) >> 24);
+		if (z80emu_batch<CHECK_LANES>::lockstep_op(op)) return op;
+	}
+}
+
+/* random code through the batch and individual instances */
+static void check_random(int seed) {
+	static check_sys_t sys_ref[CHECK_RANDOM_LANES], sys_batch[CHECK_RANDOM_LANES];
+	uint64_t rng = 0x9E3779B97F4A7C15ULL * (uint64_t)seed + 7;
+	bool same = (seed & 1); // run the same code on every lane
+	uint32_t dense = 50 + check_rnd(rng) % 50; // percentage of register-only opcodes
+
+	std::unique_ptr<z80emu_batch<CHECK_RANDOM_LANES>> batch(new z80emu_batch<CHECK_RANDOM_LANES>());
+	std::unique_ptr<z80emu> ref[CHECK_RANDOM_LANES];
+	for (int i = 0; i < CHECK_RANDOM_LANES; i++) {
+		if (!same || !i) {
+			for (int j = 0; j < 0x10000; j++) {
+				uint8_t op = (check_rnd(rng) % 100 < dense) ? check_lockstep_op(rng) : (uint8_t)(check_rnd(rng) >> 24);
+				if (op == 0x76 && check_rnd(rng) % 4) op = 0x00; // not too many HALTs
+				sys_ref[i].mem[j] = op;
+			}
+		}
+		else memcpy(sys_ref[i].mem, sys_ref[0].mem, sizeof(sys_ref[i].mem));
+		memcpy(sys_batch[i].mem, sys_ref[i].mem, sizeof(sys_batch[i].mem));
+		sys_ref[i].hash = sys_batch[i].hash = sys_ref[i].accesses = sys_batch[i].accesses = 0;
+
+		ref[i].reset(new z80emu(false));
+		z80emu& lane = batch->lane(i);
+		ref[i]->set_bus(check_bus(sys_ref[i])); lane.set_bus(check_bus(sys_batch[i]));
+		ref[i]->reset(); lane.reset();
+		if (i % 11 == 5) { ref[i]->set_dcache(true); lane.set_dcache(true); } // (running on its own)
+		z80_registers_t r = ref[i]->get_regs();
+		r.REG_AF = (uint16_t)check_rnd(rng); r.REG_BC = (uint16_t)check_rnd(rng); r.REG_DE = (uint16_t)check_rnd(rng); r.REG_HL = (uint16_t)check_rnd(rng);
+		r.REG_SP = (uint16_t)check_rnd(rng); r.REG_IR = (uint16_t)check_rnd(rng); r.REG_AF_S = (uint16_t)check_rnd(rng); r.REG_BC_S = (uint16_t)check_rnd(rng);
+		r.int_mode = (uint8_t)(check_rnd(rng) % 3); r.iff1 = r.iff2 = (check_rnd(rng) & 1); r.Q = (uint8_t)check_rnd(rng);
+		if (same) r.REG_PC = 0;
+		ref[i]->set_regs(r); lane.set_regs(r);
+	}
+
+	for (int round = 0; round < CHECK_ROUNDS; round++) {
+		char where[32];
+		snprintf(where, sizeof(where), "seed %d, round %d", seed, round);
+		uint32_t what = check_rnd(rng) % 4;
+		if (what < 2) {
+			int tstates[CHECK_RANDOM_LANES];
+			for (int n = check_rnd(rng) % 200; n > 0; n--) {
+				batch->step(tstates);
+				for (int i = 0; i < CHECK_RANDOM_LANES; i++, check_steps++) {
+					if (ref[i]->step_instruction() != tstates[i]) check_fail("step() T cycles differ", where, i);
+				}
+			}
+		}
+		else if (what == 2) {
+			uint64_t len = check_rnd(rng) % 3000, tstates[CHECK_RANDOM_LANES];
+			batch->run(len, tstates);
+			for (int i = 0; i < CHECK_RANDOM_LANES; i++) {
+				if (ref[i]->run(len) != tstates[i]) check_fail("run() T cycles differ", where, i);
+			}
+		}
+		else {
+			int i = check_rnd(rng) % CHECK_RANDOM_LANES;
+			switch (check_rnd(rng) % 3) {
+			case 0: ref[i]->trigger_nmi(); batch->lane(i).trigger_nmi(); break;
+			case 1: {
+				uint64_t t = 1 + check_rnd(rng) % 500;
+				ref[i]->schedule_int(t); batch->lane(i).schedule_int(t);
+				break;
+			}
+			default: {
+				bool level = (check_rnd(rng) & 1);
+				ref[i]->set_intpin(level); batch->lane(i).set_intpin(level);
+				break;
+			}
+			}
+		}
+
+		if (check_rnd(rng) % 5 == 0 || round == CHECK_ROUNDS - 1) {
+			for (int i = 0; i < CHECK_RANDOM_LANES; i++) {
+				z80emu& lane = batch->lane(i);
+				z80_pins_t pa = ref[i]->get_pins(), pb = lane.get_pins();
+				if (!check_same_state(*ref[i], lane)) check_fail("state differs", where, i);
+				else if (memcmp(sys_ref[i].mem, sys_batch[i].mem, sizeof(sys_ref[i].mem))) check_fail("memory differs", where, i);
+				else if (sys_ref[i].hash != sys_batch[i].hash || sys_ref[i].accesses != sys_batch[i].accesses) check_fail("bus accesses differ", where, i);
+				else if (pa.state != pb.state || pa.dir != pb.dir) check_fail("pins differ", where, i);
+			}
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	int seeds = (argc > 1) ? atoi(argv[1]) : 16;
+	check_exhaustive();
+	for (int seed = 1; seed <= seeds; seed++) check_random(seed);
+	printf("%d failures, %ld instructions\n", check_fails, check_steps);
+	return check_fails != 0;
+}
\ No newline at end of file
@@ -0,0 +1,125 @@
+/*
+ * Pin-level clocking throughput benchmark.
+ * Runs a load/ALU/stack loop out of 64K of plain RAM through clock() (one call per half-cycle), clock_n() (one handler call per active
+ * half-cycle) and run() (instruction-level, for reference), and prints the best rate of each over a number of repeats. Only API
+ * that predates the cycle dispatch rework is used, so the same file can be built against an older checkout for before/after figures.
+ *
+ * usage: llz80emu_bench_clock [-n half-cycles] [-r repeats]
+ *   -n half-cycles	number of half-cycles clocked per measurement (default: 20000000)
+ *   -r repeats		number of measurements taken of each method, of which the fastest is reported (default: 9)
+ */
+
+#include "z80emu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+using namespace llz80emu;
+
+/* LD SP,F000h / LD HL,8000h / LD DE,9000h / LD BC,0400h, then 1024 times: LD A,(HL) / ADD A,(HL) / XOR E / LD (DE),A / RL A / INC HL / INC DE / LD IX,1234h / LD A,(IX+5) / PUSH HL / POP HL / DEC BC / LD A,B / OR C / JR NZ, and start over */
+static const uint8_t bench_prog[] = {
+	0x31, 0x00, 0xF0, 0x21, 0x00, 0x80, 0x11, 0x00, 0x90, 0x01, 0x00, 0x04,
+	0x7E, 0x86, 0xAB, 0x12, 0xCB, 0x17, 0x23, 0x13, 0xDD, 0x21, 0x34, 0x12, 0xDD, 0x7E, 0x05, 0xE5, 0xE1, 0x0B, 0x78, 0xB1, 0x20, 0xEC,
+	0xC3, 0x00, 0x00
+};
+
+static uint8_t bench_mem[0x10000];
+
+#define BENCH_IDLE_PINS						(Z80_RESET | Z80_WAIT | Z80_BUSREQ | Z80_INT) // input pins with nothing asserted
+
+/* serve a memory access (I/O reads get a floating data bus) and return the input pin state */
+static inline z80_pinbits_t bench_bus(const z80_pins_t& pins) {
+	z80_pinbits_t state = BENCH_IDLE_PINS | Z80_D_ALL;
+	z80_pinbits_t active = ~pins.state & pins.dir; // outputs driven low
+	if (active & Z80_MREQ) {
+		uint16_t addr = (uint16_t)(pins.state & Z80_A_ALL);
+		if (active & Z80_RD) state = BENCH_IDLE_PINS | ((z80_pinbits_t)bench_mem[addr] << Z80_PIN_D_BASE);
+		else if (active & Z80_WR) bench_mem[addr] = (uint8_t)(pins.state >> Z80_PIN_D_BASE);
+	}
+	return state;
+}
+
+static bool bench_handler(void*, const z80_pins_t& pins, z80_pinbits_t& state) {
+	state = bench_bus(pins);
+	return true;
+}
+
+static uint8_t bench_mem_read(void*, uint16_t addr) { return bench_mem[addr]; }
+static void bench_mem_write(void*, uint16_t addr, uint8_t val) { bench_mem[addr] = val; }
+static uint8_t bench_io_read(void*, uint16_t) { return 0xFF; }
+static void bench_io_write(void*, uint16_t, uint8_t) {}
+
+static void bench_load() {
+	memset(bench_mem, 0, sizeof(bench_mem));
+	memcpy(bench_mem, bench_prog, sizeof(bench_prog));
+}
+
+static double bench_now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* pin-level emulation through clock() - returns the time taken to run count half-cycles after reset */
+static double bench_clock(size_t count) {
+	bench_load();
+	z80emu cpu(false);
+	for (int i = 0; i < 8; i++) cpu.clock(BENCH_IDLE_PINS & ~Z80_RESET); // hold RESET for 4 T cycles
+	z80_pins_t pins = cpu.clock(BENCH_IDLE_PINS);
+	double start = bench_now();
+	for (size_t i = 0; i < count; i++) pins = cpu.clock(bench_bus(pins));
+	return bench_now() - start;
+}
+
+/* pin-level emulation through clock_n() */
+static double bench_clock_n(size_t count) {
+	bench_load();
+	z80emu cpu(false);
+	z80_pinbits_t state = BENCH_IDLE_PINS & ~Z80_RESET;
+	cpu.clock_n(8, state, bench_handler, nullptr);
+	state = BENCH_IDLE_PINS;
+	double start = bench_now();
+	for (size_t done = 0; done < count; ) done += cpu.clock_n(count - done, state, bench_handler, nullptr);
+	return bench_now() - start;
+}
+
+/* instruction-level emulation through run() (count half-cycles = count / 2 T cycles) */
+static double bench_run(size_t count) {
+	bench_load();
+	z80emu cpu(false);
+	cpu.reset();
+	z80_bus_t bus = { nullptr, bench_mem_read, bench_mem_write, bench_io_read, bench_io_write, nullptr };
+	cpu.set_bus(bus);
+	double start = bench_now();
+	cpu.run(count / 2);
+	return bench_now() - start;
+}
+
+int main(int argc, char** argv) {
+	size_t count = 20000000;
+	int repeats = 9;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-n") && i + 1 < argc) count = strtoull(argv[++i], nullptr, 0);
+		else if (!strcmp(argv[i], "-r") && i + 1 < argc) repeats = atoi(argv[++i]);
+		else {
+			fprintf(stderr, "usage: %s [-n half-cycles] [-r repeats]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (!count || repeats < 1) {
+		fprintf(stderr, "%s: nothing to measure\n", argv[0]);
+		return 1;
+	}
+
+	double best[3] = { 1e30, 1e30, 1e30 };
+	for (int r = 0; r < repeats; r++) { // interleaved, so that frequency scaling and other noise hit all methods alike
+		double t = bench_clock(count); if (t < best[0]) best[0] = t;
+		t = bench_clock_n(count); if (t < best[1]) best[1] = t;
+		t = bench_run(count); if (t < best[2]) best[2] = t;
+	}
+
+	printf("clock():   %8.2f M half-cycles/s\n", count / best[0] / 1e6);
+	printf("clock_n(): %8.2f M half-cycles/s\n", count / best[1] / 1e6);
+	printf("run():     %8.2f M T cycles/s\n", count / 2 / best[2] / 1e6);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,183 @@
+/*
+ * Rewind buffer regression check (see rewind.h).
+ * Runs random code (with LDIR/LDDR sprinkled in for larger memory deltas) and random WAIT/INT/BUSREQ/NMI activity through a reference
+ * instance, sampling its state, RAM, host state and input pins at random times and at keyframe boundaries. The same program is then run
+ * through a rewind buffer with a random keyframe interval, ring size and delta budget, seeking back to sampled times along the way and
+ * comparing against the samples on arrival. Seeks outside the window are checked to be refused, and the buffer to stay within its budget.
+ *
+ * usage: llz80emu_rewind_check [seeds]
+ *   seeds	number of random programs to run (default: 64)
+ * The exit status is 0 if every check passed.
+ */
+
+#include "rewind.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+using namespace llz80emu;
+
+#define CHECK_HALF_CYCLES					200000 // length of each run
+#define CHECK_SAMPLES						60 // number of random times sampled in each run
+#define CHECK_IDLE_PINS						(Z80_RESET | Z80_WAIT | Z80_BUSREQ | Z80_INT) // input pins with nothing asserted
+
+static int check_fails = 0;
+static long check_seeks = 0; // number of seeks checked
+
+static void check_fail(const char* what, int seed, uint64_t time) { // report a failure (only the first few are printed)
+	if (check_fails++ < 10) printf("seed %d, time %llu: %s\n", seed, (unsigned long long)time, what);
+}
+
+/* host state other than RAM (stored with each keyframe) */
+typedef struct {
+	uint64_t rng;
+	int int_len, wait_len, busreq_len; // remaining half-cycles of INT/WAIT/BUSREQ assertion
+} check_world_t;
+
+static uint32_t check_rnd(uint64_t& rng) {
+	rng ^= rng << 13; rng ^= rng >> 7; rng ^= rng << 17;
+	return (uint32_t)rng;
+}
+
+typedef struct {
+	check_world_t world;
+	z80emu* cpu;
+	uint8_t* mem;
+} check_host_t;
+
+static bool check_handler(void* ctx, const z80_pins_t& pins, z80_pinbits_t& state) {
+	check_host_t& host = *(check_host_t*)ctx;
+	check_world_t& w = host.world;
+	z80_pinbits_t active = ~pins.state & pins.dir; // outputs driven low (lines off the bus are inputs)
+	uint16_t addr = (uint16_t)(pins.state & Z80_A_ALL);
+	uint8_t data = 0xFF;
+	if ((active & Z80_MREQ) && (active & Z80_RD)) data = host.mem[addr];
+	else if ((active & Z80_MREQ) && (active & Z80_WR)) host.mem[addr] = (uint8_t)(pins.state >> Z80_PIN_D_BASE);
+	else if ((active & Z80_IORQ) && (active & Z80_M1)) data = (uint8_t)(check_rnd(w.rng) & 0xFE);
+	else if ((active & Z80_IORQ) && (active & Z80_RD)) data = (uint8_t)(addr * 7);
+	state = CHECK_IDLE_PINS | ((z80_pinbits_t)data << Z80_PIN_D_BASE);
+
+	if (w.int_len > 0) { state &= ~Z80_INT; w.int_len--; }
+	else if (!(check_rnd(w.rng) % 2000)) w.int_len = 30;
+	if (w.wait_len > 0) { state &= ~Z80_WAIT; w.wait_len--; }
+	else if (!(check_rnd(w.rng) % 300)) w.wait_len = 1 + check_rnd(w.rng) % 6;
+	if (w.busreq_len > 0) { state &= ~Z80_BUSREQ; w.busreq_len--; }
+	else if (!(check_rnd(w.rng) % 3000)) w.busreq_len = 2 + check_rnd(w.rng) % 20;
+	if (!(check_rnd(w.rng) % 15000)) host.cpu->trigger_nmi();
+	return true;
+}
+
+static void check_host_save(void* ctx, void* buf) { memcpy(buf, &((check_host_t*)ctx)->world, sizeof(check_world_t)); }
+static void check_host_load(void* ctx, const void* buf) { memcpy(&((check_host_t*)ctx)->world, buf, sizeof(check_world_t)); }
+
+/* everything there is to compare at a point in time */
+typedef struct {
+	uint64_t time;
+	uint8_t snapshot[Z80_STATE_SIZE];
+	std::vector<uint8_t> mem;
+	check_world_t world;
+	z80_pinbits_t state;
+} check_sample_t;
+
+static void check_init(uint8_t* mem, int seed) {
+	uint64_t rng = 0x9E3779B97F4A7C15ULL * seed;
+	for (int i = 0; i < 0x10000; i++) {
+		mem[i] = (uint8_t)check_rnd(rng);
+		if (mem[i] == 0x76) mem[i] = 0; // no HALT (which would stall the program for long stretches)
+	}
+	for (int i = 0; i < 32; i++) { // LDIR/LDDR
+		uint16_t addr = (uint16_t)(check_rnd(rng) % 0xFFF0);
+		mem[addr] = 0xED; mem[addr + 1] = (check_rnd(rng) & 1) ? 0xB0 : 0xB8;
+	}
+}
+
+/* power on, and hold RESET for 2 T cycles (outside the rewind buffer's time) */
+static void check_reset(z80emu& cpu, check_host_t& host, z80_pinbits_t& state) {
+	state = CHECK_IDLE_PINS & ~Z80_RESET;
+	cpu.clock_n(4, state, check_handler, &host);
+	state = CHECK_IDLE_PINS;
+}
+
+static bool check_same(z80emu& cpu, const check_host_t& host, z80_pinbits_t state, const check_sample_t& sample) {
+	uint8_t snapshot[Z80_STATE_SIZE];
+	cpu.save_state(snapshot, sizeof(snapshot));
+	return !memcmp(snapshot, sample.snapshot, sizeof(snapshot)) && !memcmp(host.mem, sample.mem.data(), 0x10000)
+		&& !memcmp(&host.world, &sample.world, sizeof(check_world_t)) && state == sample.state;
+}
+
+static uint8_t mem_ref[0x10000], mem_rw[0x10000];
+
+static void check_seed(int seed) {
+	uint64_t rng = 0x1234567ULL * seed + 1;
+	uint64_t interval = 50 + check_rnd(rng) % 2000; // short, so that keyframes often fall in the middle of write cycles
+	size_t keyframes = 4 + check_rnd(rng) % 60;
+	size_t delta_size = (seed % 3) ? (size_t)(16 << 20) : (size_t)(check_rnd(rng) % 40000); // every third run is short of delta space
+
+	/* reference run, sampled at random times and keyframe boundaries */
+	check_init(mem_ref, seed);
+	z80emu ref(false);
+	check_host_t host_ref = { { 777ULL * seed + 3, 0, 0, 0 }, &ref, mem_ref };
+	z80_pinbits_t state_ref;
+	check_reset(ref, host_ref, state_ref);
+	uint8_t start[Z80_STATE_SIZE];
+	ref.save_state(start, sizeof(start)); // for registers that reset leaves alone
+
+	std::vector<uint64_t> times = { 0, CHECK_HALF_CYCLES };
+	for (int i = 0; i < CHECK_SAMPLES; i++) times.push_back(check_rnd(rng) % CHECK_HALF_CYCLES);
+	for (uint64_t t = interval * 2; t <= CHECK_HALF_CYCLES; t += interval * 2) times.push_back(t);
+	std::sort(times.begin(), times.end());
+	times.erase(std::unique(times.begin(), times.end()), times.end());
+	std::vector<check_sample_t> samples(times.size());
+	uint64_t now = 0;
+	for (size_t i = 0; i < times.size(); i++) {
+		while (now < times[i]) now += ref.clock_n((size_t)(times[i] - now), state_ref, check_handler, &host_ref);
+		check_sample_t& sample = samples[i];
+		sample.time = now;
+		ref.save_state(sample.snapshot, sizeof(sample.snapshot));
+		sample.mem.assign(mem_ref, mem_ref + 0x10000);
+		sample.world = host_ref.world;
+		sample.state = state_ref;
+	}
+
+	/* the same through the rewind buffer, seeking back along the way */
+	check_init(mem_rw, seed);
+	z80emu cpu(false);
+	check_host_t host = { { 777ULL * seed + 3, 0, 0, 0 }, &cpu, mem_rw };
+	z80_pinbits_t state;
+	check_reset(cpu, host, state);
+	cpu.load_state(start, sizeof(start));
+	z80_rewind_host_t rw_host = { &host, sizeof(check_world_t), check_host_save, check_host_load };
+	z80_rewind rw(cpu, mem_rw, interval, keyframes, delta_size, &rw_host);
+	if (rw.seek(0, state, check_handler, &host)) check_fail("seek before the first run accepted", seed, 0);
+
+	while (rw.now() < CHECK_HALF_CYCLES) {
+		rw.run(std::min<uint64_t>(CHECK_HALF_CYCLES - rw.now(), 1 + check_rnd(rng) % 40000), state, check_handler, &host);
+		if (!(check_rnd(rng) % 3)) continue;
+		if (rw.oldest() && rw.seek(rw.oldest() - 1, state, check_handler, &host)) check_fail("seek before the oldest keyframe accepted", seed, rw.oldest() - 1);
+		if (rw.seek(rw.now() + 1, state, check_handler, &host)) check_fail("seek into the future accepted", seed, rw.now() + 1);
+
+		/* mostly into recent history, so that the run moves on */
+		uint64_t from = (!(check_rnd(rng) % 8) || rw.now() < 30000) ? rw.oldest() : std::max<uint64_t>(rw.oldest(), rw.now() - 30000);
+		std::vector<const check_sample_t*> targets;
+		for (const check_sample_t& sample : samples) if (sample.time >= from && sample.time <= rw.now()) targets.push_back(&sample);
+		if (targets.empty()) continue;
+		const check_sample_t& target = *targets[check_rnd(rng) % targets.size()];
+		if (!rw.seek(target.time, state, check_handler, &host)) check_fail("seek failed", seed, target.time);
+		else if (rw.now() != target.time || !check_same(cpu, host, state, target)) check_fail("state after seeking differs", seed, target.time);
+		check_seeks++;
+	}
+	if (!check_same(cpu, host, state, samples.back())) check_fail("final state differs", seed, rw.now());
+
+	z80_rewind_stats_t stats = rw.get_stats();
+	if (stats.keyframes > keyframes || stats.delta_pages * Z80_REWIND_PAGE_SIZE > delta_size) check_fail("over budget", seed, rw.now());
+}
+
+int main(int argc, char** argv) {
+	int seeds = (argc > 1) ? atoi(argv[1]) : 64;
+	for (int seed = 1; seed <= seeds; seed++) check_seed(seed);
+	printf("%d failures, %ld seeks\n", check_fails, check_seeks);
+	return check_fails != 0;
+}
\ No newline at end of file
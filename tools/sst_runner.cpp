@@ -0,0 +1,593 @@
+/*
+ * SingleStepTests/JSMoo conformance runner.
+ * Runs every vector of the given test files (or of the *.json files in the given directories) through pin-level emulation (z80emu::clock()),
+ * checking the final registers and memory, the I/O port writes and the per-T cycle bus trace, and prints pass/fail counts and timing per
+ * opcode file. Files are memory-mapped and parsed in place, and are spread over worker threads.
+ *
+ * usage: llz80emu_sst [-j threads] [-q] [-c] [-r] <file or directory>...
+ *   -j threads	number of worker threads (default: one per hardware thread)
+ *   -q		only list files with failures
+ *   -c		don't check bus traces (registers, memory and port writes only)
+ *   -r		sample bus traces after the rising edge of each T cycle, instead of after the falling edge
+ * The exit status is 0 if every vector passed.
+ */
+
+#include "z80emu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace llz80emu;
+
+/* read-only memory-mapped file */
+class sst_mapped_file {
+public:
+	~sst_mapped_file() {
+#if defined(_WIN32)
+		if (_data) UnmapViewOfFile(_data);
+		if (_mapping) CloseHandle(_mapping);
+		if (_file != INVALID_HANDLE_VALUE) CloseHandle(_file);
+#else
+		if (_data) munmap((void*)_data, _size);
+#endif
+	}
+
+	bool open(const char* path) { // map the file, returning false on failure
+#if defined(_WIN32)
+		_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (_file == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(_file, &size)) return false;
+		_size = (size_t)size.QuadPart;
+		if (!_size) return true; // nothing to map
+		_mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (!_mapping) return false;
+		_data = (const char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return false;
+		struct stat st;
+		if (fstat(fd, &st) < 0) { close(fd); return false; }
+		_size = (size_t)st.st_size;
+		if (_size) {
+			void* p = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (p != MAP_FAILED) {
+				_data = (const char*)p;
+				madvise(p, _size, MADV_SEQUENTIAL); // we only go through it once
+			}
+		}
+		close(fd); // the mapping stays valid
+		if (!_size) return true;
+#endif
+		return _data != nullptr;
+	}
+
+	inline const char* data() const { return _data; }
+	inline size_t size() const { return _size; }
+private:
+	const char* _data = nullptr;
+	size_t _size = 0;
+#if defined(_WIN32)
+	HANDLE _file = INVALID_HANDLE_VALUE;
+	HANDLE _mapping = NULL;
+#endif
+};
+
+/*
+ * streaming JSON reader working in place on the mapped file (no allocations). Since test files are machine-generated, it is lenient:
+ * commas and colons are treated as whitespace, and strings are returned raw (escape sequences are not decoded).
+ * Any syntax error sets the error flag and moves the cursor to the end, so that the caller's loops run out.
+ */
+class sst_json {
+public:
+	sst_json(const char* begin, const char* end) : _p(begin), _end(end) {}
+
+	inline bool ok() const { return !_err; }
+	inline bool eof() { skip_ws(); return _p >= _end; }
+
+	inline char peek() { // return the next significant character (0 at the end)
+		skip_ws();
+		return (_p < _end) ? *_p : 0;
+	}
+
+	inline bool accept(char c) { // consume c if it's the next significant character
+		if (peek() != c) return false;
+		_p++;
+		return true;
+	}
+
+	inline void expect(char c) { // consume c, or fail
+		if (!accept(c)) fail();
+	}
+
+	bool string(const char*& str, size_t& len) { // read a string, returning a pointer into the file
+		str = _end; len = 0; // empty on failure
+		if (!accept('"')) { fail(); return false; }
+		str = _p;
+		while (_p < _end && *_p != '"') _p += (*_p == '\\') ? 2 : 1;
+		if (_p >= _end) { fail(); return false; }
+		len = _p++ - str;
+		return true;
+	}
+
+	bool number(long& val) { // read an integer (returning false on null)
+		if (peek() == 'n') { literal("null"); return false; }
+		bool neg = accept('-');
+		if (_p >= _end || *_p < '0' || *_p > '9') { fail(); return false; }
+		val = 0;
+		while (_p < _end && *_p >= '0' && *_p <= '9') val = val * 10 + (*_p++ - '0');
+		if (_p < _end && (*_p == '.' || *_p == 'e' || *_p == 'E')) { // not expected in test files - skip the fractional part/exponent
+			while (_p < _end && strchr("0123456789.eE+-", *_p)) _p++;
+		}
+		if (neg) val = -val;
+		return true;
+	}
+
+	void skip() { // skip a value
+		switch (peek()) {
+		case '{': _p++; while (ok() && !accept('}')) { const char* key; size_t len; string(key, len); skip(); } break;
+		case '[': _p++; while (ok() && !accept(']')) skip(); break;
+		case '"': { const char* str; size_t len; string(str, len); } break;
+		case 't': literal("true"); break;
+		case 'f': literal("false"); break;
+		case 'n': literal("null"); break;
+		default: { long val; number(val); } break;
+		}
+	}
+private:
+	const char* _p; // cursor
+	const char* _end;
+	bool _err = false;
+
+	inline void skip_ws() {
+		while (_p < _end && (*_p == ' ' || *_p == '\t' || *_p == '\r' || *_p == '\n' || *_p == ',' || *_p == ':')) _p++;
+	}
+
+	void literal(const char* lit) {
+		size_t len = strlen(lit);
+		if ((size_t)(_end - _p) < len || memcmp(_p, lit, len)) fail();
+		else _p += len;
+	}
+
+	void fail() {
+		_err = true;
+		_p = _end;
+	}
+};
+
+/* test vector contents */
+#define SST_MAX_RAM							64 // maximum number of memory locations per state
+#define SST_MAX_CYCLES						64 // maximum number of T cycles per vector
+#define SST_MAX_PORTS						8 // maximum number of I/O accesses per vector
+
+typedef enum {
+	SST_PC, SST_SP, SST_A, SST_B, SST_C, SST_D, SST_E, SST_F, SST_H, SST_L, SST_I, SST_R, SST_EI, SST_WZ, SST_IX, SST_IY,
+	SST_AF_S, SST_BC_S, SST_DE_S, SST_HL_S, SST_IM, SST_P, SST_Q, SST_IFF1, SST_IFF2,
+	SST_FIELDS
+} sst_field_t;
+
+static const struct {
+	const char* name; // key in the test file
+	bool check; // whether the final value is compared (EI and P only matter for interrupt handling, which the vectors don't exercise)
+} sst_fields[SST_FIELDS] = {
+	{ "pc", true }, { "sp", true }, { "a", true }, { "b", true }, { "c", true }, { "d", true }, { "e", true }, { "f", true }, { "h", true }, { "l", true },
+	{ "i", true }, { "r", true }, { "ei", false }, { "wz", true }, { "ix", true }, { "iy", true },
+	{ "af_", true }, { "bc_", true }, { "de_", true }, { "hl_", true }, { "im", true }, { "p", false }, { "q", true }, { "iff1", true }, { "iff2", true }
+};
+
+#define SST_CTL_RD							(1 << 0) // bus control signals in cycle traces ("rwmi")
+#define SST_CTL_WR							(1 << 1)
+#define SST_CTL_MREQ						(1 << 2)
+#define SST_CTL_IORQ						(1 << 3)
+
+typedef struct {
+	uint16_t regs[SST_FIELDS];
+	struct { uint16_t addr; uint8_t val; } ram[SST_MAX_RAM];
+	size_t ram_len;
+} sst_state_t;
+
+typedef struct {
+	uint16_t addr;
+	int16_t data; // -1 = not given (null)
+	uint8_t ctl; // SST_CTL_*
+} sst_cycle_t;
+
+typedef struct {
+	uint16_t addr;
+	uint8_t val;
+	bool write;
+} sst_port_t;
+
+typedef struct {
+	const char* name; // pointer into the file
+	size_t name_len;
+	sst_state_t initial, final;
+	sst_cycle_t cycles[SST_MAX_CYCLES];
+	size_t cycles_len;
+	sst_port_t ports[SST_MAX_PORTS];
+	size_t ports_len;
+} sst_test_t;
+
+static bool sst_key_is(const char* key, size_t len, const char* name) {
+	return strlen(name) == len && !memcmp(key, name, len);
+}
+
+static void sst_parse_state(sst_json& json, sst_state_t& state) {
+	memset(&state, 0, sizeof(state));
+	json.expect('{');
+	while (json.ok() && !json.accept('}')) {
+		const char* key; size_t len;
+		json.string(key, len);
+		if (sst_key_is(key, len, "ram")) {
+			json.expect('[');
+			while (json.ok() && !json.accept(']')) {
+				long addr = 0, val = 0;
+				json.expect('['); json.number(addr); json.number(val); json.expect(']');
+				if (state.ram_len == SST_MAX_RAM) { json.skip(); continue; } // can't happen with real vectors - the test will fail on memory contents
+				state.ram[state.ram_len].addr = (uint16_t)addr; state.ram[state.ram_len].val = (uint8_t)val;
+				state.ram_len++;
+			}
+			continue;
+		}
+		int field;
+		for (field = 0; field < SST_FIELDS && !sst_key_is(key, len, sst_fields[field].name); field++);
+		if (field == SST_FIELDS) { json.skip(); continue; } // unknown field
+		long val = 0;
+		json.number(val);
+		state.regs[field] = (uint16_t)val;
+	}
+}
+
+static bool sst_parse_test(sst_json& json, sst_test_t& test) { // parse the next vector in the top-level array
+	test.name = ""; test.name_len = 0;
+	test.cycles_len = test.ports_len = 0;
+	json.expect('{');
+	while (json.ok() && !json.accept('}')) {
+		const char* key; size_t len;
+		json.string(key, len);
+		if (sst_key_is(key, len, "name")) json.string(test.name, test.name_len);
+		else if (sst_key_is(key, len, "initial")) sst_parse_state(json, test.initial);
+		else if (sst_key_is(key, len, "final")) sst_parse_state(json, test.final);
+		else if (sst_key_is(key, len, "cycles")) {
+			json.expect('[');
+			while (json.ok() && !json.accept(']')) {
+				sst_cycle_t cycle;
+				long addr = 0, data = -1;
+				const char* ctl; size_t ctl_len = 0;
+				json.expect('[');
+				json.number(addr);
+				if (!json.number(data)) data = -1;
+				json.string(ctl, ctl_len);
+				json.expect(']');
+				cycle.addr = (uint16_t)addr; cycle.data = (int16_t)data;
+				cycle.ctl = 0;
+				for (size_t i = 0; i < ctl_len; i++) {
+					switch (ctl[i]) {
+					case 'r': cycle.ctl |= SST_CTL_RD; break;
+					case 'w': cycle.ctl |= SST_CTL_WR; break;
+					case 'm': cycle.ctl |= SST_CTL_MREQ; break;
+					case 'i': cycle.ctl |= SST_CTL_IORQ; break;
+					default: break;
+					}
+				}
+				if (test.cycles_len < SST_MAX_CYCLES) test.cycles[test.cycles_len] = cycle;
+				test.cycles_len++; // counted even past SST_MAX_CYCLES, so that such vectors are reported
+			}
+		}
+		else if (sst_key_is(key, len, "ports")) {
+			json.expect('[');
+			while (json.ok() && !json.accept(']')) {
+				long addr = 0, val = 0;
+				const char* dir; size_t dir_len = 0;
+				json.expect('['); json.number(addr); json.number(val); json.string(dir, dir_len); json.expect(']');
+				if (test.ports_len < SST_MAX_PORTS) {
+					test.ports[test.ports_len].addr = (uint16_t)addr; test.ports[test.ports_len].val = (uint8_t)val;
+					test.ports[test.ports_len].write = (dir_len && dir[0] == 'w');
+				}
+				test.ports_len++;
+			}
+		}
+		else json.skip();
+	}
+	return json.ok();
+}
+
+/* test bus state (one per worker) */
+typedef struct {
+	uint8_t mem[0x10000];
+	uint16_t touched[2 * SST_MAX_RAM + SST_MAX_CYCLES]; // addresses to be cleared after the vector
+	size_t touched_len;
+	sst_port_t writes[SST_MAX_PORTS]; // I/O writes made
+	size_t writes_len;
+} sst_bus_t;
+
+static inline void sst_touch(sst_bus_t& bus, uint16_t addr) {
+	if (bus.touched_len < sizeof(bus.touched) / sizeof(bus.touched[0])) bus.touched[bus.touched_len++] = addr;
+}
+
+static inline uint8_t sst_ctl(z80_pinbits_t state) { // get bus control signals (active low) from pin state
+	return ((state & Z80_RD) ? 0 : SST_CTL_RD) | ((state & Z80_WR) ? 0 : SST_CTL_WR) | ((state & Z80_MREQ) ? 0 : SST_CTL_MREQ) | ((state & Z80_IORQ) ? 0 : SST_CTL_IORQ);
+}
+
+static void sst_ctl_str(uint8_t ctl, char* str) {
+	str[0] = (ctl & SST_CTL_RD) ? 'r' : '-'; str[1] = (ctl & SST_CTL_WR) ? 'w' : '-';
+	str[2] = (ctl & SST_CTL_MREQ) ? 'm' : '-'; str[3] = (ctl & SST_CTL_IORQ) ? 'i' : '-';
+	str[4] = 0;
+}
+
+static z80_pinbits_t sst_service(sst_bus_t& bus, const sst_test_t& test, z80_pinbits_t state, z80_pinbits_t prev) { // respond to bus activity and return the next input pin state
+	z80_pinbits_t in = Z80_RESET | Z80_WAIT | Z80_BUSREQ | Z80_INT | Z80_D_ALL; // nothing asserted, data bus floating
+	uint16_t addr = (uint16_t)(state & Z80_A_ALL);
+	uint8_t ctl = sst_ctl(state);
+	if ((ctl & (SST_CTL_MREQ | SST_CTL_RD)) == (SST_CTL_MREQ | SST_CTL_RD))
+		in = (in & ~Z80_D_ALL) | ((z80_pinbits_t)bus.mem[addr] << Z80_PIN_D_BASE);
+	else if ((ctl & (SST_CTL_MREQ | SST_CTL_WR)) == (SST_CTL_MREQ | SST_CTL_WR)) {
+		bus.mem[addr] = (uint8_t)((state & Z80_D_ALL) >> Z80_PIN_D_BASE);
+		sst_touch(bus, addr);
+	}
+	else if ((ctl & (SST_CTL_IORQ | SST_CTL_RD)) == (SST_CTL_IORQ | SST_CTL_RD) && (state & Z80_M1)) { // not an interrupt acknowledgment
+		for (size_t i = 0; i < test.ports_len && i < SST_MAX_PORTS; i++) {
+			if (!test.ports[i].write && test.ports[i].addr == addr) {
+				in = (in & ~Z80_D_ALL) | ((z80_pinbits_t)test.ports[i].val << Z80_PIN_D_BASE);
+				break;
+			}
+		}
+	}
+	else if ((ctl & (SST_CTL_IORQ | SST_CTL_WR)) == (SST_CTL_IORQ | SST_CTL_WR) && (sst_ctl(prev) & (SST_CTL_IORQ | SST_CTL_WR)) != (SST_CTL_IORQ | SST_CTL_WR)) { // record each write once
+		if (bus.writes_len < SST_MAX_PORTS) {
+			bus.writes[bus.writes_len].addr = addr; bus.writes[bus.writes_len].val = (uint8_t)((state & Z80_D_ALL) >> Z80_PIN_D_BASE);
+			bus.writes[bus.writes_len].write = true;
+		}
+		bus.writes_len++;
+	}
+	return in;
+}
+
+typedef struct {
+	bool check_cycles; // compare bus traces
+	bool sample_high; // sample bus traces after the rising edge
+} sst_options_t;
+
+static bool sst_run_test(z80emu& cpu, sst_bus_t& bus, const sst_test_t& test, const sst_options_t& opts, std::string* why) { // run a vector, returning whether it passed (and, if why is given, describing the first mismatches)
+	char buf[128];
+	bool pass = true;
+
+	/* set up */
+	bus.touched_len = bus.writes_len = 0;
+	for (size_t i = 0; i < test.initial.ram_len; i++) {
+		bus.mem[test.initial.ram[i].addr] = test.initial.ram[i].val;
+		sst_touch(bus, test.initial.ram[i].addr);
+	}
+	cpu.reset(); cpu.set_clkpin(false); // the first clock() is the rising edge of T1 of the opcode fetch
+	const uint16_t* in = test.initial.regs;
+	z80_registers_t regs = cpu.get_regs();
+	regs.REG_PC = in[SST_PC]; regs.REG_SP = in[SST_SP];
+	regs.REG_A = (uint8_t)in[SST_A]; regs.REG_F = (uint8_t)in[SST_F];
+	regs.REG_B = (uint8_t)in[SST_B]; regs.REG_C = (uint8_t)in[SST_C];
+	regs.REG_D = (uint8_t)in[SST_D]; regs.REG_E = (uint8_t)in[SST_E];
+	regs.REG_H = (uint8_t)in[SST_H]; regs.REG_L = (uint8_t)in[SST_L];
+	regs.REG_I = (uint8_t)in[SST_I]; regs.REG_R = (uint8_t)in[SST_R];
+	regs.REG_IX = in[SST_IX]; regs.REG_IY = in[SST_IY];
+	regs.REG_AF_S = in[SST_AF_S]; regs.REG_BC_S = in[SST_BC_S]; regs.REG_DE_S = in[SST_DE_S]; regs.REG_HL_S = in[SST_HL_S];
+	regs.REG_WZ = regs.MEMPTR = in[SST_WZ];
+	regs.Q = (uint8_t)in[SST_Q];
+	regs.iff1 = in[SST_IFF1] != 0; regs.iff2 = in[SST_IFF2] != 0; regs.int_mode = (uint8_t)in[SST_IM];
+	cpu.set_regs(regs);
+
+	/* run for as many T cycles as the trace has, comparing pins as we go */
+	if (test.cycles_len > SST_MAX_CYCLES) {
+		pass = false;
+		if (why) { snprintf(buf, sizeof(buf), "too many cycles (%zu); ", test.cycles_len); *why += buf; }
+	}
+	z80_pinbits_t state = Z80_RESET | Z80_WAIT | Z80_BUSREQ | Z80_INT | Z80_D_ALL, prev = 0;
+	bool cycles_ok = true;
+	for (size_t t = 0; t < test.cycles_len && t < SST_MAX_CYCLES; t++) {
+		z80_pinbits_t sample = 0;
+		for (int edge = 0; edge < 2; edge++) {
+			z80_pins_t pins = cpu.clock(state);
+			state = sst_service(bus, test, pins.state, prev);
+			prev = pins.state;
+			if (edge == (opts.sample_high ? 0 : 1)) sample = pins.state;
+		}
+
+		const sst_cycle_t& exp = test.cycles[t];
+		if (!opts.check_cycles || !cycles_ok) continue; // only report the first mismatch
+		uint8_t ctl = sst_ctl(sample);
+		uint16_t addr = (uint16_t)(sample & Z80_A_ALL);
+		int data = (ctl & (SST_CTL_RD | SST_CTL_WR)) ? (int)((sample & Z80_D_ALL) >> Z80_PIN_D_BASE) : -1; // data bus is only meaningful during reads and writes
+		if (ctl != exp.ctl || ((exp.ctl & (SST_CTL_MREQ | SST_CTL_IORQ)) && addr != exp.addr) || (exp.data >= 0 && data != exp.data)) { // addresses are only compared on bus accesses, and data only where given
+			cycles_ok = pass = false;
+			if (why) {
+				char exp_ctl[5], got_ctl[5];
+				sst_ctl_str(exp.ctl, exp_ctl); sst_ctl_str(ctl, got_ctl);
+				snprintf(buf, sizeof(buf), "cycle %zu: expected %s %04X/%d, got %s %04X/%d; ", t, exp_ctl, exp.addr, exp.data, got_ctl, addr, data);
+				*why += buf;
+			}
+		}
+	}
+
+	/* compare registers */
+	regs = cpu.get_regs();
+	uint16_t out[SST_FIELDS] = {};
+	out[SST_PC] = regs.REG_PC; out[SST_SP] = regs.REG_SP;
+	out[SST_A] = regs.REG_A; out[SST_F] = regs.REG_F; out[SST_B] = regs.REG_B; out[SST_C] = regs.REG_C;
+	out[SST_D] = regs.REG_D; out[SST_E] = regs.REG_E; out[SST_H] = regs.REG_H; out[SST_L] = regs.REG_L;
+	out[SST_I] = regs.REG_I; out[SST_R] = regs.REG_R; out[SST_WZ] = regs.MEMPTR;
+	out[SST_IX] = regs.REG_IX; out[SST_IY] = regs.REG_IY;
+	out[SST_AF_S] = regs.REG_AF_S; out[SST_BC_S] = regs.REG_BC_S; out[SST_DE_S] = regs.REG_DE_S; out[SST_HL_S] = regs.REG_HL_S;
+	out[SST_IM] = regs.int_mode; out[SST_Q] = regs.Q; out[SST_IFF1] = regs.iff1; out[SST_IFF2] = regs.iff2;
+	for (int i = 0; i < SST_FIELDS; i++) {
+		if (!sst_fields[i].check || out[i] == test.final.regs[i]) continue;
+		pass = false;
+		if (why) { snprintf(buf, sizeof(buf), "%s: expected %04X, got %04X; ", sst_fields[i].name, test.final.regs[i], out[i]); *why += buf; }
+	}
+
+	/* compare memory and I/O writes */
+	for (size_t i = 0; i < test.final.ram_len; i++) {
+		uint16_t addr = test.final.ram[i].addr;
+		if (bus.mem[addr] == test.final.ram[i].val) continue;
+		pass = false;
+		if (why) { snprintf(buf, sizeof(buf), "mem %04X: expected %02X, got %02X; ", addr, test.final.ram[i].val, bus.mem[addr]); *why += buf; }
+	}
+	size_t n = 0;
+	for (size_t i = 0; i < test.ports_len && i < SST_MAX_PORTS; i++) {
+		if (!test.ports[i].write) continue;
+		if (n >= bus.writes_len || n >= SST_MAX_PORTS || bus.writes[n].addr != test.ports[i].addr || bus.writes[n].val != test.ports[i].val) {
+			pass = false;
+			if (why) { snprintf(buf, sizeof(buf), "port write %zu: expected %02X to %04X; ", n, test.ports[i].val, test.ports[i].addr); *why += buf; }
+		}
+		n++;
+	}
+	if (n != bus.writes_len) {
+		pass = false;
+		if (why) { snprintf(buf, sizeof(buf), "%zu port writes made, %zu expected; ", bus.writes_len, n); *why += buf; }
+	}
+
+	/* clean up for the next vector */
+	for (size_t i = 0; i < bus.touched_len; i++) bus.mem[bus.touched[i]] = 0;
+	if (bus.touched_len == sizeof(bus.touched) / sizeof(bus.touched[0])) memset(bus.mem, 0, sizeof(bus.mem)); // lost track
+	return pass;
+}
+
+/* per-file results */
+typedef struct {
+	std::string path;
+	size_t total, passed;
+	bool error; // couldn't be read or parsed
+	double ms; // time taken (parsing included)
+	std::string first_failure; // name and mismatches of the first failing vector
+} sst_file_result_t;
+
+static void sst_run_file(z80emu& cpu, sst_bus_t& bus, sst_test_t& test, const sst_options_t& opts, sst_file_result_t& result) {
+	auto start = std::chrono::steady_clock::now();
+	result.total = result.passed = 0;
+	result.error = false;
+
+	sst_mapped_file file;
+	if (!file.open(result.path.c_str())) result.error = true;
+	else {
+		sst_json json(file.data(), file.data() + file.size());
+		json.expect('[');
+		while (json.ok() && !json.accept(']')) {
+			if (!sst_parse_test(json, test)) break;
+			result.total++;
+			if (sst_run_test(cpu, bus, test, opts, nullptr)) result.passed++;
+			else if (result.first_failure.empty()) {
+				result.first_failure.assign(test.name, test.name_len);
+				result.first_failure += ": ";
+				sst_run_test(cpu, bus, test, opts, &result.first_failure); // run it again to describe the mismatches (so passing vectors don't pay for it)
+			}
+		}
+		if (!json.ok()) result.error = true;
+	}
+
+	result.ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool sst_has_suffix(const std::string& str, const char* suffix) {
+	size_t len = strlen(suffix);
+	return str.size() >= len && !str.compare(str.size() - len, len, suffix);
+}
+
+static void sst_add_path(const char* path, std::vector<sst_file_result_t>& files) { // add a test file, or the *.json files in a directory
+	std::vector<std::string> found;
+#if defined(_WIN32)
+	DWORD attr = GetFileAttributesA(path);
+	if (attr != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_DIRECTORY)) {
+		WIN32_FIND_DATAA fd;
+		HANDLE h = FindFirstFileA((std::string(path) + "\\*.json").c_str(), &fd);
+		if (h != INVALID_HANDLE_VALUE) {
+			do found.push_back(std::string(path) + "\\" + fd.cFileName); while (FindNextFileA(h, &fd));
+			FindClose(h);
+		}
+	}
+#else
+	DIR* dir = opendir(path);
+	if (dir) {
+		struct dirent* ent;
+		while ((ent = readdir(dir))) {
+			std::string name = ent->d_name;
+			if (sst_has_suffix(name, ".json")) found.push_back(std::string(path) + "/" + name);
+		}
+		closedir(dir);
+	}
+#endif
+	else found.push_back(path);
+	std::sort(found.begin(), found.end());
+	for (auto& p : found) {
+		sst_file_result_t r;
+		r.path = p;
+		files.push_back(r);
+	}
+}
+
+int main(int argc, char** argv) {
+	size_t threads = 0;
+	bool quiet = false;
+	sst_options_t opts = { true, false };
+	std::vector<sst_file_result_t> files;
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "-j") && i + 1 < argc) threads = (size_t)atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-q")) quiet = true;
+		else if (!strcmp(argv[i], "-c")) opts.check_cycles = false;
+		else if (!strcmp(argv[i], "-r")) opts.sample_high = true;
+		else sst_add_path(argv[i], files);
+	}
+	if (files.empty()) {
+		fprintf(stderr, "usage: %s [-j threads] [-q] [-c] [-r] <file or directory>...\n", argv[0]);
+		return 2;
+	}
+	if (!threads) threads = std::thread::hardware_concurrency();
+	if (!threads) threads = 1;
+	if (threads > files.size()) threads = files.size();
+
+	/* run files over the workers (each taking the next file in line) */
+	auto start = std::chrono::steady_clock::now();
+	std::atomic<size_t> next{ 0 };
+	std::vector<std::thread> workers;
+	for (size_t i = 0; i < threads; i++) {
+		workers.emplace_back([&] {
+			z80emu cpu(false);
+			std::unique_ptr<sst_bus_t> bus(new sst_bus_t());
+			std::unique_ptr<sst_test_t> test(new sst_test_t());
+			size_t idx;
+			while ((idx = next++) < files.size()) sst_run_file(cpu, *bus, *test, opts, files[idx]);
+		});
+	}
+	for (auto& w : workers) w.join();
+	double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	/* report */
+	size_t total = 0, passed = 0, failed_files = 0;
+	for (auto& f : files) {
+		total += f.total; passed += f.passed;
+		bool ok = !f.error && f.passed == f.total;
+		if (!ok) failed_files++;
+		if (quiet && ok) continue;
+		size_t slash = f.path.find_last_of("/\\");
+		std::string name = f.path.substr((slash == std::string::npos) ? 0 : slash + 1);
+		if (sst_has_suffix(name, ".json")) name.resize(name.size() - 5);
+		printf("%-14s %5zu/%-5zu %8.2f ms%s", name.c_str(), f.passed, f.total, f.ms, (f.error) ? "  READ/PARSE ERROR" : "");
+		if (!f.first_failure.empty()) printf("  %s", f.first_failure.c_str());
+		printf("\n");
+	}
+	printf("%zu/%zu vectors passed, %zu/%zu files failing, %.2f s on %zu threads\n", passed, total, failed_files, files.size(), secs, threads);
+	return (failed_files) ? 1 : 0;
+}
\ No newline at end of file
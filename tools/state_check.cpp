@@ -0,0 +1,184 @@
+/*
+ * State snapshot regression check (see state.h).
+ * Checks the register section of the snapshot layout against fixed offsets, then takes snapshots of pin-level emulation at random
+ * half-cycles (with random code, WAIT, INT, BUSREQ, NMI and RESET activity) and loads them into a second instance that has been running
+ * something else. Both are then clocked in lockstep, with their pins compared on every half-cycle and their full state and memory compared
+ * at the end. Snapshots are also checked to save back identically, corrupt or short ones to be rejected without changing anything, and
+ * instruction-level execution (with a scheduled INT pending every so often) to continue identically from them.
+ *
+ * usage: llz80emu_state_check [seeds]
+ *   seeds	number of random programs to run (default: 32)
+ * The exit status is 0 if every check passed.
+ */
+
+#include "z80emu.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace llz80emu;
+
+static int check_fails = 0;
+
+static void check_fail(const char* what, int seed, int snap) { // report a failure (only the first few are printed)
+	if (check_fails++ < 10) printf("seed %d, snapshot %d: %s\n", seed, snap, what);
+}
+
+/* everything outside the CPU: 64K of RAM, an I/O port pattern, an interrupting peripheral and random control line activity */
+typedef struct {
+	uint64_t rng;
+	uint8_t mem[0x10000];
+	uint8_t vector; // data placed on the bus on INT acknowledgment
+	int int_len, wait_len, busreq_len; // remaining half-cycles of INT/WAIT/BUSREQ assertion
+	z80_pins_t pins; // pins following the last half-cycle
+} check_world_t;
+
+static uint32_t check_rnd(check_world_t& w) {
+	w.rng ^= w.rng << 13; w.rng ^= w.rng >> 7; w.rng ^= w.rng << 17;
+	return (uint32_t)w.rng;
+}
+
+/* serve the bus access in progress, and clock the CPU by one half-cycle */
+static void check_clock(z80emu& cpu, check_world_t& w) {
+	z80_pinbits_t active = ~w.pins.state & w.pins.dir; // outputs driven low (lines off the bus are inputs)
+	uint16_t addr = (uint16_t)(w.pins.state & Z80_A_ALL);
+	z80_pinbits_t in = Z80_RESET | Z80_WAIT | Z80_BUSREQ | Z80_INT | Z80_D_ALL; // nothing asserted, data bus floating
+	uint8_t data = 0xFF;
+	if ((active & Z80_MREQ) && (active & Z80_RD)) data = w.mem[addr];
+	else if ((active & Z80_MREQ) && (active & Z80_WR)) w.mem[addr] = (uint8_t)(w.pins.state >> Z80_PIN_D_BASE);
+	else if ((active & Z80_IORQ) && (active & Z80_M1)) data = w.vector;
+	else if ((active & Z80_IORQ) && (active & Z80_RD)) data = (uint8_t)(addr * 7 + (addr >> 8));
+	in = (in & ~Z80_D_ALL) | ((z80_pinbits_t)data << Z80_PIN_D_BASE);
+
+	if (w.int_len > 0) { in &= ~Z80_INT; w.int_len--; }
+	else if (!(check_rnd(w) % 3000)) w.int_len = 40;
+	if (w.wait_len > 0) { in &= ~Z80_WAIT; w.wait_len--; }
+	else if (!(check_rnd(w) % 500)) w.wait_len = 1 + check_rnd(w) % 6;
+	if (w.busreq_len > 0) { in &= ~Z80_BUSREQ; w.busreq_len--; }
+	else if (!(check_rnd(w) % 4000)) w.busreq_len = 2 + check_rnd(w) % 20;
+	if (!(check_rnd(w) % 20000)) cpu.trigger_nmi();
+	if (!(check_rnd(w) % 30000)) in &= ~Z80_RESET;
+
+	w.pins = cpu.clock(in);
+}
+
+/* snapshot layout: header and registers at fixed offsets */
+static void check_layout() {
+	z80_registers_t regs;
+	memset(&regs, 0, sizeof(regs));
+	z80_regpair_t* pairs[] = { &regs.AF, &regs.BC, &regs.DE, &regs.HL, &regs.AF_s, &regs.BC_s, &regs.DE_s, &regs.HL_s, &regs.IX, &regs.IY, &regs.SP, &regs.PC, &regs.IR, &regs.WZ };
+	for (int i = 0; i < 14; i++) pairs[i]->word = (uint16_t)(0x1101 * (i + 1));
+	regs.Q = 0xA5; regs.MEMPTR = 0xBEEF; regs.instr = 0xED; regs.iff1 = true; regs.iff2 = false; regs.int_mode = 2;
+
+	z80emu cpu(false);
+	cpu.set_regs(regs);
+	uint8_t buf[Z80_STATE_SIZE];
+	if (cpu.save_state(buf, sizeof(buf)) != Z80_STATE_SIZE) { check_fail("save failed", 0, -1); return; }
+
+	uint8_t expected[8 + 35] = { 'L', 'Z', '8', '0', (uint8_t)Z80_STATE_VERSION, (uint8_t)(Z80_STATE_VERSION >> 8), (uint8_t)Z80_STATE_SIZE, (uint8_t)(Z80_STATE_SIZE >> 8) };
+	size_t n = 8;
+	for (int i = 0; i < 14; i++) { expected[n++] = (uint8_t)(0x1101 * (i + 1)); expected[n++] = (uint8_t)((0x1101 * (i + 1)) >> 8); }
+	expected[n++] = 0xA5; expected[n++] = 0xEF; expected[n++] = 0xBE; expected[n++] = 0xED;
+	expected[n++] = 1; expected[n++] = 0; expected[n++] = 2;
+	for (size_t i = 0; i < n; i++) {
+		if (buf[i] != expected[i]) {
+			printf("layout: byte %zu is 0x%02X, expected 0x%02X\n", i, buf[i], expected[i]);
+			check_fails++;
+			return;
+		}
+	}
+}
+
+/* pin-level emulation: snapshot, restore into another instance and run both in lockstep */
+static check_world_t world_a, world_b;
+
+static void check_pins(int seed) {
+	world_a.rng = 0x9E3779B97F4A7C15ULL * seed;
+	for (int i = 0; i < 0x10000; i++) world_a.mem[i] = (uint8_t)check_rnd(world_a);
+	world_a.vector = (seed & 1) ? 0xFF : (uint8_t)(check_rnd(world_a) & 0xFE); // RST 38H in mode 0 (or the floating bus in mode 1), or a mode 2 vector
+	world_a.int_len = world_a.wait_len = world_a.busreq_len = 0;
+
+	z80emu a(false), b(false);
+	for (int i = 0; i < 8; i++) world_a.pins = a.clock(0); // reset (which also leaves b's state different from a's)
+
+	uint8_t buf[Z80_STATE_SIZE], buf2[Z80_STATE_SIZE];
+	for (int k = 0; k < 16; k++) {
+		for (uint32_t i = check_rnd(world_a) % 30000; i; i--) check_clock(a, world_a);
+		if (a.save_state(buf, sizeof(buf) - 1)) check_fail("short buffer accepted", seed, k);
+		if (a.save_state(buf, sizeof(buf)) != Z80_STATE_SIZE) { check_fail("save failed", seed, k); continue; }
+
+		/* b has been running a program of its own */
+		world_b = world_a; world_b.rng ^= 0x5555;
+		for (int i = 0; i < 200 + k * 13; i++) check_clock(b, world_b);
+		if (!b.load_state(buf, sizeof(buf))) { check_fail("load failed", seed, k); continue; }
+		if (b.save_state(buf2, sizeof(buf2)) != Z80_STATE_SIZE || memcmp(buf, buf2, sizeof(buf))) check_fail("saved back differently", seed, k);
+
+		/* lockstep */
+		uint32_t count = 1 + check_rnd(world_a) % 5000;
+		world_b = world_a; // (after drawing from its random number generator)
+		for (uint32_t i = 0; i < count; i++) {
+			check_clock(a, world_a); check_clock(b, world_b);
+			if (world_a.pins.state != world_b.pins.state || world_a.pins.dir != world_b.pins.dir) {
+				check_fail("pins differ in lockstep", seed, k);
+				break;
+			}
+		}
+		a.save_state(buf, sizeof(buf)); b.save_state(buf2, sizeof(buf2));
+		if (memcmp(buf, buf2, sizeof(buf)) || memcmp(world_a.mem, world_b.mem, sizeof(world_a.mem))) check_fail("state or memory differs after lockstep", seed, k);
+	}
+
+	/* rejection (leaving the state untouched): bad signature, version and size, an invalid cycle type, and a short snapshot */
+	a.save_state(buf, sizeof(buf));
+	const size_t bad[] = { 0, 4, 6, 8 + 35 + 30 };
+	for (size_t off : bad) {
+		memcpy(buf2, buf, sizeof(buf));
+		buf2[off] = 0xFE;
+		if (a.load_state(buf2, sizeof(buf2))) check_fail("corrupt snapshot accepted", seed, -1);
+	}
+	if (a.load_state(buf, sizeof(buf) - 1)) check_fail("short snapshot accepted", seed, -1);
+	a.save_state(buf2, sizeof(buf2));
+	if (memcmp(buf, buf2, sizeof(buf))) check_fail("rejected snapshot changed the state", seed, -1);
+}
+
+/* instruction-level emulation: snapshot, restore into an instance with the decoded instruction cache enabled, and continue both */
+static uint8_t il_mem_a[0x10000], il_mem_b[0x10000];
+static uint8_t check_mem_read(void* ctx, uint16_t addr) { return ((uint8_t*)ctx)[addr]; }
+static void check_mem_write(void* ctx, uint16_t addr, uint8_t val) { ((uint8_t*)ctx)[addr] = val; }
+static uint8_t check_io_read(void*, uint16_t port) { return (uint8_t)(port * 3); }
+static void check_io_write(void*, uint16_t, uint8_t) {}
+
+static void check_instr(int seed) {
+	memcpy(il_mem_a, world_a.mem, sizeof(il_mem_a));
+	z80emu a(false);
+	z80_bus_t bus_a = { il_mem_a, check_mem_read, check_mem_write, check_io_read, check_io_write, nullptr };
+	a.set_bus(bus_a); a.reset();
+	uint8_t buf[Z80_STATE_SIZE], buf2[Z80_STATE_SIZE];
+	for (int k = 0; k < 16; k++) {
+		a.run(check_rnd(world_a) % 20000);
+		if (!(k & 3)) a.schedule_int(1 + check_rnd(world_a) % 3000); // pending in the snapshot
+		a.save_state(buf, sizeof(buf));
+
+		z80emu b(false);
+		z80_bus_t bus_b = { il_mem_b, check_mem_read, check_mem_write, check_io_read, check_io_write, nullptr };
+		b.set_bus(bus_b); b.set_dcache(true); b.reset(); b.run(1000); // fill the cache with something else
+		memcpy(il_mem_b, il_mem_a, sizeof(il_mem_b));
+		if (!b.load_state(buf, sizeof(buf))) { check_fail("instruction-level load failed", seed, k); continue; }
+
+		if (k & 1) { a.trigger_nmi(); b.trigger_nmi(); }
+		uint64_t ta = a.run(5000), tb = b.run(5000);
+		a.save_state(buf, sizeof(buf)); b.save_state(buf2, sizeof(buf2));
+		if (ta != tb || memcmp(buf, buf2, sizeof(buf)) || memcmp(il_mem_a, il_mem_b, sizeof(il_mem_a))) check_fail("instruction-level run differs", seed, k);
+	}
+}
+
+int main(int argc, char** argv) {
+	int seeds = (argc > 1) ? atoi(argv[1]) : 32;
+	check_layout();
+	for (int seed = 1; seed <= seeds; seed++) {
+		check_pins(seed);
+		check_instr(seed);
+	}
+	printf("%d failures\n", check_fails);
+	return check_fails != 0;
+}
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace llz80emu {
+	/* micro-op program representation for fixed-sequence instructions (see instr_uop.cpp) */
+	typedef enum {
+		Z80_UOP_END, // return to fetching
+		Z80_UOP_END_IF_NOT, // return to fetching if the condition in arg is not met
+		Z80_UOP_READ, // stage memory read from addr into data (ends step)
+		Z80_UOP_WRITE, // stage memory write of data to addr (ends step)
+		Z80_UOP_BOGUS, // stage arg bogus clock cycles (ends step)
+		Z80_UOP_JUMP, // PC = WZ
+		Z80_UOP_JUMP_REL, // sign extend Z into WZ, then PC += WZ, MEMPTR = PC
+		Z80_UOP_RST, // PC = MEMPTR = y * 8
+		Z80_UOP_MEMPTR_WZ, // MEMPTR = WZ
+		Z80_UOP_MEMPTR_PC, // MEMPTR = PC
+		Z80_UOP_LD_SP_HL, // SP = HL/IX/IY
+		Z80_UOP_EX_SP_HL, // HL/IX/IY = MEMPTR = WZ (after reading the old stack top into WZ)
+		Z80_UOP_INCDEC_RP, // INC/DEC BC/DE/HL/SP (determined by y)
+		Z80_UOP_DEC_B, // B--
+		Z80_UOP_RESTORE_IFF, // IFF1 = IFF2
+		Z80_UOP_ALU, // ALU operation y on A and Z (sets flags)
+	} z80_uop_op_t;
+
+	typedef enum {
+		Z80_UOP_ADDR_NONE,
+		Z80_UOP_ADDR_PC_INC, // PC++
+		Z80_UOP_ADDR_SP_INC, // SP++
+		Z80_UOP_ADDR_SP_DEC, // --SP
+		Z80_UOP_ADDR_SP, // SP
+		Z80_UOP_ADDR_SP_1, // SP + 1
+		Z80_UOP_ADDR_WZ, // WZ
+		Z80_UOP_ADDR_WZ_INC, // WZ++
+	} z80_uop_addr_t;
+
+	typedef enum {
+		Z80_UOP_DATA_NONE,
+		Z80_UOP_DATA_Z,
+		Z80_UOP_DATA_W,
+		Z80_UOP_DATA_PCL,
+		Z80_UOP_DATA_PCH,
+		Z80_UOP_DATA_R8, // B/C/D/E/H/L/A (or IXH/IXL/IYH/IYL) selected by y
+		Z80_UOP_DATA_RP_L, // low byte of BC/DE/HL/SP (or IX/IY) selected by y
+		Z80_UOP_DATA_RP_H, // high byte of the above
+		Z80_UOP_DATA_RP2_L, // low byte of BC/DE/HL/AF (or IX/IY) selected by y (for PUSH/POP)
+		Z80_UOP_DATA_RP2_H, // high byte of the above
+		Z80_UOP_DATA_HL_L, // L (or IXL/IYL)
+		Z80_UOP_DATA_HL_H, // H (or IXH/IYH)
+	} z80_uop_data_t;
+
+	typedef enum {
+		Z80_UOP_COND_CC, // NZ/Z/NC/C/PO/PE/P/M selected by y (RET/JP/CALL cc)
+		Z80_UOP_COND_CC_JR, // NZ/Z/NC/C selected by y - 4 (JR cc)
+		Z80_UOP_COND_B_NZ, // B != 0 (DJNZ)
+	} z80_uop_cond_t;
+
+	typedef struct {
+		uint8_t op; // operation (z80_uop_op_t)
+		uint8_t addr; // address source for READ/WRITE (z80_uop_addr_t)
+		uint8_t arg; // data source/destination for READ/WRITE (z80_uop_data_t), cycle count for BOGUS, or condition for END_IF_NOT (z80_uop_cond_t)
+	} z80_uop_t;
+
+	const z80_uop_t* z80_uop_lookup(bool ed, uint8_t opcode); // return the micro-op program for an unprefixed (or ED-prefixed) opcode, or nullptr if it's executed by a dedicated executor
+}
\ No newline at end of file
@@ -1,9 +1,19 @@
 #include "z80emu.h"
+#include "memmap.h"
 #include <string.h>
+#include <limits.h>
+#if defined(LLZ80EMU_CHECK_OPINFO)
+#include <assert.h>
+#endif
 
 using namespace llz80emu;
 
 z80emu::z80emu(bool clk) : _clkpin(clk), _fetch_cycle(_pins, _regs), _mem_read_cycle(_pins), _mem_write_cycle(_pins), _io_read_cycle(_pins), _io_write_cycle(_pins), _bogus_cycle(_pins, _regs), _intack_cycle(_pins, _regs), _instr(*this, _regs) {
+	z80_cycle* cycles[] = { &_fetch_cycle, &_mem_read_cycle, &_mem_write_cycle, &_io_read_cycle, &_io_write_cycle, &_bogus_cycle, &_intack_cycle };
+	for (z80_cycle* cycle : cycles) cycle->set_counters(&_counters.wait_states, &_counters.busrel_cycles);
+}
+
+z80emu::~z80emu() {
 
 }
 
@@ -11,8 +21,26 @@ void z80emu::set_clkpin(bool state) {
 	_clkpin = state;
 }
 
-z80_pins_t z80emu::clock(z80_pinbits_t state) {
+inline bool z80emu::clock_cycle() {
+	switch (_cycle->type) {
+	case Z80_FETCH_CYCLE: return _fetch_cycle.clock(_clkpin);
+	case Z80_MEM_READ_CYCLE: return _mem_read_cycle.clock(_clkpin);
+	case Z80_MEM_WRITE_CYCLE: return _mem_write_cycle.clock(_clkpin);
+	case Z80_IO_READ_CYCLE: return _io_read_cycle.clock(_clkpin);
+	case Z80_IO_WRITE_CYCLE: return _io_write_cycle.clock(_clkpin);
+	case Z80_BOGUS_CYCLE: return _bogus_cycle.clock(_clkpin);
+	case Z80_INTACK_CYCLE: return _intack_cycle.clock(_clkpin);
+	default: return true;
+	}
+}
+
+inline void z80emu::tick(z80_pinbits_t state) {
 	_clkpin = !_clkpin; // toggle clock pin
+	Z80_COUNT(_counters.half_cycles++);
+	if (_events) {
+		if (_events->advance(1) && _events->process()) _nmiff = true;
+		state = _events->apply(state); // pin overrides
+	}
 
 	_pins.state = (_pins.state & _pins.dir) | (state & ~_pins.dir); // update pin state (only replacing input pin bits)
 	if (_clkpin) {
@@ -25,6 +53,7 @@ z80_pins_t z80emu::clock(z80_pinbits_t state) {
 
 			_reset_m1t2 = (_cycle && _cycle->type == Z80_FETCH_CYCLE && _cycle->t == 0); _reset_cycles++;
 			_cycle = nullptr; // stop current cycle
+			_opinfo_skip = true; // don't check the interrupted instruction
 		}
 		else if (_por && !_cycle) {
 			if (_reset_cycles == 1 && _reset_m1t2) {
@@ -36,55 +65,119 @@ z80_pins_t z80emu::clock(z80_pinbits_t state) {
 				memset(&_regs, 0, sizeof(_regs)); _regs.REG_SP = _regs.REG_AF = 0xFFFF;
 			}
 
-			/* rising edge and still in reset - get out of reset now (and also synchronise with clock pin) */
-			start_fetch_cycle();
+			/* rising edge and still in reset - get out of reset now (and also synchronise with clock pin), abandoning the interrupted instruction */
+			_instr.reset(); // this also stages the first fetch cycle
+			if (_bp) check_exec();
 			_reset_cycles = 0;
 		}
 	}
 	
 
 	if (_cycle) {
-		if (_clkpin) _intpin = !(_pins.state & Z80_INT); // sample INT pin
+		if (_clkpin) {
+			_intpin = !(_pins.state & Z80_INT); // sample INT pin
+			Z80_COUNT(_counters.tstates++);
+		}
 
 		/* operate cycle */
-		if (_cycle->clock(_clkpin)) {
-			/* cycle has finished */
-			if (!_instr.started()) _instr.start(); // exiting fetch/interrupt acknowledgment cycle - start decoding and executing new instruction
-			else _instr.next_step(); // run next step of instruction execution
-
-			if (!_instr.started()) {
-				/* instruction execution complete */
-
-				if (_nmiff && !_nmi_skip) {
-					/* NMI triggered */
-					_regs.iff2 = _regs.iff1; _regs.iff1 = false; // disable interrupt while keeping former IFF1 state in IFF2
-					_nmiff = false; _nmi_pending = true; // clear NMI flip-flop (so it can be re-activated at some other point), then stage NMI servicing
-					// if (!(_pins.state & Z80_HALT)) _regs.REG_PC++; // if we're halting and an interrupt occurred, we'll need to bring ourselves out of the HALT instruction
-					return _pins; // after this, a fetch cycle will be issued as normal, but it won't be followed by a normal instruction decode/execution
-				}
-
-				if (_intpin && _regs.iff1 && !_int_skip) {
-					/* INT triggered and can be accepted */
-					_regs.iff1 = false; // disable interrupt
-					if (!_regs.int_mode) start_intack_cycle(_regs.instr); // mode 0: read to instruction ptr (this will be handled as normal)
-					else { // mode 1/2
-						start_intack_cycle(_regs.REG_Z); // read to Z (mode 1 can ignore, mode 2 can use this to calculate vector)
-						_int_pending = true; // mark as handling INT so instr_decoder can work on the rest
-						if (!(_pins.state & Z80_HALT)) _regs.REG_PC++; // if we're halting and an interrupt occurred, we'll need to bring ourselves out of the HALT instruction
-						// mode 1: extra clock cycle + push PC + jump to 0x0038
-						// mode 2: extra clock cycle + push PC + read new PC from vector
-					}
-					return _pins;
-				}
-
-				_nmi_skip = _int_skip = false;
-			}
-		}
+		if (clock_cycle()) end_cycle(); // cycle has finished
 	}
+}
 
+/* output pins whose assertion (ie. being pulled low) requires the host's attention */
+#define Z80_PINS_BUS_ACTIVE					(Z80_M1 | Z80_MREQ | Z80_IORQ | Z80_RD | Z80_WR | Z80_BUSACK)
+
+z80_pins_t z80emu::clock(z80_pinbits_t state) {
+	tick(state);
 	return _pins;
 }
 
+size_t z80emu::clock_n(size_t count, z80_pinbits_t& state, z80_pin_handler_t handler, void* ctx) {
+	size_t n = 0;
+	uint64_t hits = (_bp) ? _bp->hits() : 0;
+	while (n < count) {
+		tick(state); n++;
+		/*
+		 * only bother the host if the bus is active (floating pins during reset and bus release don't count), or ahead of rising edges that sample
+		 * input pins with the bus idle: INT during internal operations, and BUSREQ at the start of bus release (once it's staged at the end of a
+		 * machine cycle) - every other sampling edge comes right after a half-cycle on which the bus is active
+		 */
+		if ((~_pins.state & _pins.dir & Z80_PINS_BUS_ACTIVE) || (!_clkpin && _cycle && (_cycle == &_bogus_cycle || _cycle->releasing()))) {
+			if (!handler(ctx, _pins, state)) break; // host asked us to stop
+		}
+		if (_bp && _bp->hits() != hits) break; // breakpoint hit - the cycle making the access has been staged but not started yet
+	}
+	return n;
+}
+
+bool z80emu::is_bus_released() const {
+	return _cycle && (_pins.dir & Z80_BUSACK) && !(_pins.state & Z80_BUSACK) && _cycle->releasing(); // BUSREQ was low when last sampled
+}
+
+void z80emu::skip_released(size_t count, z80_pinbits_t state) {
+	bool reset = !(state & Z80_RESET);
+
+	/* clock normally until only the clock pin and counters change from one half-cycle to the next (events may change pins at any time) */
+	while (count) {
+		if (!_events && !reset && !(state & Z80_BUSREQ) && is_bus_released()) break;
+		bool rising = !_clkpin;
+		tick(state); count--;
+		if (!_events && reset && rising) break; // reset has taken hold
+	}
+	if (!count) return;
+
+	/* skip the rest */
+	uint64_t rising = (count + !_clkpin) >> 1; // number of rising edges to be skipped
+	_clkpin ^= (count & 1);
+	Z80_COUNT(_counters.half_cycles += count);
+	if (reset) _reset_cycles = (_reset_cycles + rising > INT_MAX) ? INT_MAX : (int)(_reset_cycles + rising);
+	else Z80_COUNT(_counters.tstates += rising; _counters.busrel_cycles += rising);
+	_pins = (reset) ? Z80_PINS_INIT : Z80_PINS_BUSREL; // rising edges leave these as they are, falling edges add the input pins
+	if (!_clkpin) _pins.state = (_pins.state & _pins.dir) | (state & ~_pins.dir);
+}
+
+bool z80emu::end_cycle() {
+	if (_dirty && _cycle == &_mem_write_cycle) _dirty->mark(_mem_write_cycle.addr()); // the write has been made
+	if (!_instr.started()) _instr.start(); // exiting fetch/interrupt acknowledgment cycle - start decoding and executing new instruction
+	else _instr.next_step(); // run next step of instruction execution
+
+	return end_step();
+}
+
+bool z80emu::end_step() {
+	if (_instr.started()) return false; // instruction execution still in progress
+
+	/* instruction execution complete */
+
+	if (_nmiff && !_nmi_skip) {
+		/* NMI triggered */
+		_regs.iff2 = _regs.iff1; _regs.iff1 = false; // disable interrupt while keeping former IFF1 state in IFF2
+		Z80_COUNT(_counters.nmis++);
+		_nmiff = false; _nmi_pending = true; // clear NMI flip-flop (so it can be re-activated at some other point), then stage NMI servicing
+		if (_fetch_cycle.halting()) _fetch_cycle.reset(false); // leave HALT - the NMI fetch increments PC as usual (and exec_nmi() rewinds it)
+		// if (!(_pins.state & Z80_HALT)) _regs.REG_PC++; // if we're halting and an interrupt occurred, we'll need to bring ourselves out of the HALT instruction
+		return true; // after this, a fetch cycle will be issued as normal, but it won't be followed by a normal instruction decode/execution
+	}
+
+	if (_intpin && _regs.iff1 && !_int_skip) {
+		/* INT triggered and can be accepted */
+		_regs.iff1 = false; // disable interrupt
+		Z80_COUNT(_counters.ints++);
+		if (!_regs.int_mode) start_intack_cycle(_regs.instr); // mode 0: read to instruction ptr (this will be handled as normal)
+		else { // mode 1/2
+			start_intack_cycle(_regs.REG_Z); // read to Z (mode 1 can ignore, mode 2 can use this to calculate vector)
+			_int_pending = true; // mark as handling INT so instr_decoder can work on the rest (PC already points past HALT if we're halting, since halted fetches don't increment it)
+			// mode 1: extra clock cycle + push PC + jump to 0x0038
+			// mode 2: extra clock cycle + push PC + read new PC from vector
+		}
+		return true;
+	}
+
+	_nmi_skip = _int_skip = false;
+	if (_bp) check_exec();
+	return true;
+}
+
 z80_pins_t z80emu::get_pins() {
 	return _pins;
 }
@@ -93,38 +186,111 @@ void z80emu::trigger_nmi() {
 	_nmiff = true;
 }
 
+z80_counters_t z80emu::get_counters() const {
+	return _counters;
+}
+
+void z80emu::reset_counters() {
+	_counters = {};
+}
+
+const z80_uop_t* z80emu::get_uop_program(bool ed, uint8_t opcode) {
+	return z80_uop_lookup(ed, opcode);
+}
+
+const z80_opinfo_t& z80emu::get_opinfo(z80_opspace_t space, uint8_t opcode) {
+	return z80_opinfo_tables.op[space][opcode];
+}
+
+void z80emu::log_mcycle(uint8_t type, uint8_t tstates) {
+#if defined(LLZ80EMU_CHECK_OPINFO)
+	if (_opinfo_len < (int)(sizeof(_opinfo_log) / sizeof(_opinfo_log[0]))) _opinfo_log[_opinfo_len++] = { type, Z80_OPADDR_NONE, tstates };
+	else _opinfo_skip = true; // too many redundant prefixes to keep track of
+#else
+	(void)type; (void)tstates;
+#endif
+}
+
+bool z80emu::check_opinfo() const {
+	const z80_instr_decoder::decoded_t& instr = _instr.decoded();
+	const z80_opinfo_t& info = z80_opinfo_tables.op[z80_instr_decoder::opspace(instr)][instr.instr];
+	for (int taken = 0; taken < 2; taken++) {
+		int n = (taken) ? info.mcycles_taken : info.mcycles;
+		if (_opinfo_len < n) continue;
+		int extra = _opinfo_len - n; // redundant prefixes preceding the instruction
+		bool match = true;
+		for (int i = 0; i < _opinfo_len && match; i++) {
+			const z80_mcycle_info_t& c = _opinfo_log[i];
+			if (i < extra) match = (c.type == Z80_MCYCLE_FETCH);
+			else match = (c.type == info.seq[i - extra].type && c.tstates == info.seq[i - extra].tstates);
+		}
+		if (match) return true;
+	}
+	return false;
+}
+
 void z80emu::start_fetch_cycle(bool halt) {
+#if defined(LLZ80EMU_CHECK_OPINFO)
+	if (!_instr.prefixed()) {
+		/* the previous instruction has finished */
+		assert(_opinfo_skip || _int_pending || _nmi_pending || check_opinfo());
+		_opinfo_len = 0; _opinfo_skip = halt; // halted fetches are not instructions
+	}
+	log_mcycle(Z80_MCYCLE_FETCH, 4);
+#endif
+#if !defined(LLZ80EMU_NO_COUNTERS)
+	if (_cycle && !_instr.prefixed() && !_int_pending && !_nmi_pending && !is_halting()) _counters.instructions++; // the previous instruction has been retired (interrupt servicing and halted fetches don't count)
+	_counters.mcycles[Z80_FETCH_CYCLE]++;
+#endif
 	_int_pending = _nmi_pending = false; // now that we're back to normal operation
 	_fetch_cycle.reset(halt);
 	_cycle = &_fetch_cycle;
 }
 
 void z80emu::start_mem_read_cycle(uint16_t addr, uint8_t& val_out) {
+	log_mcycle(Z80_MCYCLE_MEM_READ, 3);
+	if (_bp) _bp->check(Z80_BREAK_IDX_READ, addr);
+	Z80_COUNT(_counters.mcycles[Z80_MEM_READ_CYCLE]++);
 	_mem_read_cycle.reset(addr, val_out);
 	_cycle = &_mem_read_cycle;
 }
 
 void z80emu::start_mem_write_cycle(uint16_t addr, uint8_t val) {
+	log_mcycle(Z80_MCYCLE_MEM_WRITE, 3);
+	if (_bp) _bp->check(Z80_BREAK_IDX_WRITE, addr, val);
+	if (_dcache) _dcache->gen[addr >> Z80_DCACHE_PAGE_BITS]++; // invalidate cached instructions in this page
+	if (_dynarec) _dynarec->invalidate(addr); // same for translated blocks
+	Z80_COUNT(_counters.mcycles[Z80_MEM_WRITE_CYCLE]++);
 	_mem_write_cycle.reset(addr, val);
 	_cycle = &_mem_write_cycle;
 }
 
 void z80emu::start_io_read_cycle(uint16_t addr, uint8_t& val_out) {
+	log_mcycle(Z80_MCYCLE_IO_READ, 4);
+	if (_bp) _bp->check(Z80_BREAK_IDX_IN, addr);
+	Z80_COUNT(_counters.mcycles[Z80_IO_READ_CYCLE]++);
 	_io_read_cycle.reset(addr, val_out);
 	_cycle = &_io_read_cycle;
 }
 
 void z80emu::start_io_write_cycle(uint16_t addr, uint8_t val) {
+	log_mcycle(Z80_MCYCLE_IO_WRITE, 4);
+	if (_bp) _bp->check(Z80_BREAK_IDX_OUT, addr, val);
+	Z80_COUNT(_counters.mcycles[Z80_IO_WRITE_CYCLE]++);
 	_io_write_cycle.reset(addr, val);
 	_cycle = &_io_write_cycle;
 }
 
 void z80emu::start_bogus_cycle(int cycles) {
+	log_mcycle(Z80_MCYCLE_BOGUS, (uint8_t)cycles);
+	Z80_COUNT(_counters.mcycles[Z80_BOGUS_CYCLE]++);
 	_bogus_cycle.reset(cycles);
 	_cycle = &_bogus_cycle;
 }
 
 void z80emu::start_intack_cycle(uint8_t& val_out) {
+	_opinfo_skip = true; // interrupt servicing (or mode 0 instruction) follows
+	Z80_COUNT(_counters.mcycles[Z80_INTACK_CYCLE]++);
 	_intack_cycle.reset(val_out);
 	_cycle = &_intack_cycle;
 }
@@ -137,6 +303,10 @@ void z80emu::set_regs(const z80_registers_t& regs) {
 	_regs = regs;
 }
 
+bool z80emu::is_halting() const {
+	return _cycle == &_fetch_cycle && _fetch_cycle.halting();
+}
+
 bool z80emu::is_nmi_pending() const {
 	return _nmi_pending;
 }
@@ -151,4 +321,383 @@ void z80emu::skip_nmi_handling() {
 
 bool z80emu::is_int_pending() const {
 	return _int_pending;
+}
+
+void z80emu::reset() {
+	_por = true;
+	memset(&_regs, 0, sizeof(_regs)); _regs.REG_SP = _regs.REG_AF = 0xFFFF;
+	_intpin = _int_skip = _int_pending = false; _int_timer = 0;
+	_nmiff = _nmi_skip = _nmi_pending = false;
+	_reset_cycles = 0; _reset_m1t2 = false;
+	_opinfo_skip = true;
+	_cycle = nullptr; // so that the instruction being interrupted isn't counted as retired
+	_instr.reset(); // this also stages the first fetch cycle
+	if (_bp) check_exec();
+}
+
+void z80emu::set_bus(const z80_bus_t& bus) {
+	_bus = bus;
+}
+
+void z80emu::set_intpin(bool state) {
+	_intpin = state;
+}
+
+int z80emu::step_instruction() {
+	if (_mem) {
+		z80_memory_map_bus bus(*_mem, _bus);
+		return step_instruction(bus);
+	}
+	z80_callback_bus bus(_bus);
+	return step_instruction(bus);
+}
+
+uint64_t z80emu::run(uint64_t tstates, bool until_idle) {
+	if (_mem) {
+		z80_memory_map_bus bus(*_mem, _bus);
+		return run(bus, tstates, until_idle);
+	}
+	z80_callback_bus bus(_bus);
+	return run(bus, tstates, until_idle);
+}
+
+uint64_t z80emu::run_limit(uint64_t limit) {
+	if (_int_timer && _int_timer < limit) limit = _int_timer; // also stop where the scheduled INT will be asserted
+	if (_events) {
+		sync_events();
+		uint64_t now = _events->now(), next = _events->next();
+		if (next > now && (next - now + 1) / 2 < limit) limit = (next - now + 1) / 2; // and where the next pending event is due
+	}
+	return limit;
+}
+
+void z80emu::count_tstates(uint64_t tstates, bool counter) {
+	count_int_timer(tstates);
+	if (counter) Z80_COUNT(_counters.tstates += tstates); // bulk runs count their own
+	if (_events) _events->advance(2 * tstates);
+}
+
+uint64_t z80emu::run_dynarec(const z80_bus_t& bus, uint64_t max_tstates) {
+	return _dynarec->run(bus, _pins, max_tstates, &_counters);
+}
+
+z80emu::dcache_entry_t* z80emu::dcache_lookup(int& tstates, bool& done) {
+	uint16_t pc = _regs.REG_PC;
+	dcache_entry_t& entry = _dcache->entries[pc & (Z80_DCACHE_ENTRIES - 1)];
+
+	if (entry.len && entry.pc == pc
+		&& entry.gen[0] == _dcache->gen[pc >> Z80_DCACHE_PAGE_BITS]
+		&& entry.gen[1] == _dcache->gen[(uint16_t)(pc + entry.len - 1) >> Z80_DCACHE_PAGE_BITS]) {
+		/* hit - replay the opcode fetches (for R and pins) and start executing right away */
+		_dcache->stats.hits++;
+		for (int i = 1; i < entry.len; i++) { // prefixes (the final opcode will overwrite the instruction register)
+			tstates += _fetch_cycle.replay(0);
+			log_mcycle(Z80_MCYCLE_FETCH, 4);
+		}
+		Z80_COUNT(_counters.mcycles[Z80_FETCH_CYCLE] += entry.len - 1); // the prefix fetches don't go through start_fetch_cycle()
+		tstates += _fetch_cycle.replay(entry.instr.instr);
+		_instr.start(entry.instr);
+		done = end_step();
+		return nullptr;
+	}
+
+	_dcache->stats.misses++;
+	return &entry;
+}
+
+void z80emu::dcache_fill(dcache_entry_t& entry, uint16_t pc, uint8_t len, const uint32_t gen[2], bool done) {
+	if (done || _instr.started()) { // DDCB/FDCB instructions are not cached, since their displacement byte is read before execution starts
+		entry.instr = _instr.decoded();
+		entry.pc = pc; entry.len = len;
+		entry.gen[0] = gen[0]; entry.gen[1] = gen[1];
+	}
+}
+
+void z80emu::set_dcache(bool enable) {
+	if (enable) _dcache.reset(new dcache_t()); // zero-initialised (all entries empty)
+	else _dcache.reset();
+}
+
+void z80emu::invalidate_dcache(uint16_t addr, size_t len) {
+	if (!_dcache || !len) return;
+	if (len > 0x10000) len = 0x10000;
+	size_t first = addr >> Z80_DCACHE_PAGE_BITS, last = (addr + len - 1) >> Z80_DCACHE_PAGE_BITS; // last may go past the final page if the range wraps around
+	for (size_t page = first; page <= last; page++) _dcache->gen[page & ((0x10000 >> Z80_DCACHE_PAGE_BITS) - 1)]++;
+}
+
+z80_dcache_stats_t z80emu::get_dcache_stats() const {
+	if (!_dcache) return {};
+	return _dcache->stats;
+}
+
+bool z80emu::quiet_boundary() const {
+	return _cycle == &_fetch_cycle && !_fetch_cycle.halting()
+		&& !_nmi_pending && !_nmiff // NMI would be serviced after the first instruction
+		&& !(_intpin && _regs.iff1); // so would INT (blocks don't contain EI, so _int_skip doesn't matter after the first instruction)
+}
+
+bool z80emu::lockstep_capable() const {
+	return !_bp && !_events && !_dcache && !_dynarec && !_ram && !_mem;
+}
+
+bool z80emu::lockstep_ready() const {
+	return _cycle && lockstep_capable() && !_instr.started() && !_instr.prefixed() && quiet_boundary();
+}
+
+int z80emu::step_fetched(uint8_t instr) {
+	z80_callback_bus bus(_bus); // (no memory map on capable instances)
+	int t = _fetch_cycle.replay(instr); // in place of the first run_cycle() of step_instruction()
+	while (!end_cycle() || _instr.prefixed()) t += run_cycle(bus);
+	count_tstates(t, true);
+	return t;
+}
+
+void z80emu::retire_lockstep(uint8_t instr, uint8_t r, uint64_t count) {
+	/* pins following the last opcode fetch (see z80_fetch_cycle::replay()) */
+	_pins = Z80_PINS_NOMINAL;
+	_pins.state =
+		(_pins.state & ~(Z80_RFSH | Z80_A_ALL))
+		| ((z80_pinbits_t)((_regs.REG_I << 8) | r) << Z80_PIN_A_BASE);
+
+	/* then the decoder finishing it, and the next fetch being started */
+	_instr.retire(instr);
+	Z80_COUNT(_counters.instructions += count - 1; _counters.mcycles[Z80_FETCH_CYCLE] += count - 1); // start_fetch_cycle() counts the last one
+	start_fetch_cycle();
+	_nmi_skip = _int_skip = false; // see end_step()
+	count_tstates(4 * count, true);
+}
+
+bool z80emu::set_dynarec(bool enable) {
+	_dynarec.reset();
+	if (!enable) return true;
+	if (!z80_dynarec::supported()) return false;
+
+	_dynarec.reset(new z80_dynarec(_regs));
+	if (!_dynarec->ready()) {
+		_dynarec.reset(); // couldn't allocate executable memory
+		return false;
+	}
+	return true;
+}
+
+void z80emu::invalidate_dynarec(uint16_t addr, size_t len) {
+	if (_dynarec) _dynarec->invalidate(addr, len);
+}
+
+z80_dynarec_stats_t z80emu::get_dynarec_stats() const {
+	if (!_dynarec) return {};
+	return _dynarec->stats();
+}
+
+void z80emu::set_event_queue(bool enable) {
+	if (enable) _events.reset(new z80_event_queue());
+	else _events.reset();
+}
+
+bool z80emu::post_event(const z80_event_t& event) {
+	return _events && _events->post(event);
+}
+
+uint64_t z80emu::get_event_time() const {
+	return (_events) ? _events->now() : 0;
+}
+
+void z80emu::sync_events() {
+	if (_events->advance(0) && _events->process()) _nmiff = true;
+	if (_events->override_mask() & Z80_INT) _intpin = !(_events->override_state() & Z80_INT); // clock() samples this from the pins instead
+}
+
+void z80emu::set_direct_ram(uint8_t* mem, uint16_t addr, size_t len) {
+	if (len > 0x10000 - (size_t)addr) len = 0x10000 - addr; // don't wrap around
+	_ram = (len) ? mem : nullptr;
+	_ram_addr = addr; _ram_len = (_ram) ? len : 0;
+}
+
+void z80emu::set_memory_map(z80_memory_map* map) {
+	_mem = map;
+}
+
+void z80emu::set_breakpoints(bool enable) {
+	if (enable) _bp.reset(new z80_breakpoints());
+	else _bp.reset();
+}
+
+void z80emu::set_breakpoint(uint8_t types, uint16_t addr, size_t len, bool state) {
+	if (_bp) _bp->set(types, addr, len, state);
+}
+
+void z80emu::clear_breakpoints() {
+	if (_bp) _bp->clear();
+}
+
+bool z80emu::get_break(z80_break_t& brk) {
+	return _bp && _bp->take(brk);
+}
+
+bool z80emu::set_dirty_tracking(size_t page_size) {
+	if (!page_size) {
+		_dirty.reset();
+		_mem_write_cycle.set_dirty_map(nullptr);
+		return true;
+	}
+	for (int bits = Z80_DIRTY_MIN_PAGE_BITS; bits <= Z80_DIRTY_MAX_PAGE_BITS; bits++) {
+		if (page_size == ((size_t)1 << bits)) {
+			_dirty.reset(new z80_dirty_map(bits));
+			_mem_write_cycle.set_dirty_map(_dirty.get());
+			return true;
+		}
+	}
+	return false;
+}
+
+void z80emu::mark_dirty(uint16_t addr, size_t len) {
+	if (_dirty) _dirty->mark(addr, len);
+}
+
+size_t z80emu::collect_dirty(z80_mem_range_t* ranges, size_t max) {
+	return (_dirty) ? _dirty->collect(ranges, max) : 0;
+}
+
+void z80emu::check_exec() {
+	if (_cycle == &_fetch_cycle && !_fetch_cycle.halting() && !_instr.prefixed()) _bp->check(Z80_BREAK_IDX_EXEC, _regs.REG_PC); // not a halted fetch or the rest of a prefixed instruction
+}
+
+size_t z80emu::ram_avail(uint16_t addr, bool down) const {
+	if (addr < _ram_addr) return 0;
+	size_t off = (size_t)(addr - _ram_addr);
+	if (off >= _ram_len) return 0;
+	return (down) ? (off + 1) : (_ram_len - off);
+}
+
+int z80emu::step_blk_bulk(uint64_t max_tstates) {
+	/* LDIR/CPIR/LDDR/CPDR (ED B0/B1/B8/B9) */
+	uint16_t pc = _regs.REG_PC;
+	if (ram_avail(pc, false) < 2) return 0;
+	const uint8_t* op = &_ram[pc - _ram_addr];
+	if (op[0] != 0xED || (op[1] & 0xF6) != 0xB0) return 0;
+	bool down = op[1] & 0x08, cp = op[1] & 0x01;
+
+	/* each repeating iteration takes 21 T cycles (opcode fetches 4 + 4, memory read 3, then write 3 + bogus 2 + 5 or bogus 5 + 5) */
+	size_t n = (uint16_t)(_regs.REG_BC - 1); // the final iteration (where BC becomes 0) doesn't repeat, so the decoder will do it
+	if (n > max_tstates / 21) n = (size_t)(max_tstates / 21);
+	size_t avail = ram_avail(_regs.REG_HL, down);
+	if (n > avail) n = avail;
+	uint16_t hl = _regs.REG_HL, de = _regs.REG_DE;
+	uint8_t* src = &_ram[hl - _ram_addr];
+	if (!cp) {
+		avail = ram_avail(de, down);
+		if (n > avail) n = avail;
+		for (int i = 0; i < 2; i++) { // stop before overwriting the instruction itself
+			uint16_t addr = pc + i;
+			size_t dist = (down) ? (uint16_t)(de - addr) : (uint16_t)(addr - de);
+			if (dist < n) n = dist;
+		}
+	}
+	else {
+		/* the iteration finding A will stop repeating, so leave it to the decoder */
+		for (size_t i = 0; i < n; i++) {
+			if (src[(down) ? -(ptrdiff_t)i : (ptrdiff_t)i] == _regs.REG_A) {
+				n = i;
+				break;
+			}
+		}
+	}
+	if (!n) return 0;
+
+	uint16_t last = (uint16_t)((down) ? (hl - (n - 1)) : (hl + (n - 1))); // source address of the last iteration
+	uint8_t val; // byte read by the last iteration
+	if (!cp) {
+		uint8_t* dst = &_ram[de - _ram_addr];
+		ptrdiff_t dist = dst - src;
+		if ((!down && dist > 0 && (size_t)dist < n) || (down && dist < 0 && (size_t)-dist < n)) {
+			/* the destination catches up with bytes yet to be read (i.e. a fill) - copy one byte at a time */
+			for (size_t i = 0; i < n; i++) {
+				ptrdiff_t ofs = (down) ? -(ptrdiff_t)i : (ptrdiff_t)i;
+				dst[ofs] = src[ofs];
+			}
+		}
+		else if (down) memmove(dst - (n - 1), src - (n - 1), n);
+		else memmove(dst, src, n);
+
+		uint16_t de_last = (uint16_t)((down) ? (de - (n - 1)) : (de + (n - 1)));
+		val = _ram[de_last - _ram_addr];
+		invalidate_dcache((down) ? de_last : de, n); invalidate_dynarec((down) ? de_last : de, n); mark_dirty((down) ? de_last : de, n); // our writes don't go through start_mem_write_cycle()
+
+		_regs.REG_DE = (down) ? (de - n) : (de + n);
+		_regs.REG_Z = val + _regs.REG_A;
+		_regs.REG_F = (_regs.REG_F & (Z80_FLAG_C | Z80_FLAG_Z | Z80_FLAG_S)) | Z80_FLAG_PV; // F3 and F5 are filled in below
+
+		/* the last cycle was the write (the bogus cycles don't touch the pins) */
+		_pins = Z80_PINS_NOMINAL;
+		_pins.dir |= Z80_D_ALL;
+		_pins.state =
+			(_pins.state & ~Z80_A_ALL)
+			| ((z80_pinbits_t)de_last << Z80_PIN_A_BASE)
+			| ((z80_pinbits_t)val << Z80_PIN_D_BASE);
+	}
+	else {
+		val = _ram[last - _ram_addr];
+		uint8_t carry = _regs.REG_F & Z80_FLAG_C;
+		_regs.REG_Z = val;
+		z80_alu_op(_regs, 0b111); // CP for S, N, Z and H
+		_regs.REG_Z = _regs.REG_A - val - ((_regs.REG_F >> Z80_FLAGBIT_H) & 1);
+		_regs.REG_F = (_regs.REG_F & (Z80_FLAG_S | Z80_FLAG_N | Z80_FLAG_Z | Z80_FLAG_H)) | carry | Z80_FLAG_PV;
+
+		/* the last cycle was the read */
+		_pins = Z80_PINS_NOMINAL;
+		_pins.state =
+			(_pins.state & ~Z80_A_ALL)
+			| ((z80_pinbits_t)last << Z80_PIN_A_BASE)
+			| ((z80_pinbits_t)val << Z80_PIN_D_BASE);
+	}
+
+	/* state following the last repeating iteration (see exec_blk_ld() and exec_blk_cp()) */
+	_regs.REG_HL = (down) ? (hl - n) : (hl + n);
+	_regs.REG_BC -= (uint16_t)n;
+	_regs.Q = _regs.REG_F =
+		(_regs.REG_F & ~(Z80_FLAG_F3 | Z80_FLAG_F5))
+		| (_regs.REG_PCH & (Z80_FLAG_F3 | Z80_FLAG_F5)); // PC has been rewound to the instruction
+	_regs.MEMPTR = pc + 1;
+	_regs.REG_R = (_regs.REG_R + 2 * n) & 0x7F; // two opcode fetches per iteration
+	_regs.instr = op[1];
+
+#if !defined(LLZ80EMU_NO_COUNTERS)
+	const z80_opinfo_t& info = z80_opinfo_tables.op[Z80_OPSPACE_ED][op[1]]; // machine cycles of a repeating iteration
+	for (int i = 0; i < Z80_MCYCLE_TYPES; i++) _counters.mcycles[i] += n * info.counts[1][i];
+	_counters.instructions += n; _counters.tstates += 21 * n;
+#endif
+	return (int)(21 * n);
+}
+
+bool z80emu::is_idle() const {
+	return is_halting() && !_nmi_pending && !_nmiff && !(_intpin && _regs.iff1);
+}
+
+uint64_t z80emu::skip_idle(uint64_t tstates) {
+	if (!tstates || !is_idle()) return 0;
+
+	/* replicate the halted opcode fetches (each followed by a NOP) - see z80_fetch_cycle::replay() */
+	uint64_t n = (tstates + 3) / 4; // number of fetches
+	uint8_t r_last = (n > 1) ? (uint8_t)((_regs.REG_R + n - 1) & 0x7F) : _regs.REG_R; // refresh address of the last fetch
+	_pins = Z80_PINS_NOMINAL;
+	_pins.state =
+		(_pins.state & ~(Z80_RFSH | Z80_A_ALL | Z80_HALT))
+		| ((z80_pinbits_t)((_regs.REG_I << 8) | r_last) << Z80_PIN_A_BASE);
+	_regs.REG_R = (uint8_t)((_regs.REG_R + n) & 0x7F);
+	_regs.instr = 0x00; _regs.Q = 0;
+	Z80_COUNT(_counters.mcycles[Z80_FETCH_CYCLE] += n; _counters.tstates += 4 * n);
+	return 4 * n;
+}
+
+void z80emu::schedule_int(uint64_t tstates) {
+	_int_timer = tstates;
+}
+
+void z80emu::count_int_timer(uint64_t tstates) {
+	if (!_int_timer) return;
+	if (tstates >= _int_timer) {
+		_int_timer = 0;
+		_intpin = true; // time's up
+	}
+	else _int_timer -= tstates;
 }
\ No newline at end of file
@@ -2,8 +2,18 @@
 
 #include "pins.h"
 #include "registers.h"
+#include "bus.h"
 #include "cycle.h"
 #include "instr_decoder.h"
+#include "dynarec.h"
+#include "opinfo.h"
+#include "counters.h"
+#include "events.h"
+#include "breakpoints.h"
+#include "dirty.h"
+#include "state.h"
+
+#include <memory>
 
 /* dllexport/dllimport macro for Windows */
 #if !defined(LLZ80EMU_API) // allow overriding
@@ -21,12 +31,28 @@
 #endif
 
 namespace llz80emu {
+	/* decoded instruction cache (see z80emu::set_dcache()) */
+	#define Z80_DCACHE_ENTRIES					4096 // number of cache entries (direct-mapped by PC - must be a power of 2)
+	#define Z80_DCACHE_PAGE_BITS				8 // log2 of the page size used for invalidation on memory writes
+
+	typedef struct {
+		uint64_t hits; // instructions whose opcode bytes were taken from the cache
+		uint64_t misses; // cacheable instructions that had to be fetched and decoded through the bus
+	} z80_dcache_stats_t;
+
+	class z80_memory_map; // see memmap.h
+	template<size_t N> class z80emu_batch; // see batch.h
+
 	class z80emu {
 	public:
 		LLZ80EMU_API z80emu(bool clk);
+		LLZ80EMU_API ~z80emu();
 
 		LLZ80EMU_API void set_clkpin(bool state); // set the clock pin state (without clocking)
 		LLZ80EMU_API z80_pins_t clock(z80_pinbits_t state); // clock the CPU by one half-cycle (rising edge or falling edge)
+		LLZ80EMU_API size_t clock_n(size_t count, z80_pinbits_t& state, z80_pin_handler_t handler, void* ctx); // clock the CPU by up to count half-cycles, calling handler only on half-cycles where the bus is active or an input pin is about to be sampled with the bus idle (and stopping right after the half-cycle on which an access hitting a breakpoint is staged); return the number of half-cycles run
+		LLZ80EMU_API bool is_bus_released() const; // return whether the CPU has released the bus, and will stay off it for as long as BUSREQ is held low
+		LLZ80EMU_API void skip_released(size_t count, z80_pinbits_t state); // clock the CPU by count half-cycles with fixed input pin states, skipping through them in one go once it is off the bus for good (see is_bus_released()) or held in reset
 
 		LLZ80EMU_API z80_pins_t get_pins(); // get pins without clocking
 		LLZ80EMU_API z80_registers_t get_regs(); // get registers
@@ -34,6 +60,64 @@ namespace llz80emu {
 
 		LLZ80EMU_API void trigger_nmi(); // trigger NMI pin (to be called on NMI falling edge)
 
+		LLZ80EMU_API z80_counters_t get_counters() const; // get a snapshot of the performance counters (always zero when built with LLZ80EMU_NO_COUNTERS)
+		LLZ80EMU_API void reset_counters(); // zero the performance counters
+
+		LLZ80EMU_API static const z80_uop_t* get_uop_program(bool ed, uint8_t opcode); // get the micro-op program (terminated by Z80_UOP_END) for an unprefixed or ED-prefixed opcode, or nullptr if it's executed by a dedicated executor
+		LLZ80EMU_API static const z80_opinfo_t& get_opinfo(z80_opspace_t space, uint8_t opcode); // get the length, machine cycle sequence and T cycle cost of an opcode
+
+		/* instruction-level execution (bypassing pin emulation) */
+		LLZ80EMU_API void reset(); // perform a normal reset immediately (for use when the RESET pin is not driven through clock())
+		LLZ80EMU_API void set_bus(const z80_bus_t& bus); // set host bus callbacks
+		LLZ80EMU_API void set_intpin(bool state); // set INT pin state (true = active = INT low) - clock() overrides this with the sampled pin state
+		LLZ80EMU_API int step_instruction(); // execute until the next instruction boundary and return the number of T cycles taken (0 if the CPU is in reset)
+		LLZ80EMU_API uint64_t run(uint64_t tstates, bool until_idle = false); // execute instructions for at least the specified number of T cycles (or, if until_idle is set, until the CPU halts with no NMI/INT to service), stopping early after an instruction that hit a breakpoint, and return the actual number of T cycles taken
+
+		/* same as above, with accesses going through a host bus class (see bus.h) instead of the z80_bus_t callbacks or memory map, so that they can be inlined into the cycle code */
+		template<class Bus> int step_instruction(Bus& bus);
+		template<class Bus> uint64_t run(Bus& bus, uint64_t tstates, bool until_idle = false);
+
+		/* HALT fast-forwarding for instruction-level execution (run() does this automatically) */
+		LLZ80EMU_API bool is_idle() const; // return whether the CPU is halted with no NMI/INT to service
+		LLZ80EMU_API uint64_t skip_idle(uint64_t tstates); // if idle, skip halted opcode fetches for at least the specified number of T cycles in one go (without calling the host's mem_read callback), and return the number of T cycles skipped (0 if not idle)
+		LLZ80EMU_API void schedule_int(uint64_t tstates); // assert the INT pin once the specified number of T cycles have been run through step_instruction()/run() (0 = cancel), so that run() can skip HALT right up to the interrupt
+
+		/* decoded instruction cache for instruction-level execution (opcode fetches served by the cache skip the host's mem_read callback) */
+		LLZ80EMU_API void set_dcache(bool enable); // enable (and flush) or disable the cache - disabled by default
+		LLZ80EMU_API void invalidate_dcache(uint16_t addr = 0, size_t len = 0x10000); // invalidate cached instructions in the specified memory range (for changes not made by the CPU, e.g. DMA or bank switching)
+		LLZ80EMU_API z80_dcache_stats_t get_dcache_stats() const; // get cache hit/miss counters
+
+		/* dynamic recompiler for run() (x86-64 hosts only, requires building with LLZ80EMU_DYNAREC) */
+		LLZ80EMU_API bool set_dynarec(bool enable); // enable (and flush) or disable the dynarec - disabled by default; return false if it is not available
+		LLZ80EMU_API void invalidate_dynarec(uint16_t addr = 0, size_t len = 0x10000); // invalidate translated blocks in the specified memory range (for changes not made by the CPU, e.g. DMA or bank switching)
+		LLZ80EMU_API z80_dynarec_stats_t get_dynarec_stats() const; // get translation/execution counters
+
+		/* lock-free input event queue (for peripherals running on other threads) */
+		LLZ80EMU_API void set_event_queue(bool enable); // enable (with no pending events or pin overrides) or disable the queue - disabled by default; not thread-safe, so this is to be done before producers start
+		LLZ80EMU_API bool post_event(const z80_event_t& event); // queue a timestamped NMI/pin override event (thread-safe and lock-free) - return false if the queue is full or disabled
+		LLZ80EMU_API uint64_t get_event_time() const; // get the event time (half-cycles run since enabling the queue, with instruction-level execution counting 2 per T cycle) - can be called from any thread
+
+		/* direct-mapped RAM for run() (lets repeated LDIR/LDDR/CPIR/CPDR iterations be done in bulk) */
+		LLZ80EMU_API void set_direct_ram(uint8_t* mem, uint16_t addr = 0, size_t len = 0x10000); // register host memory backing [addr, addr + len) (which must behave as plain RAM - no side effects on access), or unregister it if mem is nullptr
+
+		/* paged memory map for instruction-level execution (see memmap.h) */
+		LLZ80EMU_API void set_memory_map(z80_memory_map* map); // have memory accesses (opcode fetches included) go through map instead of the host's mem_read/mem_write callbacks, or go back to the callbacks if map is nullptr - I/O and interrupt acknowledgment still use the callbacks
+
+		/* breakpoints and watchpoints (clock_n() and run() stop on hits - see breakpoints.h) */
+		LLZ80EMU_API void set_breakpoints(bool enable); // enable (with nothing set) or disable the breakpoint engine - disabled by default; run() doesn't use direct-mapped RAM or the dynarec while it's enabled
+		LLZ80EMU_API void set_breakpoint(uint8_t types, uint16_t addr, size_t len = 1, bool state = true); // set (or clear if state is false) breakpoints of the specified Z80_BREAK_* types on memory addresses/ports [addr, addr + len) - ignored if the engine is disabled
+		LLZ80EMU_API void clear_breakpoints(); // clear all breakpoints
+		LLZ80EMU_API bool get_break(z80_break_t& brk); // get the latest hit, returning false if there hasn't been any since the last call
+
+		/* dirty page tracking for memory writes made by the CPU (for incremental snapshots and syncing) */
+		LLZ80EMU_API bool set_dirty_tracking(size_t page_size); // enable tracking (with all pages clean) at the specified page size (a power of 2 from 256 to 4096 bytes), or disable it if page_size is 0 - disabled by default; return false if page_size is invalid
+		LLZ80EMU_API void mark_dirty(uint16_t addr, size_t len = 1); // mark the pages overlapping the specified memory range as dirty (for changes not made by the CPU, e.g. DMA)
+		LLZ80EMU_API size_t collect_dirty(z80_mem_range_t* ranges, size_t max); // store up to max ranges of consecutive dirty pages (in ascending address order) into ranges and mark them clean, and return the number of ranges stored - pages beyond those stay dirty until the next call
+
+		/* snapshots of the complete emulator state, which can be taken and restored at any half-cycle (see state.h) */
+		LLZ80EMU_API size_t save_state(void* buf, size_t size) const; // write a snapshot into buf, and return its size (Z80_STATE_SIZE), or 0 if size is too small
+		LLZ80EMU_API bool load_state(const void* buf, size_t size); // restore a snapshot (flushing the decoded instruction cache and dynarec) - return false, leaving the emulator untouched, if it is invalid or from another format version
+
 		/* cycle transition methods - not supposed to be called by library consumer! */
 		void start_fetch_cycle(bool halt = false);
 		void start_mem_read_cycle(uint16_t addr, uint8_t& val_out);
@@ -47,9 +131,18 @@ namespace llz80emu {
 		void skip_nmi_handling();
 		bool is_nmi_pending() const;
 
+		bool is_halting() const; // return whether the current cycle is an opcode fetch during HALT
+
 		void skip_int_handling();
 		bool is_int_pending() const;
 	private:
+		template<size_t N> friend class z80emu_batch; // runs register-only instructions on its own register file, with this instance's registers moved in and out
+		void tick(z80_pinbits_t state); // clock() without returning the pins (shared with clock_n())
+		bool clock_cycle(); // clock the current cycle by one half-cycle (dispatching on its type), and return true if it has finished
+		template<class Bus> int run_cycle(Bus& bus); // run the entire current cycle through a bus class (dispatching on its type), and return the number of T cycles taken
+		LLZ80EMU_API bool end_cycle(); // advance instruction execution after the current cycle has finished, then handle interrupts; return true on an instruction boundary
+		bool end_step(); // second half of end_cycle() - handle interrupts if instruction execution has finished, and return true if it has
+
 		bool _clkpin = false; // clock pin state (true = high, false = low) - this is synchronised with the RESET signal
 		bool _por = false; // whether power-on reset has been triggered in the CPU's lifetime
 
@@ -69,15 +162,153 @@ namespace llz80emu {
 
 		z80_instr_decoder _instr; // instruction decoder and executor
 
+		z80_bus_t _bus = {}; // host bus callbacks (for instruction-level execution)
+
+		/* decoded instruction cache */
+		typedef struct {
+			z80_instr_decoder::decoded_t instr; // decoded instruction
+			uint16_t pc; // address of the first opcode byte
+			uint8_t len; // number of opcode bytes, prefixes included (0 = empty entry)
+			uint32_t gen[2]; // write generation of the pages holding the first and last opcode bytes at the time of decoding
+		} dcache_entry_t;
+		typedef struct {
+			dcache_entry_t entries[Z80_DCACHE_ENTRIES];
+			uint32_t gen[0x10000 >> Z80_DCACHE_PAGE_BITS]; // per-page write generation counters
+			z80_dcache_stats_t stats;
+		} dcache_t;
+		std::unique_ptr<dcache_t> _dcache; // null if the cache is disabled
+		template<class Bus> int step_dcache(Bus& bus, bool& done); // fetch and start the next instruction through the cache, and return the number of T cycles taken (done is set if the instruction has also finished)
+		LLZ80EMU_API dcache_entry_t* dcache_lookup(int& tstates, bool& done); // replay and start the instruction at PC if it's cached (adding the T cycles taken to tstates) and return nullptr, or return the entry to be filled
+		LLZ80EMU_API void dcache_fill(dcache_entry_t& entry, uint16_t pc, uint8_t len, const uint32_t gen[2], bool done); // fill an entry once the instruction at pc has been fetched through the bus
+
+		LLZ80EMU_API uint64_t run_dynarec(const z80_bus_t& bus, uint64_t max_tstates); // run the translated block at PC (see z80_dynarec::run())
+
+		std::unique_ptr<z80_dynarec> _dynarec; // null if the dynarec is disabled
+
+		std::unique_ptr<z80_event_queue> _events; // null if the event queue is disabled
+		LLZ80EMU_API void sync_events(); // apply due events at an instruction boundary (for instruction-level execution)
+		LLZ80EMU_API bool quiet_boundary() const; // return whether several instructions can be run in one go from the current state (i.e. an instruction boundary that interrupts won't interfere with)
+
+		/* lockstep execution (see z80emu_batch) */
+		LLZ80EMU_API bool lockstep_capable() const; // return whether none of the features that have to see each instruction go through the decoder (breakpoints, event queue, caches, memory map, direct RAM) are enabled
+		LLZ80EMU_API bool lockstep_ready() const; // return whether the registers can be moved out for register-only instructions to be run on them directly (a quiet boundary on a capable instance)
+		LLZ80EMU_API int step_fetched(uint8_t instr); // step_instruction(), with the opcode byte at PC already read through the bus callbacks
+		LLZ80EMU_API void retire_lockstep(uint8_t instr, uint8_t r, uint64_t count); // account for count single-fetch instructions run on the registers directly (the last being instr, fetched with R = r), leaving the pins, decoder, counters and INT timer as stepping through them would have
+
+		/* direct-mapped RAM */
+		uint8_t* _ram = nullptr; // null if not registered
+		uint16_t _ram_addr = 0; // address of the first byte
+		size_t _ram_len = 0; // size (not wrapping around the address space)
+		size_t ram_avail(uint16_t addr, bool down) const; // return the number of bytes that can be accessed directly starting from addr, going upwards or downwards
+		LLZ80EMU_API int step_blk_bulk(uint64_t max_tstates); // run repeating iterations of the LDIR/LDDR/CPIR/CPDR instruction at PC in bulk (up to max_tstates T cycles, leaving the final one to the decoder), and return the number of T cycles taken (0 if nothing was run)
+
+		z80_memory_map* _mem = nullptr; // memory map (null if memory accesses go through the host's callbacks)
+
+		std::unique_ptr<z80_breakpoints> _bp; // null if the breakpoint engine is disabled
+		void check_exec(); // check for execute breakpoints once a new instruction's opcode fetch has been staged
+
+		std::unique_ptr<z80_dirty_map> _dirty; // null if dirty page tracking is disabled
+
 		bool _intpin = false; // sampled state of INT pin (true = active = INT low)
+		uint64_t _int_timer = 0; // number of T cycles until INT is asserted (0 = not scheduled - see schedule_int())
+		void count_int_timer(uint64_t tstates); // count down the above, asserting INT once it runs out
+		LLZ80EMU_API uint64_t run_limit(uint64_t limit); // cut the number of T cycles that run() can go through in one go short at the scheduled INT or the next pending event
+		LLZ80EMU_API void count_tstates(uint64_t tstates, bool counter); // count T cycles run at instruction level towards the scheduled INT, the event queue time and (if counter is set) the T cycle counter
 		bool _int_skip = false; // set to skip interrupt handling for the current instruction (for emulating EI behaviour)
 		bool _int_pending = false; // set when handling INT (cleared once we're out of the interrupt acknowledgment process)
 
 		bool _nmiff = false; // state of the NMI flip-flop (true = active)
 		bool _nmi_skip = false; // set to skip NMI handling (for emulating NONI)
 		bool _nmi_pending = false; // set when NMI flip-flop activity has been acknowledged, but the interrupt is not serviced yet (ie. doing bogus fetch + PC stack pushes)
+
+		z80_counters_t _counters = {}; // performance counters (left untouched when built with LLZ80EMU_NO_COUNTERS)
+	
+		/* opcode metadata self-test (only active when built with LLZ80EMU_CHECK_OPINFO) */
+		z80_mcycle_info_t _opinfo_log[2 * Z80_OPINFO_MAX_MCYCLES]; // machine cycles started for the current instruction
+		int _opinfo_len = 0; // number of entries in the above
+		bool _opinfo_skip = true; // set if the current instruction is not to be checked (i.e. interrupt servicing, HALT or coming out of reset)
+		void log_mcycle(uint8_t type, uint8_t tstates); // record machine cycle started for the current instruction
+		bool check_opinfo() const; // return whether the machine cycles recorded for the instruction that has just finished match its z80_opinfo_tables entry
 	
 		int _reset_cycles = 0; // number of cycles that RESET has been held low
 		bool _reset_m1t2 = false; // set if RESET was asserted on M1T2 rising edge (possibly special reset) - this will be confirmed with _reset_cycles
 	};
+
+	/* templated instruction-level execution */
+
+	template<class Bus> inline int z80emu::run_cycle(Bus& bus) {
+		switch (_cycle->type) {
+		case Z80_FETCH_CYCLE: return _fetch_cycle.run(bus);
+		case Z80_MEM_READ_CYCLE: return _mem_read_cycle.run(bus);
+		case Z80_MEM_WRITE_CYCLE: return _mem_write_cycle.run(bus);
+		case Z80_IO_READ_CYCLE: return _io_read_cycle.run(bus);
+		case Z80_IO_WRITE_CYCLE: return _io_write_cycle.run(bus);
+		case Z80_BOGUS_CYCLE: return _bogus_cycle.run(bus);
+		case Z80_INTACK_CYCLE: return _intack_cycle.run(bus);
+		default: return 0;
+		}
+	}
+
+	template<class Bus> int z80emu::step_dcache(Bus& bus, bool& done) {
+		int t = 0;
+		uint16_t pc = _regs.REG_PC;
+		dcache_entry_t* entry = dcache_lookup(t, done);
+		if (!entry) return t; // hit
+
+		/* miss - fetch opcode bytes through the bus as usual until the instruction has been resolved */
+		uint8_t len = 0; uint32_t gen[2];
+		do {
+			gen[1] = _dcache->gen[_regs.REG_PC >> Z80_DCACHE_PAGE_BITS]; // sample generations before the first execution step (which may stage a write to the instruction itself)
+			if (!len) gen[0] = gen[1];
+			t += run_cycle(bus); len++;
+			done = end_cycle() && !_instr.prefixed();
+		} while (!done && !_instr.started() && _cycle == &_fetch_cycle && len < UINT8_MAX);
+		dcache_fill(*entry, pc, len, gen, done);
+		return t;
+	}
+
+	template<class Bus> int z80emu::step_instruction(Bus& bus) {
+		if (!_cycle) return 0; // still in reset
+		if (_events) sync_events();
+
+		int t = 0; bool done = false;
+		if (_dcache && _cycle == &_fetch_cycle && !_fetch_cycle.halting() && !_nmi_pending) // the opcode will actually be decoded (i.e. not a HALT or NMI fetch)
+			t = step_dcache(bus, done);
+
+		if (!done) {
+			do {
+				t += run_cycle(bus);
+			} while (!end_cycle() || _instr.prefixed()); // prefixes are executed as part of the instruction they modify
+		}
+		count_tstates(t, true);
+		return t;
+	}
+
+	template<class Bus> uint64_t z80emu::run(Bus& bus, uint64_t tstates, bool until_idle) {
+		uint64_t t = 0, hits = (_bp) ? _bp->hits() : 0;
+		while (t < tstates) {
+			uint64_t limit = run_limit(tstates - t); // only run what fits, so that we stop at the same point as stepping would
+
+			uint64_t bulk = 0;
+			if (is_idle()) {
+				if (until_idle) break;
+				bulk = skip_idle(limit); // halted - skip straight to the end (or the scheduled INT)
+			}
+			else if ((_ram || _dynarec) && !_bp && quiet_boundary()) {
+				bulk = (_ram) ? step_blk_bulk(limit) : 0;
+				if (!bulk && _dynarec) bulk = run_dynarec(z80_bus_callbacks(bus), limit);
+			}
+			if (bulk) {
+				t += bulk;
+				count_tstates(bulk, false);
+				continue;
+			}
+
+			int step = step_instruction(bus);
+			if (!step) break; // still in reset
+			t += step;
+			if (_bp && _bp->hits() != hits) break; // breakpoint hit
+		}
+		return t;
+	}
 }